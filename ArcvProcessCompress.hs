@@ -130,7 +130,7 @@ compress_AND_write_to_archive_PROCESS archive command backdoor pipe = do
         crc'             <-  val crc >>== finishCRC     --    CRC
         origsize'        <-  val origsize
         write_compressor <-  if just_copy then return compressor
-                                          else getElems final_compressor >>== add_encryption_info >>== compressionDeleteTempCompressors
+                                          else getElems final_compressor >>== add_encryption_info >>== compressionDeleteTempCompressors >>== compressionPurify
         putP backdoor (ArchiveBlock {
                            blArchive     = archive
                          , blType        = block_type
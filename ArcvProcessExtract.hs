@@ -182,6 +182,8 @@ de_compress_PROCESS1 de_compress reader times command limit_memory comprMethod n
           "time" -> do time <- TABI.required p "time"
                        time' =: time
                        return aFREEARC_OK
+          --   ,         (,  dedup)
+          "testing" -> return (if cmdType (cmd_name command) == TEST_CMD  then 1  else 0)
           --  () callbacks
           _ -> return aFREEARC_ERRCODE_NOT_IMPLEMENTED
 
@@ -211,6 +213,8 @@ de_compress_PROCESS1 de_compress reader times command limit_memory comprMethod n
       callback "time" ptr 0 = do t <- peek (castPtr ptr::Ptr CDouble) >>==realToFrac
                                  time' =: t
                                  return aFREEARC_OK
+      --   ,         (,  dedup)
+      callback "testing" _ _ = return (if cmdType (cmd_name command) == TEST_CMD  then 1  else 0)
       --  () callbacks
       callback _ _ _ = return aFREEARC_ERRCODE_NOT_IMPLEMENTED
 
@@ -238,6 +238,12 @@ calcMem getMem  = maximum . map getMemSum . splitOn isEXTERNAL_Method
 -- |    "tempfile"    .
 compressionDeleteTempCompressors = filter (/="tempfile")
 
+-- |     ,     (, :lp  tor).
+--      
+compressionPurify = map purify_one
+  where purify_one method | isFakeMethod method || isEncryption method  =  method
+                          | otherwise                                    =  CompressionLib.purifyCompressionMethod method
+
 
 ----------------------------------------------------------------------------------------------------
 ----- (De)compression of data stream                                                           -----
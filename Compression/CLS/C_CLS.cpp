@@ -53,7 +53,7 @@ int CLS_METHOD::compress (CALLBACK_FUNC *_callback, void *_auxdata)
 }
 
 //   buf[MAX_METHOD_STRLEN] ,       (,   parse_CLS)
-void CLS_METHOD::ShowCompressionMethod (char *buf)
+void CLS_METHOD::ShowCompressionMethod (char *buf, bool purify)
 {
     if (strequ(params,""))
       then strcpy (buf, name);
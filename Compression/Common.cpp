@@ -9,8 +9,6 @@ int compress_all_at_once = 0;
 int jmpready = FALSE;
 jmp_buf jumper;
 
-#ifndef FREEARC_STANDALONE_TORNADO
-
 // ****************************************************************************
 // MEMORY ALLOCATION **********************************************************
 // ****************************************************************************
@@ -27,6 +25,8 @@ int g_allocCountBig = 0;
 #define alloc_debug_printf(x)
 #endif
 
+#ifndef FREEARC_STANDALONE_TORNADO
+
 void *MyAlloc(size_t size) throw()
 {
   if (size == 0)
@@ -62,54 +62,6 @@ void MidFree(void *address) throw()
   ::VirtualFree(address, 0, MEM_RELEASE);
 }
 
-static SIZE_T g_LargePageSize =
-    #ifdef _WIN64
-    (1 << 21);
-    #else
-    (1 << 22);
-    #endif
-
-typedef SIZE_T (WINAPI *GetLargePageMinimumP)();
-
-int SetLargePageSize()
-{
-  GetLargePageMinimumP largePageMinimum = (GetLargePageMinimumP)
-        ::GetProcAddress(::GetModuleHandle(TEXT("kernel32.dll")), "GetLargePageMinimum");
-  if (largePageMinimum == 0)
-    return FALSE;
-  SIZE_T size = largePageMinimum();
-  if (size == 0 || (size & (size - 1)) != 0)
-    return FALSE;
-  g_LargePageSize = size;
-  return TRUE;
-}
-
-
-void *BigAlloc(size_t size) throw()
-{
-  if (size == 0)
-    return 0;
-  alloc_debug_printf((stderr, "\nAlloc_Big %10d bytes;  count = %10d", size, g_allocCountBig++));
-
-  if (size > 256*kb)
-  {
-    void *res = ::VirtualAlloc(0, (size + g_LargePageSize - 1) & (~(g_LargePageSize - 1)),
-        MEM_COMMIT | MEM_4MB_PAGES | MEM_TOP_DOWN, PAGE_READWRITE);
-    if (res != 0)
-      return res;
-  }
-  return ::VirtualAlloc(0, size, MEM_COMMIT | MEM_TOP_DOWN, PAGE_READWRITE);
-}
-
-void BigFree(void *address) throw()
-{
-  if (address == 0)
-    return;
-  alloc_debug_printf((stderr, "\nFree_Big; count = %10d", --g_allocCountBig));
-
-  ::VirtualFree(address, 0, MEM_RELEASE);
-}
-
 #endif
 
 
@@ -189,6 +141,508 @@ char *str_replace (char *orig, char *from, char *to)
 
 #endif // !FREEARC_STANDALONE_TORNADO
 
+
+// ****************************************************************************
+// MIRRORED RING BUFFER *******************************************************
+// ****************************************************************************
+
+#ifdef FREEARC_WIN
+
+void *MirrorAlloc (size_t size) throw()
+{
+  HANDLE mapping = ::CreateFileMapping (INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64)size>>32), (DWORD)size, NULL);
+  if (mapping == NULL)
+    return NULL;
+  // Find free address range and map both views there; another thread may occupy this range meanwhile, so retry a few times
+  for (int attempt=0; attempt<10; attempt++)
+  {
+    BYTE *address = (BYTE*) ::VirtualAlloc (NULL, 2*size, MEM_RESERVE, PAGE_NOACCESS);
+    if (address == NULL)
+      break;
+    ::VirtualFree (address, 0, MEM_RELEASE);
+    void *view1 = ::MapViewOfFileEx (mapping, FILE_MAP_ALL_ACCESS, 0, 0, size, address);
+    void *view2 = ::MapViewOfFileEx (mapping, FILE_MAP_ALL_ACCESS, 0, 0, size, address+size);
+    if (view1 && view2) {
+      ::CloseHandle (mapping);   // Views hold their own references to the mapping
+      return address;
+    }
+    if (view1)  ::UnmapViewOfFile (view1);
+    if (view2)  ::UnmapViewOfFile (view2);
+  }
+  ::CloseHandle (mapping);
+  return NULL;
+}
+
+void MirrorFree (void *address, size_t size) throw()
+{
+  if (address == 0)
+    return;
+  ::UnmapViewOfFile (address);
+  ::UnmapViewOfFile ((BYTE*)address+size);
+}
+
+size_t MirrorRoundUp (size_t size) throw()
+{
+  return (size + MIRROR_GRANULARITY - 1) / MIRROR_GRANULARITY * MIRROR_GRANULARITY;
+}
+
+#else // For Unix:
+#include <sys/mman.h>
+
+static size_t HugePageSize (void);
+static void CountBigAlloc (int type, size_t size);
+
+void *MirrorAlloc (size_t size) throw()
+{
+  // Large pages policy is applied only if the buffer consists of whole huge pages
+  int mode = GetLargePages(),  type = PAGES_ORDINARY;
+  size_t align = (mode==LARGE_PAGES_THP || mode==LARGE_PAGES_HUGE) && size % HugePageSize() == 0?  HugePageSize() : 0;
+
+  int fd = -1;
+#ifdef MFD_HUGETLB
+  // Succeeds only if the administrator has reserved huge pages (vm.nr_hugepages)
+  if (mode == LARGE_PAGES_HUGE  &&  align  &&  (fd = memfd_create ("freearc-mirror", MFD_HUGETLB)) >= 0)
+    type = PAGES_HUGE;
+#endif
+#ifdef MFD_CLOEXEC
+  // Anonymous memory file isn't limited by the size of /dev/shm
+  if (fd < 0)
+    fd = memfd_create ("freearc-mirror", MFD_CLOEXEC);
+#endif
+  bool sized = false;
+  if (fd >= 0)
+    sized = (ftruncate (fd, size) == 0);
+  else
+  {
+    // Create shared memory object and remove its name immediately - it will be alive while mapped
+    char name[64];
+    sprintf (name, "/freearc-mirror-%d-%p", int(getpid()), (void*)&name);
+    fd = shm_open (name, O_RDWR|O_CREAT|O_EXCL, 0600);
+    if (fd < 0)
+      return NULL;
+    shm_unlink (name);
+    // The object is sparse: reserve its space now, otherwise touching pages that don't fit into /dev/shm raises SIGBUS
+    sized = (posix_fallocate (fd, 0, size) == 0);
+  }
+  BYTE *address = NULL;
+  if (sized)
+  {
+    // Reserve address range (aligned to huge page) and then map the object twice into it
+    void *area = mmap (NULL, 2*size+align, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (area != MAP_FAILED)
+    {
+      address = (BYTE*) area;
+      if (align)
+      {
+        size_t skew = (align - (size_t)area % align) % align;
+        if (skew)          munmap (address, skew);
+        if (align-skew)    munmap (address+skew+2*size, align-skew);
+        address += skew;
+      }
+      if (mmap (address,      size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED
+      ||  mmap (address+size, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED)
+        munmap (address, 2*size),  address = NULL;
+    }
+  }
+  close (fd);
+  if (address == NULL  &&  type == PAGES_HUGE)
+  {
+    // Huge pages aren't reserved - fall back to transparent ones
+    LargePagesScope large_pages (LARGE_PAGES_THP);
+    return MirrorAlloc (size);
+  }
+  if (address == NULL)
+    return NULL;
+
+#ifdef MADV_HUGEPAGE
+  // Shared memory gets transparent huge pages only if /sys/kernel/mm/transparent_hugepage/shmem_enabled allows it
+  if (align  &&  type == PAGES_ORDINARY  &&  madvise (address, 2*size, MADV_HUGEPAGE) == 0)
+    type = PAGES_TRANSPARENT;
+#endif
+  CountBigAlloc (type, size);
+  return address;
+}
+
+void MirrorFree (void *address, size_t size) throw()
+{
+  if (address == 0)
+    return;
+  munmap (address, 2*size);
+}
+
+size_t MirrorRoundUp (size_t size) throw()
+{
+  // Smaller buffers are not worth rounding up to the huge page size
+  int mode = GetLargePages();
+  size_t granularity = (mode==LARGE_PAGES_THP || mode==LARGE_PAGES_HUGE) && size >= HugePageSize()?  mymax (HugePageSize(), MIRROR_GRANULARITY)  :  MIRROR_GRANULARITY;
+  return (size + granularity - 1) / granularity * granularity;
+}
+
+#endif // Windows/Unix
+
+
+// ****************************************************************************
+// RESERVED ADDRESS RANGE *****************************************************
+// ****************************************************************************
+
+#ifdef FREEARC_WIN
+
+void *ReserveAlloc (size_t size) throw()
+{
+  return ::VirtualAlloc (NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+int CommitAlloc (void *address, size_t size) throw()
+{
+  return size==0  ||  ::VirtualAlloc (address, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
+void ReserveFree (void *address, size_t size) throw()
+{
+  if (address == 0)
+    return;
+  ::VirtualFree (address, 0, MEM_RELEASE);
+}
+
+#else // For Unix:
+
+void *ReserveAlloc (size_t size) throw()
+{
+  void *address = mmap (NULL, size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  if (address == MAP_FAILED)
+    return NULL;
+#ifdef MADV_HUGEPAGE
+  if (GetLargePages() == LARGE_PAGES_THP  ||  GetLargePages() == LARGE_PAGES_HUGE)
+    madvise (address, size, MADV_HUGEPAGE);
+#endif
+  return address;
+}
+
+int CommitAlloc (void *address, size_t size) throw()
+{
+  // mprotect() needs page-aligned start
+  size_t pagesize = sysconf (_SC_PAGESIZE),  skew = (size_t)address & (pagesize-1);
+  return size==0  ||  mprotect ((BYTE*)address - skew, size + skew, PROT_READ|PROT_WRITE) == 0;
+}
+
+void ReserveFree (void *address, size_t size) throw()
+{
+  if (address == 0)
+    return;
+  munmap (address, size);
+}
+
+#endif // Windows/Unix
+
+
+// ****************************************************************************
+// LARGE PAGES ****************************************************************
+// ****************************************************************************
+
+static THREAD_LOCAL int LargePages = LARGE_PAGES_DEFAULT;   // Policy of the current thread
+int GetLargePages (void)      {return LargePages;}
+int SetLargePages (int mode)  {int saved = LargePages;  LargePages = mode;  return saved;}
+
+// Statistics and list of huge page blocks are shared by all threads and protected by spinlock
+static uint64 BigAllocBytes[PAGE_TYPES];
+static volatile long BigAllocLocked = 0;
+
+#ifdef FREEARC_WIN
+static void LockBigAlloc()    {while (InterlockedExchange (&BigAllocLocked, 1))  Sleep(0);}
+static void UnlockBigAlloc()  {InterlockedExchange (&BigAllocLocked, 0);}
+#else
+#include <sched.h>
+static void LockBigAlloc()    {while (__sync_lock_test_and_set (&BigAllocLocked, 1))  sched_yield();}
+static void UnlockBigAlloc()  {__sync_lock_release (&BigAllocLocked);}
+#endif
+
+static void CountBigAlloc (int type, size_t size)
+{
+  LockBigAlloc();
+  BigAllocBytes[type] += size;
+  UnlockBigAlloc();
+}
+
+#ifdef FREEARC_WIN
+
+static SIZE_T g_LargePageSize =
+    #ifdef _WIN64
+    (1 << 21);
+    #else
+    (1 << 22);
+    #endif
+
+typedef SIZE_T (WINAPI *GetLargePageMinimumP)();
+
+int SetLargePageSize()
+{
+  GetLargePageMinimumP largePageMinimum = (GetLargePageMinimumP)
+        ::GetProcAddress(::GetModuleHandle(TEXT("kernel32.dll")), "GetLargePageMinimum");
+  if (largePageMinimum == 0)
+    return FALSE;
+  SIZE_T size = largePageMinimum();
+  if (size == 0 || (size & (size - 1)) != 0)
+    return FALSE;
+  g_LargePageSize = size;
+  return TRUE;
+}
+
+
+void *BigAlloc(size_t size) throw()
+{
+  if (size == 0)
+    return 0;
+  alloc_debug_printf((stderr, "\nAlloc_Big %10d bytes;  count = %10d", size, g_allocCountBig++));
+
+  // Windows has no transparent huge pages, so LARGE_PAGES_THP means ordinary pages here
+  if (size > 256*kb  &&  (LargePages==LARGE_PAGES_DEFAULT || LargePages==LARGE_PAGES_HUGE))
+  {
+    SIZE_T allocsize = (size + g_LargePageSize - 1) & (~(g_LargePageSize - 1));
+    void *res = ::VirtualAlloc(0, allocsize, MEM_COMMIT | MEM_4MB_PAGES | MEM_TOP_DOWN, PAGE_READWRITE);
+    if (res != 0)
+    {
+      CountBigAlloc (PAGES_HUGE, allocsize);
+      return res;
+    }
+  }
+  void *res = ::VirtualAlloc(0, size, MEM_COMMIT | MEM_TOP_DOWN, PAGE_READWRITE);
+  if (res != 0)
+    CountBigAlloc (PAGES_ORDINARY, size);
+  return res;
+}
+
+void BigFree(void *address) throw()
+{
+  if (address == 0)
+    return;
+  alloc_debug_printf((stderr, "\nFree_Big; count = %10d", --g_allocCountBig));
+
+  ::VirtualFree(address, 0, MEM_RELEASE);
+}
+
+void GetBigAllocStats (uint64 bytes[PAGE_TYPES], size_t pagesize[PAGE_TYPES])
+{
+  SYSTEM_INFO si;  GetSystemInfo (&si);
+  LockBigAlloc();
+  iterate_var(i,PAGE_TYPES)  bytes[i] = BigAllocBytes[i];
+  UnlockBigAlloc();
+  pagesize[PAGES_ORDINARY]    = si.dwPageSize;
+  pagesize[PAGES_TRANSPARENT] = g_LargePageSize;
+  pagesize[PAGES_HUGE]        = g_LargePageSize;
+}
+
+#else // For Unix:
+
+// Size of huge pages reported by the kernel (2mb on x86-64)
+static size_t HugePageSize (void)
+{
+  static size_t size = 0;
+  if (size == 0)
+  {
+    size_t kbytes = 0;  char line[256];
+    FILE *f = fopen ("/proc/meminfo", "r");
+    if (f)
+    {
+      while (fgets (line, sizeof(line), f))
+        if (sscanf (line, "Hugepagesize: %lu kB", (unsigned long*) &kbytes) == 1)
+          break;
+      fclose (f);
+    }
+    size = kbytes? kbytes*kb : 2*mb;
+  }
+  return size;
+}
+
+// Blocks allocated by mmap(MAP_HUGETLB) - BigFree() needs their sizes. All other blocks are allocated by malloc()
+struct HugeBlock {void *address; size_t size; HugeBlock *next;};
+static HugeBlock *HugeBlocks = NULL;
+
+void *BigAlloc(size_t size) throw()
+{
+  if (size == 0)
+    return 0;
+  alloc_debug_printf((stderr, "\nAlloc_Big %10d bytes;  count = %10d", size, g_allocCountBig++));
+
+  // Smaller blocks are not worth rounding up to the huge page size
+  size_t hugepage = HugePageSize(),  allocsize = (size + hugepage - 1) & ~(hugepage - 1);
+  int mode = size < hugepage? LARGE_PAGES_OFF : LargePages;
+
+#ifdef MAP_HUGETLB
+  if (mode == LARGE_PAGES_HUGE)
+  {
+    // Succeeds only if the administrator has reserved huge pages (vm.nr_hugepages)
+    void *res = mmap (NULL, allocsize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (res != MAP_FAILED)
+    {
+      HugeBlock *block = (HugeBlock*) malloc (sizeof(HugeBlock));
+      if (block)
+      {
+        block->address = res,  block->size = allocsize;
+        LockBigAlloc();
+        block->next = HugeBlocks,  HugeBlocks = block;
+        BigAllocBytes[PAGES_HUGE] += allocsize;
+        UnlockBigAlloc();
+        return res;
+      }
+      munmap (res, allocsize);
+    }
+  }
+#endif
+
+#ifdef MADV_HUGEPAGE
+  if (mode == LARGE_PAGES_THP  ||  mode == LARGE_PAGES_HUGE)
+  {
+    // Aligned block allows the kernel to map it entirely with huge pages
+    void *res;
+    if (posix_memalign (&res, hugepage, allocsize) == 0)
+    {
+      madvise (res, allocsize, MADV_HUGEPAGE);
+      CountBigAlloc (PAGES_TRANSPARENT, allocsize);
+      return res;
+    }
+  }
+#endif
+
+  void *res = ::malloc(size);
+  if (res != 0)
+    CountBigAlloc (PAGES_ORDINARY, size);
+  return res;
+}
+
+void BigFree(void *address) throw()
+{
+  if (address == 0)
+    return;
+  alloc_debug_printf((stderr, "\nFree_Big; count = %10d", --g_allocCountBig));
+
+  LockBigAlloc();
+  HugeBlock **p = &HugeBlocks;
+  while (*p  &&  (*p)->address != address)
+    p = &(*p)->next;
+  HugeBlock *block = *p;
+  if (block)  *p = block->next;
+  UnlockBigAlloc();
+
+  if (block)  munmap (address, block->size),  ::free (block);
+  else        ::free (address);
+}
+
+void GetBigAllocStats (uint64 bytes[PAGE_TYPES], size_t pagesize[PAGE_TYPES])
+{
+  LockBigAlloc();
+  iterate_var(i,PAGE_TYPES)  bytes[i] = BigAllocBytes[i];
+  UnlockBigAlloc();
+  pagesize[PAGES_ORDINARY]    = sysconf (_SC_PAGESIZE);
+  pagesize[PAGES_TRANSPARENT] = HugePageSize();
+  pagesize[PAGES_HUGE]        = HugePageSize();
+}
+
+#endif // Windows/Unix
+
+
+// ****************************************************************************
+// BUFFER POOL ****************************************************************
+// ****************************************************************************
+
+// Pooled buffers: both used ones and ones cached for reuse. The list is protected by the BigAlloc spinlock
+struct PoolBlock {void *address; size_t size; int mode; bool used; PoolBlock *next;};
+static PoolBlock *PoolBlocks = NULL;
+static int PoolUsers = 0;
+
+// Smaller buffers aren't pooled. Larger ones are rounded up to 1/8 of power of 2, so waste is less than 12.5%
+#define POOL_MIN_SIZE (64*kb)
+static size_t PoolSizeClass (size_t size)
+{
+  size_t step = POOL_MIN_SIZE/8;
+  while (step*16 <= size)  step *= 2;
+  return (size + step - 1) & ~(step - 1);
+}
+
+// Free cached buffers smaller than the given size
+static void PoolTrim (size_t below)
+{
+  LockBigAlloc();
+  PoolBlock *unused = NULL;
+  for (PoolBlock **p = &PoolBlocks; *p; )
+  {
+    PoolBlock *block = *p;
+    if (block->used  ||  block->size >= below)  {p = &block->next;  continue;}
+    *p = block->next,  block->next = unused,  unused = block;
+  }
+  UnlockBigAlloc();
+  while (unused)
+  {
+    PoolBlock *next = unused->next;
+    BigFree (unused->address),  ::free (unused);
+    unused = next;
+  }
+}
+
+void *PoolAlloc (size_t size) throw()
+{
+  if (size < POOL_MIN_SIZE)
+    return BigAlloc (size);
+  size_t allocsize = PoolSizeClass (size);
+  int mode = GetLargePages();
+
+  // Best fit among cached buffers that are no more than twice larger than requested
+  LockBigAlloc();
+  PoolBlock *best = NULL;
+  for (PoolBlock *block = PoolBlocks; block; block = block->next)
+    if (!block->used  &&  block->mode == mode  &&  block->size >= allocsize  &&  block->size/2 <= allocsize)
+      if (!best  ||  block->size < best->size)
+        best = block;
+  if (best)  best->used = true;
+  UnlockBigAlloc();
+  if (best)  return best->address;
+
+  // Cached buffers that are smaller than requested one are dropped: block sizes mostly vary upwards (f.e. with
+  // amount of compressible data), so such buffers are unlikely to be reused, while larger buffer will serve them too
+  PoolTrim (allocsize);
+  PoolBlock *block = (PoolBlock*) malloc (sizeof(PoolBlock));
+  void *res = block? BigAlloc (allocsize) : NULL;
+  if (res == NULL)  {::free (block);  return NULL;}
+  block->address = res,  block->size = allocsize,  block->mode = mode,  block->used = true;
+  LockBigAlloc();
+  block->next = PoolBlocks,  PoolBlocks = block;
+  UnlockBigAlloc();
+  return res;
+}
+
+void PoolFree (void *address) throw()
+{
+  if (address == 0)
+    return;
+  LockBigAlloc();
+  PoolBlock *block = PoolBlocks;
+  while (block  &&  block->address != address)
+    block = block->next;
+  if (block)  block->used = false;
+  bool trim = (PoolUsers == 0);   // no one will reuse the buffer
+  UnlockBigAlloc();
+  if (!block)  BigFree (address);
+  else if (trim)  PoolTrim (size_t(-1));
+}
+
+void PoolEnter (void) throw()
+{
+  LockBigAlloc();
+  PoolUsers++;
+  UnlockBigAlloc();
+}
+
+// Cached buffers are freed when any codec finishes: they were most probably left by that codec, and otherwise
+// would stay allocated while other codecs run, without being counted in their memory requirements.
+// Buffers currently used by other codecs aren't affected - they will be cached again when freed
+void PoolLeave (void) throw()
+{
+  LockBigAlloc();
+  --PoolUsers;
+  UnlockBigAlloc();
+  PoolTrim (size_t(-1));
+}
+
+
 // If the string param contains an integer, return it - otherwise set error=1
 MemSize parseInt (char *param, int *error)
 {
@@ -465,25 +465,83 @@ extern jmp_buf jumper;
 #define throw()
 #endif
 
+// Memory area of 2*size bytes whose second half is mapped to the same memory as the first one,
+// i.e. p[i] and p[i+size] are the same byte. It's used as ring buffer that can be accessed without wrapping.
+// size should be a multiple of MIRROR_GRANULARITY. MirrorAlloc() returns NULL if mapping isn't possible.
+// On Linux it follows large pages policy of BigAlloc() when size is a multiple of the huge page size
+#define MIRROR_GRANULARITY (64*kb)
+void *MirrorAlloc (size_t size) throw();
+size_t MirrorRoundUp (size_t size) throw();   // Round size up to MIRROR_GRANULARITY or, if large pages policy allows, to the huge page size
+void MirrorFree (void *address, size_t size) throw();
+
+// Contiguous address range of size bytes that gets backing memory only when CommitAlloc() is called for its parts.
+// It's used for multi-gigabyte windows that are usually filled only partially and may not fit into memory as one
+// ordinary allocation. ReserveAlloc() returns NULL if there is no free address range of this size
+void *ReserveAlloc (size_t size) throw();
+int   CommitAlloc  (void *address, size_t size) throw();   // Commit memory for [address,address+size) inside reserved range; returns FALSE on failure
+void  ReserveFree  (void *address, size_t size) throw();
+
+// Large memory blocks (hash tables, buffers) that may be placed into large pages
+void *BigAlloc(size_t size) throw();
+void BigFree(void *address) throw();
+#ifdef FREEARC_WIN
+int SetLargePageSize();
+#endif
+
+// Large pages policy of BigAlloc() in the current thread. Threads of MTCompressor inherit policy of the thread that started them
+//   LARGE_PAGES_DEFAULT - platform default: large pages on Windows (if process has the privilege), ordinary pages on Unix
+//   LARGE_PAGES_OFF     - ordinary pages only
+//   LARGE_PAGES_THP     - transparent huge pages on Linux (madvise), ordinary pages elsewhere
+//   LARGE_PAGES_HUGE    - explicit huge pages (MAP_HUGETLB on Linux), falling back to LARGE_PAGES_THP
+enum {LARGE_PAGES_DEFAULT, LARGE_PAGES_OFF, LARGE_PAGES_THP, LARGE_PAGES_HUGE, LARGE_PAGES_MODES};
+int GetLargePages (void);
+int SetLargePages (int mode);   // returns previous policy
+
+// Amount of memory allocated by BigAlloc() and MirrorAlloc() since program start in ordinary, transparent huge and huge pages, and sizes of these pages
+enum {PAGES_ORDINARY, PAGES_TRANSPARENT, PAGES_HUGE, PAGE_TYPES};
+void GetBigAllocStats (uint64 bytes[PAGE_TYPES], size_t pagesize[PAGE_TYPES]);
+
+#ifdef __cplusplus
+// Switch large pages policy of the current thread until the end of scope (LARGE_PAGES_DEFAULT keeps current policy)
+struct LargePagesScope
+{
+  int saved;
+  LargePagesScope (int mode)  {saved = mode==LARGE_PAGES_DEFAULT? -1 : SetLargePages(mode);}
+  ~LargePagesScope()          {if (saved >= 0)  SetLargePages(saved);}
+};
+#endif
+
+// Pool of large buffers for block codecs that need buffers of the same sizes for every block.
+// PoolFree() keeps the buffer for reuse by the next PoolAlloc() of about the same size, so steady-state
+// (de)compression doesn't allocate memory. Codecs using the pool should call PoolEnter() at start and
+// PoolLeave() at finish - when any of them finishes, buffers cached at this moment are freed
+void *PoolAlloc (size_t size) throw();
+void  PoolFree  (void *address) throw();
+void  PoolEnter (void) throw();
+void  PoolLeave (void) throw();
+#define PoolFreeAndNil(p)        ((p) && (PoolFree(p), (p)=NULL))
+
+#ifdef __cplusplus
+// Use the buffer pool until the end of scope
+struct PoolScope
+{
+  PoolScope()   {PoolEnter();}
+  ~PoolScope()  {PoolLeave();}
+};
+#endif
+
 #ifdef FREEARC_STANDALONE_TORNADO
 #define MidAlloc(size) malloc(size)
 #define MidFree(address) free(address)
-#define BigAlloc(size) malloc(size)
-#define BigFree(address) free(address)
 #else
 void *MyAlloc(size_t size) throw();
 void MyFree(void *address) throw();
 #ifdef FREEARC_WIN
-int SetLargePageSize();
 void *MidAlloc(size_t size) throw();
 void MidFree(void *address) throw();
-void *BigAlloc(size_t size) throw();
-void BigFree(void *address) throw();
 #else
 #define MidAlloc(size) MyAlloc(size)
 #define MidFree(address) MyFree(address)
-#define BigAlloc(size) MyAlloc(size)
-#define BigFree(address) MyFree(address)
 #endif
 
 
@@ -536,6 +594,23 @@ static inline MemSize lb (MemSize n)
     return result;
 }
 
+// Prefetch memory line containing given address into the cache
+#if __INTEL_COMPILER || _MSC_VER >= 1400
+#include <xmmintrin.h>
+#define prefetch_data(addr)      _mm_prefetch ((char*)(addr), _MM_HINT_T0)
+#elif __GNUC__ == 3 && __GNUC_MINOR__ > 0 || __GNUC__ > 3
+#define prefetch_data(addr)      __builtin_prefetch (addr)
+#else
+#define prefetch_data(addr)
+#endif
+
+// Variable having separate instance in every thread
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 //        
 // ,  f(13,2)=16
 static inline MemSize roundup_to_power_of (MemSize n, MemSize base)
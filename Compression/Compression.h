@@ -230,6 +230,11 @@ int DecompressWithHeader (CALLBACK_FUNC *callback, void *auxdata);
 //      ,    
 int DecompressMem (char *method, void *input, int inputSize, void *output, int outputSize);
 int DecompressMemWithHeader     (void *input, int inputSize, void *output, int outputSize);
+//    (preset dictionary)   name ( ), dictSize==0 -  .
+//  ,   ,      ( "tor:5:256kb:dNAME"),
+//        ,    .
+//       threads
+int LoadCompressionDictionary (char *name, void *dict, int dictSize);
 
 #ifndef FREEARC_DECOMPRESS_ONLY
 //    
@@ -241,7 +246,8 @@ int CompressWithHeader (char *method, CALLBACK_FUNC *callback, void *auxdata);
 int CompressMem           (char *method, void *input, int inputSize, void *output, int outputSize);
 int CompressMemWithHeader (char *method, void *input, int inputSize, void *output, int outputSize);
 //   out_method     in_method ( ParseCompressionMethod + ShowCompressionMethod)
-int CanonizeCompressionMethod (char *in_method, char *out_method);
+// purify:  ,     (    )
+int CanonizeCompressionMethod (char *in_method, char *out_method, int purify);
 //   ,   /,     .
 MemSize GetCompressionMem   (char *method);
 MemSize GetDictionary       (char *method);
@@ -280,8 +286,9 @@ public:
 #ifndef FREEARC_DECOMPRESS_ONLY
   virtual int compress   (CALLBACK_FUNC *callback, void *auxdata) = 0;
 
-  //   buf[MAX_METHOD_STRLEN] ,       (,   ParseCompressionMethod)
-  virtual void ShowCompressionMethod (char *buf) = 0;
+  //   buf[MAX_METHOD_STRLEN] ,       (,   ParseCompressionMethod).
+  // purify:  ,      (, :lp/:large), -     
+  virtual void ShowCompressionMethod (char *buf, bool purify) = 0;
 
   //   ,   /,
   //   (          -  lz/bs ),
@@ -312,7 +319,7 @@ public:
   double addtime;  //  ,    (  ,  threads  ..)
   COMPRESSION_METHOD() {addtime=0;}
   virtual ~COMPRESSION_METHOD() {}
-//  Debugging code:  char buf[100]; ShowCompressionMethod(buf); printf("%s : %u => %u\n", buf, GetCompressionMem(), mem);
+//  Debugging code:  char buf[100]; ShowCompressionMethod(buf,FALSE); printf("%s : %u => %u\n", buf, GetCompressionMem(), mem);
 };
 
 
@@ -328,6 +335,18 @@ typedef COMPRESSION_METHOD* (*CM_PARSER) (char** parameters);
 typedef COMPRESSION_METHOD* (*CM_PARSER2) (char** parameters, void *data);
 int AddCompressionMethod         (CM_PARSER parser);  //         
 int AddExternalCompressionMethod (CM_PARSER2 parser2, void *data);  //        ,      
+
+//  ,  LoadCompressionDictionary
+struct COMPRESSION_DICTIONARY
+{
+  char   name [MAX_METHOD_STRLEN];
+  void  *data;                          //  
+  int    size;                          //  
+  void  *cache;                         // ,      (,  ),
+  void (*free_cache) (void *cache);     //    ,     
+  COMPRESSION_DICTIONARY *next;
+};
+COMPRESSION_DICTIONARY *FindCompressionDictionary (char *name);   //      (NULL -  )
 #endif  // __cplusplus
 void ClearExternalCompressorsTable (void);                          //    
 #ifdef __cplusplus
@@ -347,7 +366,7 @@ public:
   virtual int compress   (CALLBACK_FUNC *callback, void *auxdata);
 
   //   buf[MAX_METHOD_STRLEN] ,    (,   parse_STORING)
-  virtual void ShowCompressionMethod (char *buf);
+  virtual void ShowCompressionMethod (char *buf, bool purify);
 
   // /  ,   /,     
   virtual MemSize GetCompressionMem   (void)    {return BUFFER_SIZE;}
@@ -62,7 +62,11 @@ decompressMemWithHeader a b c d = c_DecompressMemWithHeader a b c d
 
 -- |Return canonical representation of compression method
 canonizeCompressionMethod :: Method -> Method
-canonizeCompressionMethod = doWithMethod c_CanonizeCompressionMethod
+canonizeCompressionMethod = doWithMethod (\m out -> c_CanonizeCompressionMethod m out 0)
+
+-- |Return representation of compression method saved in archive (without compression-only parameters)
+purifyCompressionMethod :: Method -> Method
+purifyCompressionMethod = doWithMethod (\m out -> c_CanonizeCompressionMethod m out 1)
 
 -- |Returns memory used to compress/decompress, dictionary or block size of method given
 getCompressionMem, getDecompressionMem, getDictionary, getBlockSize :: Method -> MemSize
@@ -253,7 +257,7 @@ foreign import ccall unsafe  "External/C_External.h  AddExternalCompressor"
 
 -- |Returns canonical representation of compression method or error code
 foreign import ccall unsafe  "Compression.h  CanonizeCompressionMethod"
-   c_CanonizeCompressionMethod   :: CMethod -> CMethod -> IO Int
+   c_CanonizeCompressionMethod   :: CMethod -> CMethod -> CInt -> IO Int
 
 foreign import ccall unsafe  "Compression.h CompressionService"
    c_CompressionService :: CMethod -> CString -> CInt -> VoidPtr -> FunPtr CALLBACK_FUNC -> IO CInt
@@ -43,11 +43,12 @@ int DecompressWithHeader (CALLBACK_FUNC *callback, void *auxdata)
   return FREEARC_ERRCODE_INVALID_COMPRESSOR;  //   ,    MAX_METHOD_STRLEN       '\0'
 }
 
-// Callback- /  ()  
-void *readPtr;    //    
-int   readLeft;   //       
-void *writePtr;   //    
-int   writeLeft;  //       
+// Callback- /  ()   (     ,
+//  ()       )
+static THREAD_LOCAL void *readPtr;    //    
+static THREAD_LOCAL int   readLeft;   //       
+static THREAD_LOCAL void *writePtr;   //    
+static THREAD_LOCAL int   writeLeft;  //       
 int ReadWriteMem (const char *what, void *buf, int size, void *callback)
 {
   if (strequ(what,"read")) {
@@ -114,27 +115,55 @@ int Compress (char *method, CALLBACK_FUNC *callback, void *auxdata)
     return FREEARC_ERRCODE_INVALID_COMPRESSOR;
 }
 
+//            
+int timed_compress_with_header (COMPRESSION_METHOD *compressor, CALLBACK_FUNC *callback, void *auxdata)
+{
+  char canonical_method [MAX_METHOD_STRLEN];
+  compressor->ShowCompressionMethod (canonical_method, TRUE);
+  int result = callback ("write", canonical_method, strlen(canonical_method)+1, auxdata);
+  if (result>=0) result = timed_compress (compressor, callback, auxdata);
+  return result;
+}
+
 //            
 int CompressWithHeader (char *method, CALLBACK_FUNC *callback, void *auxdata)
 {
   COMPRESSION_METHOD *compressor = ParseCompressionMethod (method);
   if (compressor){
-    char canonical_method [MAX_METHOD_STRLEN];
-    compressor->ShowCompressionMethod (canonical_method);
-    int result = callback ("write", canonical_method, strlen(canonical_method)+1, auxdata);
-    if (result>=0) result = timed_compress (compressor, callback, auxdata);
+    int result = timed_compress_with_header (compressor, callback, auxdata);
     delete compressor;
     return result;}
   else
     return FREEARC_ERRCODE_INVALID_COMPRESSOR;
 }
 
+//  ,    CompressMem/CompressMemWithHeader.     
+//    "KeepContext",         (, tor
+//    )        .    
+//  (      compressionLib_cleanup)
+static THREAD_LOCAL char                memMethod [MAX_METHOD_STRLEN];
+static THREAD_LOCAL COMPRESSION_METHOD *memCompressor = NULL;
+
+//      method,   ,    
+static COMPRESSION_METHOD *MemCompressionMethod (char *method)
+{
+  if (memCompressor && strequ (memMethod, method))
+    return memCompressor;
+  delete memCompressor;
+  memCompressor = ParseCompressionMethod (method);
+  if (memCompressor)  memCompressor->doit ("KeepContext", 1, NULL, NULL);
+  strncopy (memMethod, method, sizeof(memMethod));
+  return memCompressor;
+}
+
 //    ,       outputSize .
 //      ,    
 int CompressMem (char *method, void *input, int inputSize, void *output, int outputSize)
 {
+  COMPRESSION_METHOD *compressor = MemCompressionMethod (method);
+  if (!compressor)  return FREEARC_ERRCODE_INVALID_COMPRESSOR;
   readPtr=input, readLeft=inputSize, writePtr=output, writeLeft=outputSize;
-  int result = Compress (method, ReadWriteMem, 0);
+  int result = timed_compress (compressor, ReadWriteMem, 0);
   return result<0 ? result : outputSize-writeLeft;
 }
 
@@ -142,17 +171,19 @@ int CompressMem (char *method, void *input, int inputSize, void *output, int out
 //      ,    
 int CompressMemWithHeader (char *method, void *input, int inputSize, void *output, int outputSize)
 {
+  COMPRESSION_METHOD *compressor = MemCompressionMethod (method);
+  if (!compressor)  return FREEARC_ERRCODE_INVALID_COMPRESSOR;
   readPtr=input, readLeft=inputSize, writePtr=output, writeLeft=outputSize;
-  int result = CompressWithHeader (method, ReadWriteMem, 0);
+  int result = timed_compress_with_header (compressor, ReadWriteMem, 0);
   return result<0 ? result : outputSize-writeLeft;
 }
 
 //   canonical_method     in_method
-int CanonizeCompressionMethod (char *method, char *canonical_method)
+int CanonizeCompressionMethod (char *method, char *canonical_method, int purify)
 {
   COMPRESSION_METHOD *compressor = ParseCompressionMethod (method);
   if (compressor){
-    compressor->ShowCompressionMethod (canonical_method);
+    compressor->ShowCompressionMethod (canonical_method, purify);
     delete compressor;
     return FREEARC_OK;}
   else
@@ -178,7 +209,7 @@ int CanonizeCompressionMethod (char *method, char *canonical_method)
     COMPRESSION_METHOD *compressor = ParseCompressionMethod (in_method);     \
     if (compressor){                                                         \
       compressor->SETTER (bytes);                                            \
-      compressor->ShowCompressionMethod (out_method);                        \
+      compressor->ShowCompressionMethod (out_method, FALSE);                 \
       delete compressor;                                                     \
       return FREEARC_OK;}                                                    \
     else                                                                     \
@@ -487,10 +518,16 @@ FARPROC LoadFromDLL (char *funcname)
 #endif
 }
 
+COMPRESSION_DICTIONARY *cdList = NULL;   //    
+
 // This function cleans up the Compression Library
 void compressionLib_cleanup (void)
 {
   removeTemporaryFiles();
+#ifndef FREEARC_DECOMPRESS_ONLY
+  delete memCompressor;  memCompressor = NULL;
+#endif
+  while (cdList)  LoadCompressionDictionary (cdList->name, NULL, 0);
 }
 
 
@@ -561,6 +598,45 @@ COMPRESSION_METHOD *ParseCompressionMethod (char* method)
 }
 
 
+// ****************************************************************************************************************************
+//   **************************************************************************************************
+// ****************************************************************************************************************************
+
+//      (NULL -  )
+COMPRESSION_DICTIONARY *FindCompressionDictionary (char *name)
+{
+  for (COMPRESSION_DICTIONARY *d = cdList; d; d = d->next)
+    if (strequ (d->name, name))  return d;
+  return NULL;
+}
+
+//     name ( ), dictSize==0 -  
+int LoadCompressionDictionary (char *name, void *dict, int dictSize)
+{
+  //          ,     
+  for (COMPRESSION_DICTIONARY **p = &cdList; *p; p = &(*p)->next)
+    if (strequ ((*p)->name, name)) {
+      COMPRESSION_DICTIONARY *d = *p;  *p = d->next;
+      if (d->free_cache)  d->free_cache (d->cache);
+      free (d->data);  free (d);
+      break;
+    }
+  if (dictSize<=0)  return FREEARC_OK;
+
+  //      ,       
+  if (*name=='\0' || strlen(name) >= MAX_METHOD_STRLEN || strchr (name, COMPRESSION_METHOD_PARAMETERS_DELIMITER))
+    return FREEARC_ERRCODE_INVALID_COMPRESSOR;
+  COMPRESSION_DICTIONARY *d = (COMPRESSION_DICTIONARY*) calloc (sizeof(COMPRESSION_DICTIONARY), 1);
+  if (d)  d->data = malloc (dictSize);
+  if (!d || !d->data)  {free(d); return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;}
+  strcpy (d->name, name);
+  memcpy (d->data, dict, dictSize);
+  d->size = dictSize;
+  d->next = cdList;  cdList = d;
+  return FREEARC_OK;
+}
+
+
 // ***********************************************************************************************************************
 //   STORING                                                                                             *
 // ***********************************************************************************************************************
@@ -590,7 +666,7 @@ int STORING_METHOD::compress (CALLBACK_FUNC *callback, void *auxdata)
 }
 
 //   buf[MAX_METHOD_STRLEN] ,    (,   parse_STORING)
-void STORING_METHOD::ShowCompressionMethod (char *buf)
+void STORING_METHOD::ShowCompressionMethod (char *buf, bool purify)
 {
   sprintf (buf, "storing");
 }
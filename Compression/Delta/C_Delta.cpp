@@ -28,6 +28,14 @@ int DELTA_METHOD::decompress (CALLBACK_FUNC *callback, void *auxdata)
                           (BlockSize, ExtendedTables, callback, auxdata);
 }
 
+//  ,   :     OverlappedIO
+// (        ).     ,
+//       ,      
+MemSize DELTA_METHOD::GetDecompressionMem (void)
+{
+  return BlockSize + OverlappedIOMem (BlockSize);
+}
+
 #ifndef FREEARC_DECOMPRESS_ONLY
 
 //  
@@ -42,13 +50,23 @@ int DELTA_METHOD::compress (CALLBACK_FUNC *callback, void *auxdata)
 }
 
 //   buf[MAX_METHOD_STRLEN] ,       (,   parse_DELTA)
-void DELTA_METHOD::ShowCompressionMethod (char *buf)
+void DELTA_METHOD::ShowCompressionMethod (char *buf, bool purify)
 {
     DELTA_METHOD defaults; char BlockSizeStr[100]=":";
     showMem (BlockSize, BlockSizeStr+1);
     sprintf (buf, "delta%s%s", BlockSize!=defaults.BlockSize? BlockSizeStr:"", ExtendedTables? ":x":"");
 }
 
+//    ,  GetDecompressionMem()   mem
+void DELTA_METHOD::SetCompressionMem (MemSize mem)
+{
+  if (mem>0)
+  {
+    MemSize io = OverlappedIOMem(0);
+    BlockSize = (mem > 2*io? mem-io : mem/2) / (OVERLAPPED_BUFFERS+1);
+  }
+}
+
 #endif  // !defined (FREEARC_DECOMPRESS_ONLY)
 
 //    DELTA_METHOD    
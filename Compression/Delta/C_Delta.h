@@ -23,18 +23,18 @@ public:
   virtual int compress   (CALLBACK_FUNC *callback, void *auxdata);
 
   //   buf[MAX_METHOD_STRLEN] ,       (,   parse_DELTA)
-  virtual void ShowCompressionMethod (char *buf);
+  virtual void ShowCompressionMethod (char *buf, bool purify);
 
   // /  ,   /,     
-  virtual MemSize GetCompressionMem     (void)         {return BlockSize;}
+  virtual MemSize GetCompressionMem     (void)         {return GetDecompressionMem();}
   virtual MemSize GetDictionary         (void)         {return 0;}
   virtual MemSize GetBlockSize          (void)         {return 0;}
-  virtual void    SetCompressionMem     (MemSize mem)  {if (mem>0)   BlockSize = mem;}
-  virtual void    SetDecompressionMem   (MemSize mem)  {if (mem>0)   BlockSize = mem;}
+  virtual void    SetCompressionMem     (MemSize mem);
+  virtual void    SetDecompressionMem   (MemSize mem)  {SetCompressionMem(mem);}
   virtual void    SetDictionary         (MemSize dict) {}
   virtual void    SetBlockSize          (MemSize bs)   {}
 #endif
-  virtual MemSize GetDecompressionMem   (void)         {return BlockSize;}
+  virtual MemSize GetDecompressionMem   (void);
 };
 
 //     DELTA
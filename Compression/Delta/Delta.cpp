@@ -119,6 +119,8 @@ const int LINE=32;
 
 // C HEADERS **************************************************************************************
 #include "../Compression.h"
+#include "../SIMD.h"   // table_distance_stats() - it relies on LINE==32 and MAX_ELEMENT_SIZE==TABLE_MAX_DIST
+#include "../MultiThreading.h"
 
 
 // OPTIONS FOR STANDALONE EXECUTABLE **************************************************************
@@ -432,28 +434,18 @@ int delta_compress (MemSize BlockSize, int ExtendedTables, CALLBACK_FUNC *callba
 
         BYTE *bufend = buf + Size;     // End of data in buf[]
         BYTE *last_table_end = buf;    // End of last table found so far
-        BYTE *hash[256], *hash1[256];
-        iterate_var(i,256)  hash[i] = hash1[i] = buf-1;
+        BYTE  prev_line[LINE];         // Contents of the last line scanned, saved before any table inside it was diffed
+        BYTE *prev_ptr = NULL;         // ..and its position
 
         for (byte *ptr=buf+LINE; ptr+MAX_ELEMENT_SIZE*4 < bufend; )
         {
 if (*(int32*)ptr != *(int32*)(ptr+3))   //  a little speed optimization, mainly to skip blocks of all zeroes
 {
             //          
-            BYTE count[MAX_ELEMENT_SIZE]; zeroArray(count);
-            BYTE *p = ptr; iterate_var(i,LINE)
-            {
-                int n = p - hash[*p/16];   // detecting repeated data by 4 higher bits
-                hash[*p/16] = p;
-                if (n<=MAX_ELEMENT_SIZE)  count[n-1]++;
-#if 0
-                // Detecting repeating data by all 8 bits - useful for tables with longer rows
-                int n1 = p - hash1[*p];
-                hash1[*p] = p;
-                if (n!=n1 && n1<=MAX_ELEMENT_SIZE)  count[n1-1]++;
-#endif
-                p++;
-            }
+            // (detecting repeated data by 4 higher bits, with SIMD code scanning all distances at once)
+            BYTE count[MAX_ELEMENT_SIZE];
+            table_distance_stats (ptr, prev_ptr? prev_line:NULL, prev_ptr? ptr-(prev_ptr+LINE):0, count);
+            memcpy (prev_line, ptr, LINE),  prev_ptr = ptr;
 
             //    ,     5  -
             //      
@@ -493,10 +485,28 @@ if (*(int32*)ptr != *(int32*)(ptr+3))   //  a little speed optimization, mainly
 #endif
 
 
+// Read the next compressed block with its headers and table descriptions (for OverlappedIO reader thread)
+static int delta_read_block (IOBuffer *b, CALLBACK_FUNC *callback, void *auxdata)
+{
+    int x = b->read (2*sizeof(int32), callback, auxdata);
+    if (x == 0)                return 0;     // end of input
+    if (x != 2*sizeof(int32))  return x<0? x : FREEARC_ERRCODE_READ;
+    int DataSize = value32 (b->buf),  TableSize = value32 (b->buf+sizeof(int32));
+    if (TableSize<0 || TableSize>INT_MAX/3)  return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+    x = b->read (TableSize*3, callback, auxdata);
+    if (x != TableSize*3)  return x<0? x : FREEARC_ERRCODE_READ;
+    x = b->read (DataSize, callback, auxdata);
+    if (x != DataSize)     return x<0? x : FREEARC_ERRCODE_READ;
+    return 1;
+}
+
 // Decompression which undiffs all data tables which was diffed by table_compress()
 int delta_decompress (MemSize BlockSize, int ExtendedTables, CALLBACK_FUNC *callback, void *auxdata)
 {
     int errcode = FREEARC_OK;   // Error code returned by last operation or FREEARC_OK
+    OverlappedIO io;            // Reading of the next block and writing of decoded data are performed by separate threads
+    if (io.start (delta_read_block, callback, auxdata))
+        callback = OverlappedIO::Callback,  auxdata = &io;
     uint64 offset = 0;   // Current offset of buf[] contents relative to file (increased after each input block processd)
     Buffer Data, TSkip, TType, TRows,
            ReorderingBuffer;           // Buffer used in reorder_table
@@ -535,7 +545,7 @@ int delta_decompress (MemSize BlockSize, int ExtendedTables, CALLBACK_FUNC *call
         offset += DataSize;
     }
 finished:
-    return errcode;
+    return io.finish (errcode);
 }
 
 
@@ -543,6 +553,7 @@ finished:
 
 #ifndef DELTA_LIBRARY
 #include "../Common.cpp"
+#include "../LZMA/Windows/Synchronization.cpp"
 
 // Structure for recording compression statistics and zero record of this type
 struct Results {
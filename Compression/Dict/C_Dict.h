@@ -28,7 +28,7 @@ public:
   virtual int compress   (CALLBACK_FUNC *callback, void *auxdata);
 
   //   buf[MAX_METHOD_STRLEN] ,       (,   parse_DICT)
-  virtual void ShowCompressionMethod (char *buf);
+  virtual void ShowCompressionMethod (char *buf, bool purify);
 
   // /  ,   /,     
   virtual MemSize GetCompressionMem     (void)         {return BlockSize*2;}
@@ -167,7 +167,7 @@ int EXTERNAL_METHOD::compress (CALLBACK_FUNC *callback, void *auxdata)
 }
 
 //   buf[MAX_METHOD_STRLEN] ,       (,   parse_EXTERNAL)
-void EXTERNAL_METHOD::ShowCompressionMethod (char *buf)
+void EXTERNAL_METHOD::ShowCompressionMethod (char *buf, bool purify)
 {
     if (strequ (name, "pmm")) {
         char MemStr[100];
@@ -47,7 +47,7 @@ public:
   virtual int compress   (CALLBACK_FUNC *callback, void *auxdata);
 
   //   buf[MAX_METHOD_STRLEN] ,       (,   parse_EXTERNAL)
-  virtual void ShowCompressionMethod (char *buf);
+  virtual void ShowCompressionMethod (char *buf, bool purify);
 
   // /  ,   /,     
   virtual MemSize GetCompressionMem     (void)          {return cmem;}
@@ -31,6 +31,7 @@
 
   "Fast" BWT memory use   : 6*BlockLen + 256Kb
   "Strong" BWT memory use : 9*BlockLen + 1Mb
+  "SA-IS" BWT memory use  : 5.125*BlockLen, at most 7.125*BlockLen
   Reverse BWT memory use  : 5*BlockLen
 
   For more information on these sources, see the manual.
@@ -74,6 +75,24 @@
 #define StrongBWT_CMask             0x3FFFFFFF
 #define StrongBWT_SMask             0x40000000
 
+#define BWT_ChainsPerGroup          8
+
+/*--
+  Inverse BWT walks from the block end to its start, one random
+  access per byte. Encoder saves rows of positions Step, 2*Step...
+  (GRZ_BWT_MaxChains-1 at most), so decoder may restore each piece
+  [j*Step,(j+1)*Step) independently: several such chains are
+  followed in an interleaved manner, which lets the CPU overlap
+  their cache misses, and groups of chains may be decoded by
+  different threads.
+--*/
+#define BWT_SaveStart(Pos,Row)                                      \
+  {                                                                 \
+    if ((Starts!=NULL)&&((Pos)>0)&&((Pos)<Size)&&                   \
+        (((Pos)&((1<<ChainLog)-1))==0))                             \
+      Starts[((Pos)>>ChainLog)-1]=(Row);                            \
+  }
+
 #define BWT_VSwap(S1,S2,Num)               \
 {                                          \
   sint32 TS1=(S1);                         \
@@ -265,7 +284,7 @@ void StrongBWT_TernarySort(sint32 * Index,uint32 * Group,sint32 Lo,sint32 Hi,sin
   }
 }
 
-sint32 GRZip_StrongBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output)
+sint32 GRZip_StrongBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output,sint32 * Starts,sint32 ChainLog)
 {
   uint8     RunOrder[BWT_MaxByte],BigDone[BWT_MaxByte];
   sint32    CopyStart[BWT_MaxByte],CopyEnd[BWT_MaxByte];
@@ -274,17 +293,17 @@ sint32 GRZip_StrongBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output)
   sint32    i,h;
   uint32    W;
 
-  uint32 *  Group=(uint32 *)BigAlloc((Size+1)*sizeof(uint32));
+  uint32 *  Group=(uint32 *)PoolAlloc((Size+1)*sizeof(uint32));
   if (Group==NULL) return (GRZ_NOT_ENOUGH_MEMORY);
 
-  sint32 *  Index=(sint32 *)BigAlloc((Size+1)*sizeof(sint32));
-  if (Index==NULL) {BigFree(Group);return (GRZ_NOT_ENOUGH_MEMORY);}
+  sint32 *  Index=(sint32 *)PoolAlloc((Size+1)*sizeof(sint32));
+  if (Index==NULL) {PoolFree(Group);return (GRZ_NOT_ENOUGH_MEMORY);}
 
-  sint32 *  Buckets=(sint32 *)BigAlloc((BWT_MaxWord+1)*sizeof(sint32));
-  if (Buckets==NULL) {BigFree(Index);BigFree(Group);return (GRZ_NOT_ENOUGH_MEMORY);}
+  sint32 *  Buckets=(sint32 *)PoolAlloc((BWT_MaxWord+1)*sizeof(sint32));
+  if (Buckets==NULL) {PoolFree(Index);PoolFree(Group);return (GRZ_NOT_ENOUGH_MEMORY);}
 
-  sint32 *  BGroups=(sint32 *)BigAlloc((StrongBWT_TSortStackSize+3)*sizeof(sint32));
-  if (BGroups==NULL) {BigFree(Buckets);BigFree(Index);BigFree(Group);return (GRZ_NOT_ENOUGH_MEMORY);}
+  sint32 *  BGroups=(sint32 *)PoolAlloc((StrongBWT_TSortStackSize+3)*sizeof(sint32));
+  if (BGroups==NULL) {PoolFree(Buckets);PoolFree(Index);PoolFree(Group);return (GRZ_NOT_ENOUGH_MEMORY);}
 
   memset(Buckets,0,(BWT_MaxWord+1)*sizeof(sint32));
 
@@ -380,7 +399,7 @@ sint32 GRZip_StrongBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output)
     BigDone[S]=1;h++;
   }
 
-  BigFree(Buckets);BigFree(BGroups);
+  PoolFree(Buckets);PoolFree(BGroups);
 
   LB=Group[0]>>24;
   W= Group[0]&0xFFFFFF;
@@ -393,20 +412,141 @@ sint32 GRZip_StrongBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output)
     else
       Output[Ps-1]=LB;
     LB=c;
+    BWT_SaveStart(i,Ps);
   }
-  BigFree(Index);BigFree(Group);
+  PoolFree(Index);PoolFree(Group);
   return W;
 }
 
 #endif  // !defined (FREEARC_DECOMPRESS_ONLY)
 
-sint32 GRZip_StrongBWT_Decode(uint8 * Input,sint32 Size,sint32 FBP)
+/*-------------------------------------------------*/
+/* Interleaved inverse BWT                         */
+/*-------------------------------------------------*/
+
+/* Log2 of the distance between positions whose rows are saved by encoder */
+sint32 GRZip_BWT_ChainLog(sint32 Size)
+{
+  sint32 ChainLog=GRZ_BWT_MinChainLog;
+  while (((Size-1)>>ChainLog)>=GRZ_BWT_MaxChains) ChainLog++;
+  return ChainLog;
+}
+
+struct GRZip_BWT_Inverter : ParallelJob
+{
+  HelperThreads * Helpers;     /* Pool of helper threads, shared by all blocks */
+  sint32          NumHelpers;  /* How many of them may join decoding of current block */
+
+  uint32 *        T;
+  uint32 *        Count;
+  uint8  *        Output;
+  sint32          Size;
+  sint32          ChainLog;
+  sint32 *        Rows;        /* Row preceding the last byte of each chain */
+  sint32          NumChains;
+  sint32          NextChain;   /* First chain not taken by any thread yet */
+
+  GRZip_BWT_Inverter(): Helpers(NULL), NumHelpers(0) {}
+  void work();
+};
+
+/* Restores chains First..First+Num-1; only the last chain of block may be shorter than others */
+static void BWT_DecodeChainGroup(uint32 * T,uint32 * Count,uint8 * Output,sint32 Size,
+                                 sint32 ChainLog,sint32 * Rows,sint32 First,sint32 Num)
+{
+  sint32  Row[BWT_ChainsPerGroup];
+  uint8 * Ptr[BWT_ChainsPerGroup];
+  sint32  i,j,Step=1<<ChainLog,LastLen=Size-((First+Num-1)<<ChainLog);
+
+  if (LastLen>Step) LastLen=Step;
+  for (j=0;j<Num;j++)
+  {
+    Row[j]=Rows[First+j];
+    Ptr[j]=Output+((First+j)<<ChainLog)+((j==Num-1)?LastLen:Step);
+  }
+
+  if (Num==BWT_ChainsPerGroup)
+    for (i=0;i<LastLen;i++)
+      for (j=0;j<BWT_ChainsPerGroup;j++)
+      {
+        uint32 u=T[Row[j]];
+        uint8  c=u&0xFF;
+        Row[j]=(u>>8)+Count[c];
+        *--Ptr[j]=c;
+      }
+  else
+    for (i=0;i<LastLen;i++)
+      for (j=0;j<Num;j++)
+      {
+        uint32 u=T[Row[j]];
+        uint8  c=u&0xFF;
+        Row[j]=(u>>8)+Count[c];
+        *--Ptr[j]=c;
+      }
+
+  for (;i<Step;i++)
+    for (j=0;j<Num-1;j++)
+    {
+      uint32 u=T[Row[j]];
+      uint8  c=u&0xFF;
+      Row[j]=(u>>8)+Count[c];
+      *--Ptr[j]=c;
+    }
+}
+
+void GRZip_BWT_Inverter::work()
+{
+  while (1)
+  {
+    sint32 First;
+    {
+      Lock _(mutex);
+      if (NextChain>=NumChains) return;
+      First=NextChain; NextChain+=BWT_ChainsPerGroup;
+    }
+    BWT_DecodeChainGroup(T,Count,Output,Size,ChainLog,Rows,First,
+                         BWT_Min(BWT_ChainsPerGroup,NumChains-First));
+  }
+}
+
+/* Chain j restores bytes [j*Step,(j+1)*Step) starting from row Starts[j], the last one - from LastRow */
+sint32 GRZip_BWT_DecodeChains(uint32 * T,uint32 * Count,uint8 * Output,sint32 Size,sint32 NumRows,sint32 LastRow,
+                              sint32 * Starts,sint32 NumStarts,sint32 ChainLog,GRZip_BWT_Inverter * Inverter)
+{
+  sint32 i,Rows[GRZ_BWT_MaxChains];
+
+  if ((NumStarts>=GRZ_BWT_MaxChains)||(ChainLog>=GRZ_Log2MaxBlockSize)||
+      (((Size-1)>>ChainLog)!=NumStarts)) return (GRZ_CRC_ERROR);
+  for (i=0;i<NumStarts;i++)
+  {
+    if ((Starts[i]<0)||(Starts[i]>=NumRows)) return (GRZ_CRC_ERROR);
+    Rows[i]=Starts[i];
+  }
+  Rows[NumStarts]=LastRow;
+
+  if ((Inverter!=NULL)&&(Inverter->NumHelpers>0)&&(NumStarts>=BWT_ChainsPerGroup))
+  {
+    Inverter->T=T; Inverter->Count=Count; Inverter->Output=Output; Inverter->Size=Size;
+    Inverter->ChainLog=ChainLog; Inverter->Rows=Rows; Inverter->NumChains=NumStarts+1;
+    Inverter->NextChain=0;
+    Inverter->Helpers->run(Inverter,Inverter->NumHelpers);
+  }
+  else
+    for (i=0;i<=NumStarts;i+=BWT_ChainsPerGroup)
+      BWT_DecodeChainGroup(T,Count,Output,Size,ChainLog,Rows,i,BWT_Min(BWT_ChainsPerGroup,NumStarts+1-i));
+
+  return GRZ_NO_ERROR;
+}
+
+sint32 GRZip_StrongBWT_Decode(uint8 * Input,sint32 Size,sint32 FBP,
+                              sint32 * Starts,sint32 NumStarts,sint32 ChainLog,
+                              GRZip_BWT_Inverter * Inverter)
 {
   uint32 Count[BWT_MaxByte];
   sint32 i;
   uint32 Sum;
 
-  uint32 * T=(uint32 *)BigAlloc((Size+1)*sizeof(uint32));
+  uint32 * T=(uint32 *)PoolAlloc((Size+1)*sizeof(uint32));
   if (T==NULL) return (GRZ_NOT_ENOUGH_MEMORY);
 
   memset(Count,0,BWT_MaxByte*sizeof(uint32));
@@ -425,6 +565,13 @@ sint32 GRZip_StrongBWT_Decode(uint8 * Input,sint32 Size,sint32 FBP)
 
   for (Sum=1,i=0;i<BWT_MaxByte;i++){Sum+=Count[i];Count[i]=Sum-Count[i];}
 
+  if (NumStarts>0)
+  {
+    sint32 Result=GRZip_BWT_DecodeChains(T,Count,Input,Size,Size+1,0,Starts,NumStarts,ChainLog,Inverter);
+    PoolFree(T);
+    return (Result);
+  }
+
   for (FBP=0,i=Size-1;i>=0;i--)
   {
     uint32 u=T[FBP];
@@ -433,7 +580,7 @@ sint32 GRZip_StrongBWT_Decode(uint8 * Input,sint32 Size,sint32 FBP)
     Input[i]=c;
   }
 
-  BigFree(T);
+  PoolFree(T);
   return GRZ_NO_ERROR;
 }
 
@@ -786,7 +933,72 @@ void TreeUpdateFast(uint32 ** PtrHash,
   }
 }
 
-sint32 GRZip_FastBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output)
+/*-------------------------------------------------*/
+/* Multithreaded "Fast" BWT                        */
+/*-------------------------------------------------*/
+
+/*--
+  FastBWT sorts every 8th suffix inside its 2-byte bucket and then
+  merges the rest. Given a Sorter, these buckets are sorted by the
+  current thread and helper threads joining it, the merge remains
+  serial. Comparisons made for a bucket don't depend on the thread
+  sorting it, so the block fails to sort (and goes to SA-IS) by the
+  same rule whatever the number of threads is.
+--*/
+
+#define FastBWT_MTChunkSize         4096
+
+struct GRZip_BWT_Sorter : ParallelJob
+{
+  HelperThreads * Helpers;     /* Pool of helper threads, shared by all blocks */
+  sint32          NumHelpers;  /* How many of them may join sorting of current block */
+
+  sint32 *        Index;
+  uint8  *        Input;
+  sint32          Size;
+  sint32 *        BucketEnd;
+  sint32          Start;       /* Where the first bucket starts in Index */
+  sint32          NextBucket;  /* First bucket not taken by any thread yet */
+  sint32          AML;         /* Comparisons allowed for the whole block */
+  sint32          Used;        /* Comparisons made by all threads, >AML - sorting failed */
+
+  GRZip_BWT_Sorter(): Helpers(NULL), NumHelpers(0) {}
+  void work();
+};
+
+/* Each thread takes buckets holding FastBWT_MTChunkSize+ suffixes and sorts them with
+   the budget of the whole block, then adds comparisons made to the common counter.
+   Comparisons made for a chunk depend only on the chunk, so the block fails to sort
+   (their sum exceeds the budget) regardless of the number of threads and chunk order */
+void GRZip_BWT_Sorter::work()
+{
+  while (1)
+  {
+    sint32 i,Lo,Hi,First,Last,Left;
+    {
+      Lock _(mutex);
+      if ((NextBucket>=BWT_MaxWord)||(Used>AML)) return;
+      First=NextBucket; Lo=First?BucketEnd[First-1]:Start;
+      for (Last=First+1;(Last<BWT_MaxWord)&&(BucketEnd[Last-1]-Lo<FastBWT_MTChunkSize);Last++);
+      NextBucket=Last;
+    }
+    for (Left=AML,i=First;(i<Last)&&(Left>=0);i++)
+    {
+      Lo=i?BucketEnd[i-1]:Start; Hi=BucketEnd[i]-1;
+      if (Lo>=Hi) continue;
+      if (Hi-Lo>BWT_MinQSort)
+        FastBWT_TernarySort(Index,Input,Lo,Hi,Size,&Left);
+      else
+        FastBWT_ShellSortDeph2(Index,Input,Lo,Hi,Size,&Left);
+    }
+    {
+      Lock _(mutex);
+      Used=BWT_Min(Used+AML-Left,AML+1);
+    }
+  }
+}
+
+sint32 GRZip_FastBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output,GRZip_BWT_Sorter * Sorter,sint32 * Starts,sint32 ChainLog)
 {
 
   sint32   GroupsFreq[FastBWT_NumGroups][BWT_MaxByte];
@@ -798,11 +1010,11 @@ sint32 GRZip_FastBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output)
   uint8    Winner[FastBWT_NumGroups-1];
   uint32 * PtrHash[FastBWT_NumGroups];
 
-  sint32 * BigBucket=(sint32 *)BigAlloc(BWT_MaxWord*sizeof(sint32));
+  sint32 * BigBucket=(sint32 *)PoolAlloc(BWT_MaxWord*sizeof(sint32));
   if (BigBucket==NULL) return (GRZ_NOT_ENOUGH_MEMORY);
 
-  sint32 * Index=(sint32 *)BigAlloc((Size+1)*sizeof(sint32));
-  if (Index==NULL) {BigFree(BigBucket);return (GRZ_NOT_ENOUGH_MEMORY);}
+  sint32 * Index=(sint32 *)PoolAlloc((Size+1)*sizeof(sint32));
+  if (Index==NULL) {PoolFree(BigBucket);return (GRZ_NOT_ENOUGH_MEMORY);}
 
   sint32   GroupSize=Size/FastBWT_NumGroups;
 
@@ -835,6 +1047,19 @@ sint32 GRZip_FastBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output)
     Index[BigBucket[tmp]++]=i;
   }
 
+  if (Sorter!=NULL)
+  {
+    Sorter->Index=Index; Sorter->Input=Input; Sorter->Size=Size; Sorter->BucketEnd=BigBucket;
+    Sorter->Start=SmallBucketLo[FastBWT_NumGroups-1]; Sorter->NextBucket=0; Sorter->AML=AML; Sorter->Used=0;
+    Sorter->Helpers->run(Sorter,Sorter->NumHelpers);
+    if (Sorter->Used>Sorter->AML)
+    {
+      PoolFree(BigBucket);
+      PoolFree(Index);
+      return (GRZ_FAST_BWT_FAILS);
+    }
+  }
+  else
   for (Lo=SmallBucketLo[FastBWT_NumGroups-1],i=0;i<BWT_MaxWord;i++)
   {
     Hi=BigBucket[i]-1;
@@ -845,14 +1070,14 @@ sint32 GRZip_FastBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output)
         FastBWT_ShellSortDeph2(Index,Input,Lo,Hi,Size,&AML);
     if (AML<0)
     {
-      BigFree(BigBucket);
-      BigFree(Index);
+      PoolFree(BigBucket);
+      PoolFree(Index);
       return (GRZ_FAST_BWT_FAILS);
     }
     Lo=Hi+1;
   }
 
-  BigFree(BigBucket);
+  PoolFree(BigBucket);
 
   for (i=FastBWT_NumGroups-2;i>=0;i--)
   {
@@ -899,7 +1124,7 @@ sint32 GRZip_FastBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output)
     for (j=i+Min;i<j;)
     {
       TreeReBuild(SmallBucketLo,SmallBucketHi,PtrHash,Winner,Input,Size,&AML);
-      if (AML<0) {BigFree(Index); return (GRZ_FAST_BWT_FAILS);}
+      if (AML<0) {PoolFree(Index); return (GRZ_FAST_BWT_FAILS);}
       for (;(i<j)&&(Output[i]==0xFF);i++)
       {
         uint8 GNum = Winner[FastBWT_NumGroups-2];
@@ -907,13 +1132,14 @@ sint32 GRZip_FastBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output)
         uint32 Ptr = Index[Indx];
         uint8   PB = (Output[i]=(Ptr>>24));
         if ((Ptr&0xFFFFFF)==Size-1) Cum=i;
+        BWT_SaveStart(Size-1-(sint32)(Ptr&0xFFFFFF),i);
         PtrHash[GNum] =(uint32 *)(Input+(Index[Indx+1]&0xFFFFFF)-3);
 
         Ptr=(BucketStart[PB]++);
         if (i<Ptr) Output[Ptr]=(GNum+FastBWT_NumGroups-1)&(FastBWT_NumGroups-1);
 
         TreeUpdateFast(PtrHash,Winner,Input,Size,GNum,&AML);
-        if (AML<0) {BigFree(Index); return (GRZ_FAST_BWT_FAILS);}
+        if (AML<0) {PoolFree(Index); return (GRZ_FAST_BWT_FAILS);}
       }
       for (;(i<j)&&(Output[i]!=0xFF);i++)
       {
@@ -922,6 +1148,7 @@ sint32 GRZip_FastBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output)
         uint32 Ptr = Index[Indx];
         uint8   PB = (Output[i]=(Ptr>>24));
         if ((Ptr&0xFFFFFF)==Size-1) Cum=i;
+        BWT_SaveStart(Size-1-(sint32)(Ptr&0xFFFFFF),i);
         PtrHash[GNum] =(uint32 *)(Input+(Index[Indx+1]&0xFFFFFF)-3);
 
         Ptr=(BucketStart[PB]++);
@@ -932,15 +1159,16 @@ sint32 GRZip_FastBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output)
   for (;i<Size;i++)
     {
       TreeReBuild(SmallBucketLo,SmallBucketHi,PtrHash,Winner,Input,Size,&AML);
-      if (AML<0) {BigFree(Index); return (GRZ_FAST_BWT_FAILS);}
+      if (AML<0) {PoolFree(Index); return (GRZ_FAST_BWT_FAILS);}
       uint8 GNum = Winner[FastBWT_NumGroups-2];
       uint32 Indx= SmallBucketLo[GNum]++;
       uint32 Ptr = Index[Indx];
       uint8   PB = (Output[i]=(Ptr>>24));
       if ((Ptr&0xFFFFFF)==Size-1) Cum=i;
+      BWT_SaveStart(Size-1-(sint32)(Ptr&0xFFFFFF),i);
       PtrHash[GNum] =(uint32 *)(Input+(Index[Indx+1]&0xFFFFFF)-3);
    }
-  BigFree(Index);
+  PoolFree(Index);
   if (AML<0) return (GRZ_FAST_BWT_FAILS); else return (Cum);
 }
 
@@ -949,13 +1177,15 @@ sint32 GRZip_FastBWT_Encode(uint8 * Input,sint32 Size,uint8 * Output)
 
 #endif  // !defined (FREEARC_DECOMPRESS_ONLY)
 
-sint32 GRZip_FastBWT_Decode(uint8 * Input,sint32 Size,sint32 FBP)
+sint32 GRZip_FastBWT_Decode(uint8 * Input,sint32 Size,sint32 FBP,
+                            sint32 * Starts,sint32 NumStarts,sint32 ChainLog,
+                            GRZip_BWT_Inverter * Inverter)
 {
   uint32 Count[BWT_MaxByte];
   sint32 i;
   uint32 Sum;
 
-  uint32 * T=(uint32 *)BigAlloc(Size*sizeof(uint32));
+  uint32 * T=(uint32 *)PoolAlloc(Size*sizeof(uint32));
   if (T==NULL) return (GRZ_NOT_ENOUGH_MEMORY);
 
   memset(Count,0,BWT_MaxByte*sizeof(uint32));
@@ -968,6 +1198,13 @@ sint32 GRZip_FastBWT_Decode(uint8 * Input,sint32 Size,sint32 FBP)
 
   for (Sum=0,i=0;i<BWT_MaxByte;i++){Sum+=Count[i];Count[i]=Sum-Count[i];}
 
+  if (NumStarts>0)
+  {
+    sint32 Result=GRZip_BWT_DecodeChains(T,Count,Input,Size,Size,FBP,Starts,NumStarts,ChainLog,Inverter);
+    PoolFree(T);
+    return (Result);
+  }
+
   for (i=Size-1;i>=0;i--)
   {
     uint32 u=T[FBP];
@@ -976,12 +1213,162 @@ sint32 GRZip_FastBWT_Decode(uint8 * Input,sint32 Size,sint32 FBP)
     Input[i]=c;
   }
 
-  BigFree(T);
+  PoolFree(T);
   return GRZ_NO_ERROR;
 }
 
 #ifndef FREEARC_DECOMPRESS_ONLY
 
+/*-------------------------------------------------*/
+/* Induced sorting (SA-IS) BWT                     */
+/*-------------------------------------------------*/
+
+/*--
+  Linear-time suffix array construction by induced sorting
+  (G. Nong, S. Zhang, W.H. Chan, "Two Efficient Algorithms for
+  Linear Time Suffix Array Construction"). End of string is
+  a virtual sentinel, smaller than any symbol. Time doesn't
+  depend on data repetitiveness; reduced strings are kept
+  inside SA, so extra memory is Size/8 bytes of types plus
+  buckets of the reduced alphabet (at most 2*Size bytes).
+--*/
+
+#define SAIS_GetType(i)             ((Type[(i)>>3]>>((i)&7))&1)
+#define SAIS_SetType(i,b)           {if (b) Type[(i)>>3]|=(1<<((i)&7)); else Type[(i)>>3]&=~(1<<((i)&7));}
+#define SAIS_Chr(i)                 ((CharSize==1) ? ((uint8 *)Str)[i] : ((sint32 *)Str)[i])
+#define SAIS_IsLMS(i)               ((i)>0 && SAIS_GetType(i) && !SAIS_GetType((i)-1))
+
+static void SAIS_GetBuckets(void * Str,sint32 Size,sint32 CharSize,sint32 * Bucket,sint32 K,sint32 End)
+{
+  sint32 i,Sum;
+  memset(Bucket,0,K*sizeof(sint32));
+  for (i=0;i<Size;i++) Bucket[SAIS_Chr(i)]++;
+  for (Sum=0,i=0;i<K;i++) {Sum+=Bucket[i];Bucket[i]=End?Sum:Sum-Bucket[i];}
+}
+
+static void SAIS_Induce(void * Str,sint32 * SA,uint8 * Type,sint32 Size,sint32 CharSize,sint32 * Bucket,sint32 K)
+{
+  sint32 i,j;
+
+  SAIS_GetBuckets(Str,Size,CharSize,Bucket,K,0);
+  SA[Bucket[SAIS_Chr(Size-1)]++]=Size-1;
+  for (i=0;i<Size;i++)
+  {
+    j=SA[i]-1;
+    if (j>=0 && !SAIS_GetType(j)) SA[Bucket[SAIS_Chr(j)]++]=j;
+  }
+
+  SAIS_GetBuckets(Str,Size,CharSize,Bucket,K,1);
+  for (i=Size-1;i>=0;i--)
+  {
+    j=SA[i]-1;
+    if (j>=0 && SAIS_GetType(j)) SA[--Bucket[SAIS_Chr(j)]]=j;
+  }
+}
+
+static sint32 SAIS_Sort(void * Str,sint32 * SA,sint32 Size,sint32 K,sint32 CharSize)
+{
+  sint32 i,j,d,NumLMS,Name,Prev;
+
+  uint8 *  Type=(uint8 *)PoolAlloc((Size>>3)+1);
+  if (Type==NULL) return (GRZ_NOT_ENOUGH_MEMORY);
+
+  sint32 * Bucket=(sint32 *)PoolAlloc(K*sizeof(sint32));
+  if (Bucket==NULL) {PoolFree(Type);return (GRZ_NOT_ENOUGH_MEMORY);}
+
+  SAIS_SetType(Size-1,0);
+  for (i=Size-2;i>=0;i--)
+    SAIS_SetType(i,(SAIS_Chr(i)<SAIS_Chr(i+1)) || (SAIS_Chr(i)==SAIS_Chr(i+1) && SAIS_GetType(i+1)));
+
+  /* Stage 1: sort LMS substrings */
+  SAIS_GetBuckets(Str,Size,CharSize,Bucket,K,1);
+  for (i=0;i<Size;i++) SA[i]=-1;
+  for (i=1;i<Size;i++)
+    if (SAIS_IsLMS(i)) SA[--Bucket[SAIS_Chr(i)]]=i;
+  SAIS_Induce(Str,SA,Type,Size,CharSize,Bucket,K);
+  PoolFree(Bucket);
+
+  for (NumLMS=0,i=0;i<Size;i++)
+    if (SAIS_IsLMS(SA[i])) SA[NumLMS++]=SA[i];
+
+  /* Name LMS substrings, the reduced string goes to the end of SA */
+  for (i=NumLMS;i<Size;i++) SA[i]=-1;
+  for (Name=0,Prev=-1,i=0;i<NumLMS;i++)
+  {
+    sint32 Pos=SA[i],Diff=0;
+    for (d=0;d<Size;d++)
+      if (Prev==-1 || Pos+d==Size || Prev+d==Size ||
+          SAIS_Chr(Pos+d)!=SAIS_Chr(Prev+d) || SAIS_GetType(Pos+d)!=SAIS_GetType(Prev+d))
+        {Diff=1;break;}
+      else
+        if (d>0 && (SAIS_IsLMS(Pos+d) || SAIS_IsLMS(Prev+d))) break;
+    if (Diff) {Name++;Prev=Pos;}
+    SA[NumLMS+(Pos>>1)]=Name-1;
+  }
+  for (i=j=Size-1;i>=NumLMS;i--)
+    if (SA[i]>=0) SA[j--]=SA[i];
+
+  /* Stage 2: sort LMS suffixes, recursing if their names aren't unique */
+  sint32 * SA1=SA;
+  sint32 * S1=SA+Size-NumLMS;
+  if (Name<NumLMS)
+  {
+    sint32 Result=SAIS_Sort(S1,SA1,NumLMS,Name,sizeof(sint32));
+    if (Result!=GRZ_NO_ERROR) {PoolFree(Type);return (Result);}
+  }
+  else
+    for (i=0;i<NumLMS;i++) SA1[S1[i]]=i;
+
+  /* Stage 3: induce SA from sorted LMS suffixes */
+  Bucket=(sint32 *)PoolAlloc(K*sizeof(sint32));
+  if (Bucket==NULL) {PoolFree(Type);return (GRZ_NOT_ENOUGH_MEMORY);}
+
+  SAIS_GetBuckets(Str,Size,CharSize,Bucket,K,1);
+  for (i=1,j=0;i<Size;i++)
+    if (SAIS_IsLMS(i)) S1[j++]=i;
+  for (i=0;i<NumLMS;i++) SA1[i]=S1[SA1[i]];
+  for (i=NumLMS;i<Size;i++) SA[i]=-1;
+  for (i=NumLMS-1;i>=0;i--)
+  {
+    j=SA[i];SA[i]=-1;
+    SA[--Bucket[SAIS_Chr(j)]]=j;
+  }
+  SAIS_Induce(Str,SA,Type,Size,CharSize,Bucket,K);
+
+  PoolFree(Bucket);PoolFree(Type);
+  return (GRZ_NO_ERROR);
+}
+
+/* Produces the same output as GRZip_StrongBWT_Encode, so it's decoded by GRZip_StrongBWT_Decode */
+sint32 GRZip_SAIS_BWT_Encode(uint8 * Input,sint32 Size,uint8 * Output,sint32 * Starts,sint32 ChainLog)
+{
+  sint32 i,j,Primary=0;
+
+  sint32 * SA=(sint32 *)PoolAlloc(Size*sizeof(sint32));
+  if (SA==NULL) return (GRZ_NOT_ENOUGH_MEMORY);
+
+  if (SAIS_Sort(Input,SA,Size,BWT_MaxByte,1)!=GRZ_NO_ERROR) {PoolFree(SA);return (GRZ_NOT_ENOUGH_MEMORY);}
+
+  /* Row 0 is the sentinel suffix; BWT bytes are packed into already processed part of SA, so Output may be equal to Input */
+  uint8 *  BWT=(uint8 *)SA;
+  for (i=0,j=0;i<Size;i++)
+  {
+    sint32 Pos=SA[i];
+    if (i==0) BWT[j++]=Input[Size-1];
+    if (Pos==0) Primary=i+1; else BWT[j++]=Input[Pos-1];
+    BWT_SaveStart(Pos,i+1);
+  }
+  memcpy(Output,BWT,Size);
+
+  PoolFree(SA);
+  return (Primary);
+}
+
+#undef SAIS_GetType
+#undef SAIS_SetType
+#undef SAIS_Chr
+#undef SAIS_IsLMS
+
 void GRZip_BWT_FastBWT_Init(uint8 * Input,sint32 Size)
 {
   sint32 i,Mid=(Size+FastBWT_NumOverShoot)>>1;
@@ -1011,50 +1398,63 @@ void GRZip_BWT_FastBWT_Done(uint8 * Input,sint32 Size)
   }
 }
 
-sint32 GRZip_BWT_Encode(uint8 * Input,sint32 Size,uint8 * Output,sint32 FastMode)
+/* Sorter with NumHelpers>0 allows to split sorting of the block between several threads (its result doesn't depend on their number).
+   Starts!=NULL receives rows of positions (j+1)<<ChainLog, see GRZip_BWT_DecodeChains */
+sint32 GRZip_BWT_Encode(uint8 * Input,sint32 Size,uint8 * Output,sint32 Sorting,GRZip_BWT_Sorter * Sorter,
+                        sint32 * Starts,sint32 ChainLog)
 {
-  if (!FastMode)
+  sint32 Parallel=(Sorter!=NULL)&&(Sorter->NumHelpers>0);
+  if (Sorting==GRZ_BWTSorting_SAIS)
+  {
+    sint32 Result=GRZip_SAIS_BWT_Encode(Input,Size,Output,Starts,ChainLog);
+    if (Result!=GRZ_NOT_ENOUGH_MEMORY) return (Result|StrongBWT_Flag);
+    return (GRZ_NOT_ENOUGH_MEMORY);
+  }
+  if (Sorting==GRZ_BWTSorting_Strong)
   {
-    sint32 Result=GRZip_StrongBWT_Encode(Input,Size,Output);
+    sint32 Result=GRZip_StrongBWT_Encode(Input,Size,Output,Starts,ChainLog);
     if (Result!=GRZ_NOT_ENOUGH_MEMORY) return (Result|StrongBWT_Flag);
     return (GRZ_NOT_ENOUGH_MEMORY);
   }
   if (Input==Output)
   {
-    uint8 * Buf=(uint8 *)BigAlloc(Size);
+    uint8 * Buf=(uint8 *)PoolAlloc(Size);
     if (Buf==NULL) return (GRZ_NOT_ENOUGH_MEMORY);
     GRZip_BWT_FastBWT_Init(Input,Size);
-    sint32 Result=GRZip_FastBWT_Encode(Input+FastBWT_NumOverShoot,Size,Buf);
+    sint32 Result=GRZip_FastBWT_Encode(Input+FastBWT_NumOverShoot,Size,Buf,Parallel?Sorter:NULL,Starts,ChainLog);
     if ((Result!=GRZ_FAST_BWT_FAILS)&&(Result!=GRZ_NOT_ENOUGH_MEMORY))
     {
       memcpy(Output,Buf,Size);
-      BigFree(Buf);
+      PoolFree(Buf);
       return (Result);
     }
-    BigFree(Buf);
+    PoolFree(Buf);
     GRZip_BWT_FastBWT_Done(Input,Size);
     if (Result==GRZ_NOT_ENOUGH_MEMORY) return (Result);
-    Result=GRZip_StrongBWT_Encode(Input,Size,Output);
+    Result=GRZip_SAIS_BWT_Encode(Input,Size,Output,Starts,ChainLog);
     if (Result!=GRZ_NOT_ENOUGH_MEMORY) return (Result|StrongBWT_Flag);
     return (GRZ_NOT_ENOUGH_MEMORY);
   }
   GRZip_BWT_FastBWT_Init(Input,Size);
-  sint32 Result=GRZip_FastBWT_Encode(Input+FastBWT_NumOverShoot,Size,Output);
+  sint32 Result=GRZip_FastBWT_Encode(Input+FastBWT_NumOverShoot,Size,Output,Parallel?Sorter:NULL,Starts,ChainLog);
   GRZip_BWT_FastBWT_Done(Input,Size);
   if (Result!=GRZ_FAST_BWT_FAILS) return (Result);
-  Result=GRZip_StrongBWT_Encode(Input,Size,Output);
+  Result=GRZip_SAIS_BWT_Encode(Input,Size,Output,Starts,ChainLog);
   if (Result!=GRZ_NOT_ENOUGH_MEMORY) return (Result|StrongBWT_Flag);
   return (GRZ_NOT_ENOUGH_MEMORY);
 }
 
 #endif  // !defined (FREEARC_DECOMPRESS_ONLY)
 
-sint32 GRZip_BWT_Decode(uint8 * Input,sint32 Size,sint32 FBP)
+/* NumStarts>0 - rows saved by GRZip_BWT_Encode are used to decode several chains at once */
+sint32 GRZip_BWT_Decode(uint8 * Input,sint32 Size,sint32 FBP,
+                        sint32 * Starts,sint32 NumStarts,sint32 ChainLog,
+                        GRZip_BWT_Inverter * Inverter)
 {
   if ((FBP&StrongBWT_Flag)==0)
-    return (GRZip_FastBWT_Decode(Input,Size,FBP));
+    return (GRZip_FastBWT_Decode(Input,Size,FBP,Starts,NumStarts,ChainLog,Inverter));
   else
-    return (GRZip_StrongBWT_Decode(Input,Size,FBP&(~StrongBWT_Flag)));
+    return (GRZip_StrongBWT_Decode(Input,Size,FBP&(~StrongBWT_Flag),Starts,NumStarts,ChainLog,Inverter));
 }
 
 #undef BWT_MaxByte
@@ -1073,6 +1473,10 @@ sint32 GRZip_BWT_Decode(uint8 * Input,sint32 Size,sint32 FBP)
 #undef FastBWT_QSortStackSize
 #undef FastBWT_NumOverShoot
 #undef FastBWT_NumGroups
+#undef FastBWT_MTChunkSize
+
+#undef BWT_ChainsPerGroup
+#undef BWT_SaveStart
 
 #undef StrongBWT_Flag
 #undef StrongBWT_TSortStackSize
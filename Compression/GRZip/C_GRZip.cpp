@@ -47,6 +47,7 @@ extern "C" {
 #include "C_GRZip.h"
 }
 #include "../MultiThreading.h"
+#include "../SIMD.h"
 #include "libGRZip.h"
 #include "LZP.c"
 #include "BWT.c"
@@ -73,7 +74,8 @@ sint32 GRZip_StoreBlock(uint8 * Input ,sint32 Size,
 }
 
 sint32 GRZip_CompressBlock(uint8 * Input ,sint32 Size,
-                           uint8 * Output,sint32 Mode)
+                           uint8 * Output,sint32 Mode,
+                           GRZip_BWT_Sorter * Sorter)
 {
   sint32 SSize=Size;
 
@@ -90,36 +92,36 @@ sint32 GRZip_CompressBlock(uint8 * Input ,sint32 Size,
     if (RecMode)
     {
       sint32 NewSize;
-      uint8 * Buffer=(uint8 *)BigAlloc(Size+LZP_MaxMatchLen);
+      uint8 * Buffer=(uint8 *)PoolAlloc(Size+LZP_MaxMatchLen);
       if (Buffer==NULL) return(GRZip_StoreBlock(Input,Size,Output,0));
       GRZip_Rec_Encode(Input,Size,Buffer,RecMode); Mode+=GRZ_Disable_DeltaFlt;
       if ((RecMode&1)==1)
       {
         sint32 PartSize=(Size>>1);
-        sint32 Result=GRZip_CompressBlock(Buffer,PartSize,Output+28,Mode);
-        if (Result<0) {BigFree(Buffer);return(GRZip_StoreBlock(Input,Size,Output,0));}
+        sint32 Result=GRZip_CompressBlock(Buffer,PartSize,Output+28,Mode,Sorter);
+        if (Result<0) {PoolFree(Buffer);return(GRZip_StoreBlock(Input,Size,Output,0));}
         NewSize=Result;
-        Result=GRZip_CompressBlock(Buffer+PartSize,Size-PartSize,Output+28+NewSize,Mode);
-        if (Result<0) {BigFree(Buffer);return(GRZip_StoreBlock(Input,Size,Output,0));}
+        Result=GRZip_CompressBlock(Buffer+PartSize,Size-PartSize,Output+28+NewSize,Mode,Sorter);
+        if (Result<0) {PoolFree(Buffer);return(GRZip_StoreBlock(Input,Size,Output,0));}
         NewSize+=Result;
       }
       if ((RecMode&1)==0)
       {
         sint32 PartSize=(Size>>2);
-        sint32 Result=GRZip_CompressBlock(Buffer,PartSize,Output+28,Mode);
-        if (Result<0) {BigFree(Buffer);return(GRZip_StoreBlock(Input,Size,Output,0));}
+        sint32 Result=GRZip_CompressBlock(Buffer,PartSize,Output+28,Mode,Sorter);
+        if (Result<0) {PoolFree(Buffer);return(GRZip_StoreBlock(Input,Size,Output,0));}
         NewSize=Result;
-        Result=GRZip_CompressBlock(Buffer+PartSize,PartSize,Output+28+NewSize,Mode);
-        if (Result<0) {BigFree(Buffer);return(GRZip_StoreBlock(Input,Size,Output,0));}
+        Result=GRZip_CompressBlock(Buffer+PartSize,PartSize,Output+28+NewSize,Mode,Sorter);
+        if (Result<0) {PoolFree(Buffer);return(GRZip_StoreBlock(Input,Size,Output,0));}
         NewSize+=Result;
-        Result=GRZip_CompressBlock(Buffer+2*PartSize,PartSize,Output+28+NewSize,Mode);
-        if (Result<0) {BigFree(Buffer);return(GRZip_StoreBlock(Input,Size,Output,0));}
+        Result=GRZip_CompressBlock(Buffer+2*PartSize,PartSize,Output+28+NewSize,Mode,Sorter);
+        if (Result<0) {PoolFree(Buffer);return(GRZip_StoreBlock(Input,Size,Output,0));}
         NewSize+=Result;
-        Result=GRZip_CompressBlock(Buffer+3*PartSize,Size-3*PartSize,Output+28+NewSize,Mode);
-        if (Result<0) {BigFree(Buffer);return(GRZip_StoreBlock(Input,Size,Output,0));}
+        Result=GRZip_CompressBlock(Buffer+3*PartSize,Size-3*PartSize,Output+28+NewSize,Mode,Sorter);
+        if (Result<0) {PoolFree(Buffer);return(GRZip_StoreBlock(Input,Size,Output,0));}
         NewSize+=Result;
       }
-      BigFree(Buffer);
+      PoolFree(Buffer);
 
       if (NewSize>=Size) return(GRZip_StoreBlock(Input,Size,Output,0));
 
@@ -133,7 +135,7 @@ sint32 GRZip_CompressBlock(uint8 * Input ,sint32 Size,
     }
   }
 
-  uint8 * LZPBuffer=(uint8 *)BigAlloc(Size+LZP_MaxMatchLen);
+  uint8 * LZPBuffer=(uint8 *)PoolAlloc(Size+LZP_MaxMatchLen);
   if (LZPBuffer==NULL) return(GRZip_StoreBlock(Input,Size,Output,0));
 
   if (LZP_Enabled(Mode))
@@ -141,7 +143,7 @@ sint32 GRZip_CompressBlock(uint8 * Input ,sint32 Size,
     sint32 Result=GRZip_LZP_Encode(Input,Size,LZPBuffer,Get_LZP_MinMatchLen(Mode),Get_LZP_HT_Size(Mode));
     if (Result==GRZ_NOT_ENOUGH_MEMORY)
     {
-      BigFree(LZPBuffer);
+      PoolFree(LZPBuffer);
       return(GRZip_StoreBlock(Input,Size,Output,0));
     };
     if (Result==GRZ_NOT_COMPRESSIBLE)
@@ -163,10 +165,14 @@ sint32 GRZip_CompressBlock(uint8 * Input ,sint32 Size,
   for (Result=0;Result<8;Result++) LZPBuffer[Result+Size]=0;
   Size=(Size+7)&(~7);
 
+  sint32 Starts[GRZ_BWT_MaxChains],ChainLog=0,NumStarts=0;  // ,      
   if (Mode&GRZ_Compression_ST4)
     Result=GRZip_ST4_Encode(LZPBuffer,Size,LZPBuffer);
   else
-    Result=GRZip_BWT_Encode(LZPBuffer,Size,LZPBuffer,Mode&GRZ_BWTSorting_Fast);
+  {
+    ChainLog=GRZip_BWT_ChainLog(Size); NumStarts=(Size-1)>>ChainLog;
+    Result=GRZip_BWT_Encode(LZPBuffer,Size,LZPBuffer,Mode&(GRZ_BWTSorting_Fast|GRZ_BWTSorting_SAIS),Sorter,Starts,ChainLog);
+  }
 
   if (Result==GRZ_NOT_ENOUGH_MEMORY)
   {
@@ -175,23 +181,25 @@ sint32 GRZip_CompressBlock(uint8 * Input ,sint32 Size,
       sint32 Result=GRZip_LZP_Encode(Input,SSize,LZPBuffer,Get_LZP_MinMatchLen(Mode),Get_LZP_HT_Size(Mode));
       if (Result==GRZ_NOT_ENOUGH_MEMORY)
       {
-        BigFree(LZPBuffer);
+        PoolFree(LZPBuffer);
         return(GRZip_StoreBlock(Input,SSize,Output,0));
       };
       Result=GRZip_StoreBlock(LZPBuffer,Result,Output,Mode);
-      BigFree(LZPBuffer);
+      PoolFree(LZPBuffer);
       return (Result);
     }
-    BigFree(LZPBuffer);
+    PoolFree(LZPBuffer);
     return(GRZip_StoreBlock(Input,SSize,Output,0));
   };
 
   *(sint32 *)(Output+12)=Result;
+  memcpy(Output+28,Starts,NumStarts*sizeof(sint32));
+  sint32 StartsSize=NumStarts*sizeof(sint32);
 
   if (Mode&GRZ_Compression_MTF)
-    Result=GRZip_MTF_Ari_Encode(LZPBuffer,Size,Output+28);
+    Result=GRZip_MTF_Ari_Encode(LZPBuffer,Size,Output+28+StartsSize);
   else
-    Result=GRZip_WFC_Ari_Encode(LZPBuffer,Size,Output+28);
+    Result=GRZip_WFC_Ari_Encode(LZPBuffer,Size,Output+28+StartsSize);
 
   if ((Result==GRZ_NOT_ENOUGH_MEMORY)||(Result==GRZ_NOT_COMPRESSIBLE))
   {
@@ -200,24 +208,24 @@ sint32 GRZip_CompressBlock(uint8 * Input ,sint32 Size,
       sint32 Result=GRZip_LZP_Encode(Input,SSize,LZPBuffer,Get_LZP_MinMatchLen(Mode),Get_LZP_HT_Size(Mode));
       if (Result==GRZ_NOT_ENOUGH_MEMORY)
       {
-        BigFree(LZPBuffer);
+        PoolFree(LZPBuffer);
         return(GRZip_StoreBlock(Input,SSize,Output,0));
       };
       Result=GRZip_StoreBlock(LZPBuffer,Result,Output,Mode);
-      BigFree(LZPBuffer);
+      PoolFree(LZPBuffer);
       return (Result);
     }
-    BigFree(LZPBuffer);
+    PoolFree(LZPBuffer);
     return(GRZip_StoreBlock(Input,SSize,Output,0));
   };
 
   *(sint32 *)(Output+4)=Mode;
-  *(sint32 *)(Output+16)=Result;
+  *(sint32 *)(Output+16)=Result+StartsSize;
   *(sint32 *)(Output+20)=RESERVED;
-  *(sint32 *)(Output+24)=RESERVED;
+  *(sint32 *)(Output+24)=NumStarts? (NumStarts<<8)+ChainLog : RESERVED;
 
-  BigFree(LZPBuffer);
-  return (Result+28);
+  PoolFree(LZPBuffer);
+  return (Result+StartsSize+28);
 }
 
 #endif  // !defined (FREEARC_DECOMPRESS_ONLY)
@@ -225,20 +233,24 @@ sint32 GRZip_CompressBlock(uint8 * Input ,sint32 Size,
 sint32 GRZip_CheckBlockSign(uint8 * Input,sint32 Size)
 {
   if (Size<28) return (GRZ_UNEXPECTED_EOF);
-  if ((*(sint32 *)(Input+24))!=RESERVED)
+  if ((*(sint32 *)(Input+20))!=RESERVED)
     return (GRZ_CRC_ERROR);
   return (GRZ_NO_ERROR);
 }
 
-sint32 GRZip_DecompressBlock(uint8 * Input,sint32 Size,uint8 * Output)
+sint32 GRZip_DecompressBlock(uint8 * Input,sint32 Size,uint8 * Output,GRZip_BWT_Inverter * Inverter)
 {
   if (Size<28) return (GRZ_UNEXPECTED_EOF);
-  if ((*(sint32 *)(Input+24))!=RESERVED)
+  if ((*(sint32 *)(Input+20))!=RESERVED)
     return (GRZ_CRC_ERROR);
   if ((*(sint32 *)(Input+16))+28>Size) return (GRZ_UNEXPECTED_EOF);
-  if ((*(sint32 *)(Input+20))!=RESERVED)
+  sint32 NumStarts=(*(uint32 *)(Input+24))>>8, ChainLog=(*(sint32 *)(Input+24))&255;
+  sint32 StartsSize=NumStarts*sizeof(sint32);
+  if ((NumStarts>=GRZ_BWT_MaxChains)||(StartsSize>*(sint32 *)(Input+16)))
     return (GRZ_CRC_ERROR);
   sint32 Mode=*(sint32 *)(Input+4);
+  if ((Mode<0)&&(NumStarts||ChainLog))
+    return (GRZ_CRC_ERROR);
   sint32 Result=*(sint32 *)(Input+16);
   if (Mode==-1)
   {
@@ -257,7 +269,7 @@ sint32 GRZip_DecompressBlock(uint8 * Input,sint32 Size,uint8 * Output)
     sint32 RecMode=*(sint32 *)(Input+8);
               Size=*(sint32 *)(Input);
 
-    uint8 * Buffer=(uint8 *)BigAlloc(Size+LZP_MaxMatchLen);
+    uint8 * Buffer=(uint8 *)PoolAlloc(Size+LZP_MaxMatchLen);
     if (Buffer==NULL) return(GRZ_NOT_ENOUGH_MEMORY);
 
     uint8 * Tmp=(Input+28);
@@ -265,48 +277,48 @@ sint32 GRZip_DecompressBlock(uint8 * Input,sint32 Size,uint8 * Output)
 
     if ((RecMode&1)==1)
     {
-      Result=GRZip_DecompressBlock(Tmp,(*(sint32 *)(Tmp+16))+28,Buffer+OutputPos);
-      if (Result<0) {BigFree(Buffer);return Result;};
+      Result=GRZip_DecompressBlock(Tmp,(*(sint32 *)(Tmp+16))+28,Buffer+OutputPos,Inverter);
+      if (Result<0) {PoolFree(Buffer);return Result;};
       OutputPos+=Result;
       Tmp=Tmp+(*(sint32 *)(Tmp+16))+28;
-      Result=GRZip_DecompressBlock(Tmp,(*(sint32 *)(Tmp+16))+28,Buffer+OutputPos);
-      if (Result<0) {BigFree(Buffer);return Result;};
+      Result=GRZip_DecompressBlock(Tmp,(*(sint32 *)(Tmp+16))+28,Buffer+OutputPos,Inverter);
+      if (Result<0) {PoolFree(Buffer);return Result;};
     }
     if ((RecMode&1)==0)
     {
-      Result=GRZip_DecompressBlock(Tmp,(*(sint32 *)(Tmp+16))+28,Buffer+OutputPos);
-      if (Result<0) {BigFree(Buffer);return Result;};
+      Result=GRZip_DecompressBlock(Tmp,(*(sint32 *)(Tmp+16))+28,Buffer+OutputPos,Inverter);
+      if (Result<0) {PoolFree(Buffer);return Result;};
       OutputPos+=Result;
       Tmp=Tmp+(*(sint32 *)(Tmp+16))+28;
-      Result=GRZip_DecompressBlock(Tmp,(*(sint32 *)(Tmp+16))+28,Buffer+OutputPos);
-      if (Result<0) {BigFree(Buffer);return Result;};
+      Result=GRZip_DecompressBlock(Tmp,(*(sint32 *)(Tmp+16))+28,Buffer+OutputPos,Inverter);
+      if (Result<0) {PoolFree(Buffer);return Result;};
       OutputPos+=Result;
       Tmp=Tmp+(*(sint32 *)(Tmp+16))+28;
-      Result=GRZip_DecompressBlock(Tmp,(*(sint32 *)(Tmp+16))+28,Buffer+OutputPos);
-      if (Result<0) {BigFree(Buffer);return Result;};
+      Result=GRZip_DecompressBlock(Tmp,(*(sint32 *)(Tmp+16))+28,Buffer+OutputPos,Inverter);
+      if (Result<0) {PoolFree(Buffer);return Result;};
       OutputPos+=Result;
       Tmp=Tmp+(*(sint32 *)(Tmp+16))+28;
-      Result=GRZip_DecompressBlock(Tmp,(*(sint32 *)(Tmp+16))+28,Buffer+OutputPos);
-      if (Result<0) {BigFree(Buffer);return Result;};
+      Result=GRZip_DecompressBlock(Tmp,(*(sint32 *)(Tmp+16))+28,Buffer+OutputPos,Inverter);
+      if (Result<0) {PoolFree(Buffer);return Result;};
     }
     GRZip_Rec_Decode(Buffer,Size,Output,RecMode);
-    BigFree(Buffer);
+    PoolFree(Buffer);
     return (Size);
   }
 
-  uint8 * LZPBuffer=(uint8 *)BigAlloc(*(sint32 *)(Input+8)+LZP_MaxMatchLen);
+  uint8 * LZPBuffer=(uint8 *)PoolAlloc(*(sint32 *)(Input+8)+LZP_MaxMatchLen);
   if (LZPBuffer==NULL) return(GRZ_NOT_ENOUGH_MEMORY);
 
   sint32 TSize;
 
   if (Mode&GRZ_Compression_MTF)
-    TSize=GRZip_MTF_Ari_Decode(Input+28,LZPBuffer);
+    TSize=GRZip_MTF_Ari_Decode(Input+28+StartsSize,LZPBuffer);
   else
-    TSize=GRZip_WFC_Ari_Decode(Input+28,(*(sint32 *)(Input+8)),LZPBuffer);
+    TSize=GRZip_WFC_Ari_Decode(Input+28+StartsSize,(*(sint32 *)(Input+8)),LZPBuffer);
 
   if (Result==GRZ_NOT_ENOUGH_MEMORY)
   {
-    BigFree(LZPBuffer);
+    PoolFree(LZPBuffer);
     return(GRZ_NOT_ENOUGH_MEMORY);
   };
 
@@ -315,12 +327,12 @@ sint32 GRZip_DecompressBlock(uint8 * Input,sint32 Size,uint8 * Output)
   if (Mode&GRZ_Compression_ST4)
     Result=GRZip_ST4_Decode(LZPBuffer,TSize,Result);
   else
-    Result=GRZip_BWT_Decode(LZPBuffer,TSize,Result);
+    Result=GRZip_BWT_Decode(LZPBuffer,TSize,Result,(sint32 *)(Input+28),NumStarts,ChainLog,Inverter);
 
-  if (Result==GRZ_NOT_ENOUGH_MEMORY)
+  if (Result<0)
   {
-    BigFree(LZPBuffer);
-    return(GRZ_NOT_ENOUGH_MEMORY);
+    PoolFree(LZPBuffer);
+    return(Result);
   };
 
   TSize=*(sint32 *)(Input+8);
@@ -330,14 +342,14 @@ sint32 GRZip_DecompressBlock(uint8 * Input,sint32 Size,uint8 * Output)
     sint32 Result=GRZip_LZP_Decode(LZPBuffer,TSize,Output,Get_LZP_MinMatchLen(Mode),Get_LZP_HT_Size(Mode));
     if (Result==GRZ_NOT_ENOUGH_MEMORY)
     {
-      BigFree(LZPBuffer);
+      PoolFree(LZPBuffer);
       return(GRZ_NOT_ENOUGH_MEMORY);
     };
   }
   else
     memcpy(Output,LZPBuffer,TSize);
 
-  BigFree(LZPBuffer);
+  PoolFree(LZPBuffer);
   return (*(sint32 *)Input);
 }
 
@@ -405,6 +417,7 @@ struct GRZipMTCompressor;
 struct GRZipCompressionThread : WorkerThread
 {
     GRZipMTCompressor* compressor;
+    GRZip_BWT_Sorter   Sorter;       //  -    BWT  
     int init();
     int process();
     int done();
@@ -415,6 +428,9 @@ struct GRZipMTCompressor : MTCompressor<GRZipCompressionThread>
 {
     sint32  Mode;
     int     BlockSize;
+    HelperThreads Helpers;           // ,   ,   ,   
+    Mutex   BusyLock;
+    int     BusyThreads;             //  ,    
     int     AdaptiveBlockSize;       //    
 
     GRZipMTCompressor (int Method,
@@ -437,12 +453,27 @@ struct GRZipMTCompressor : MTCompressor<GRZipCompressionThread>
             default: SetErrCode (FREEARC_ERRCODE_INVALID_COMPRESSOR);        ////
         }
         Mode += EnableLZP? Encode_LZP_HT_Size(HashSizeLog)+Encode_LZP_MinMatchLen(MinMatchLen) : GRZ_Disable_LZP;
-        Mode += AlternativeBWTSort? GRZ_BWTSorting_Strong : GRZ_BWTSorting_Fast;
+        Mode += AlternativeBWTSort==2? GRZ_BWTSorting_SAIS : AlternativeBWTSort? GRZ_BWTSorting_Strong : GRZ_BWTSorting_Fast;
         Mode += DeltaFilter? GRZ_Enable_DeltaFlt : GRZ_Disable_DeltaFlt;
         this->AdaptiveBlockSize = AdaptiveBlockSize;
         this->BlockSize = mymin (BlockSize, GRZ_MaxBlockSize);
         this->callback  = callback;
         this->auxdata   = auxdata;
+        BusyThreads     = 0;
+    }
+
+    //      BWT,   2-     
+    virtual void CreateJobs()
+    {
+        MTCompressor<GRZipCompressionThread>::CreateJobs();
+        if (GetCompressionThreads()>1  &&  !(Mode&GRZ_Compression_ST4)  &&  (Mode&GRZ_BWTSorting_Fast))
+            Helpers.start (GetCompressionThreads()-1, NumThreads);
+    }
+    //     jobs,         jobs[i].Sorter
+    virtual void WaitJobsFinished()
+    {
+        MTCompressor<GRZipCompressionThread>::WaitJobsFinished();
+        Helpers.stop();
     }
 
     int main_cycle()
@@ -473,14 +504,18 @@ struct GRZipMTCompressor : MTCompressor<GRZipCompressionThread>
 int GRZipCompressionThread::init()                   // Alloc resources
 {
     compressor = (GRZipMTCompressor*) task;
-    InBuf   = (char*) BigAlloc (compressor->BlockSize + LZP_MaxMatchLen);
-    OutBuf  = (char*) BigAlloc (compressor->BlockSize + LZP_MaxMatchLen);
+    InBuf   = (char*) PoolAlloc (compressor->BlockSize + LZP_MaxMatchLen);
+    OutBuf  = (char*) PoolAlloc (compressor->BlockSize + LZP_MaxMatchLen);
     return (InBuf && OutBuf? 0 : FREEARC_ERRCODE_NOT_ENOUGH_MEMORY);
 }
 
 int GRZipCompressionThread::process()                // Perform one compression operation
 {
-    int res = GRZip_CompressBlock ((uint8*)InBuf, InSize, (uint8*)OutBuf, compressor->Mode);
+    //         
+    {Lock _(compressor->BusyLock);  Sorter.NumHelpers = GetCompressionThreads() - ++compressor->BusyThreads;}
+    Sorter.Helpers = &compressor->Helpers;
+    int res = GRZip_CompressBlock ((uint8*)InBuf, InSize, (uint8*)OutBuf, compressor->Mode, &Sorter);
+    {Lock _(compressor->BusyLock);  compressor->BusyThreads--;}
     return (res == GRZ_NOT_ENOUGH_MEMORY? FREEARC_ERRCODE_NOT_ENOUGH_MEMORY :
             res <  0?                     FREEARC_ERRCODE_GENERAL :
                                           res);
@@ -488,8 +523,8 @@ int GRZipCompressionThread::process()                // Perform one compression
 
 int GRZipCompressionThread::done()                   // Free resources
 {
-    BigFree(OutBuf);  OutBuf = NULL;
-    BigFree(InBuf);   InBuf  = NULL;
+    PoolFree(OutBuf);  OutBuf = NULL;
+    PoolFree(InBuf);   InBuf  = NULL;
     return 0;
 }
 
@@ -505,6 +540,7 @@ int __cdecl grzip_compress (int Method,
                     CALLBACK_FUNC *callback,
                     void *auxdata)
 {
+  PoolScope pool;
   GRZipMTCompressor grz (Method,
                          BlockSize,
                          EnableLZP,
@@ -521,20 +557,17 @@ int __cdecl grzip_compress (int Method,
 #endif  // !defined (FREEARC_DECOMPRESS_ONLY)
 
 
+struct GRZipMTDecompressor;
+
 // Single GRZip decompression thread
 struct GRZipDecompressionThread : WorkerThread
 {
-    int process()
-    {
-        int res = GRZip_DecompressBlock ((uint8*)InBuf, InSize+28, (uint8*)OutBuf);
-        return (res == GRZ_NOT_ENOUGH_MEMORY? FREEARC_ERRCODE_NOT_ENOUGH_MEMORY :
-                res <  0?                     FREEARC_ERRCODE_GENERAL :
-                                              res);
-    }
+    GRZip_BWT_Inverter Inverter;     //  -    BWT  
+    int process();
     int after_write()                //// done() too
     {
-        BigFree(OutBuf);  OutBuf = NULL;
-        BigFree(InBuf);   InBuf = NULL;
+        PoolFree(OutBuf);  OutBuf = NULL;
+        PoolFree(InBuf);   InBuf = NULL;
         return 0;
     }
 };
@@ -542,10 +575,28 @@ struct GRZipDecompressionThread : WorkerThread
 // Multi-threaded GRZip decompressor
 struct GRZipMTDecompressor : MTCompressor<GRZipDecompressionThread>
 {
+    HelperThreads Helpers;           // ,   ,   ,  
+    Mutex   BusyLock;
+    int     BusyThreads;             //  ,    
+
     GRZipMTDecompressor (CALLBACK_FUNC *callback, void *auxdata)
     {
         this->callback  = callback;
         this->auxdata   = auxdata;
+        BusyThreads     = 0;
+    }
+
+    virtual void CreateJobs()
+    {
+        MTCompressor<GRZipDecompressionThread>::CreateJobs();
+        if (GetCompressionThreads()>1)
+            Helpers.start (GetCompressionThreads()-1, NumThreads);
+    }
+    //     jobs,         jobs[i].Inverter
+    virtual void WaitJobsFinished()
+    {
+        MTCompressor<GRZipDecompressionThread>::WaitJobsFinished();
+        Helpers.stop();
     }
 
     int main_cycle()
@@ -558,11 +609,13 @@ struct GRZipMTDecompressor : MTCompressor<GRZipDecompressionThread>
             if (NumRead!=28)                                         return NumRead<0? NumRead:FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
             if (GRZip_CheckBlockSign(BlockSign,28)!=GRZ_NO_ERROR)    return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
 
+            //        ,         
             GRZipDecompressionThread *job = FreeJobs.Get();            // Acquire next compression job
-            job->InBuf = (char*) BigAlloc (*(sint32*)(BlockSign+16) + LZP_MaxMatchLen);
+            if (errcode < 0)                                         return 0;             // Error in other thread
+            job->InBuf = (char*) PoolAlloc (mymax (*(sint32*)(BlockSign+16), *(sint32*)BlockSign) + LZP_MaxMatchLen);
             if (job->InBuf==NULL)                                    return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
             memcpy(job->InBuf,BlockSign,28);
-            job->OutBuf = (char*) BigAlloc (*(sint32*)job->InBuf + LZP_MaxMatchLen);
+            job->OutBuf = (char*) PoolAlloc (*(sint32*)job->InBuf + LZP_MaxMatchLen);
             if (job->OutBuf==NULL)                                   return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
             job->InSize = callback("read",job->InBuf+28,*(sint32 *)(job->InBuf+16),auxdata);
             if (job->InSize != *(sint32 *)(job->InBuf+16))           return job->InSize<0? job->InSize : FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
@@ -573,8 +626,23 @@ struct GRZipMTDecompressor : MTCompressor<GRZipDecompressionThread>
 };
 
 
+int GRZipDecompressionThread::process()
+{
+    //        BWT  
+    GRZipMTDecompressor *decompressor = (GRZipMTDecompressor*) task;
+    {Lock _(decompressor->BusyLock);  Inverter.NumHelpers = GetCompressionThreads() - ++decompressor->BusyThreads;}
+    Inverter.Helpers = &decompressor->Helpers;
+    int res = GRZip_DecompressBlock ((uint8*)InBuf, InSize+28, (uint8*)OutBuf, &Inverter);
+    {Lock _(decompressor->BusyLock);  decompressor->BusyThreads--;}
+    return (res == GRZ_NOT_ENOUGH_MEMORY? FREEARC_ERRCODE_NOT_ENOUGH_MEMORY :
+            res <  0?                     FREEARC_ERRCODE_GENERAL :
+                                          res);
+}
+
+
 int __cdecl grzip_decompress (CALLBACK_FUNC *callback, void *auxdata)
 {
+  PoolScope pool;
   GRZipMTDecompressor grz (callback, auxdata);
   return grz.run();
 }
@@ -638,7 +706,7 @@ void GRZIP_METHOD::SetBlockSize (MemSize bs)
 }
 
 //   buf[MAX_METHOD_STRLEN] ,       (,   parse_GRZIP)
-void GRZIP_METHOD::ShowCompressionMethod (char *buf)
+void GRZIP_METHOD::ShowCompressionMethod (char *buf, bool purify)
 {
   char LZP_Str[100], BlockSizeStr[100];
   sprintf (LZP_Str, "l%d:h%d", MinMatchLen, HashSizeLog);
@@ -646,7 +714,7 @@ void GRZIP_METHOD::ShowCompressionMethod (char *buf)
   sprintf (buf, "grzip:%s:m%d:%s%s%s%s", BlockSizeStr,
                                          Method,
                                          EnableLZP?          LZP_Str : "l",
-                                         AlternativeBWTSort? ":s" : "",
+                                         AlternativeBWTSort==2? ":s2" : AlternativeBWTSort? ":s" : "",
                                          AdaptiveBlockSize?  ":a" : "",
                                          DeltaFilter?        ":d" : "");
 }
@@ -678,6 +746,7 @@ COMPRESSION_METHOD* parse_GRZIP (char** parameters)
         case 'b':  p->BlockSize   = parseMem (param+1, &error); continue;
         case 'l':  p->MinMatchLen = parseInt (param+1, &error); continue;
         case 'h':  p->HashSizeLog = parseInt (param+1, &error); continue;
+        case 's':  p->AlternativeBWTSort = parseInt (param+1, &error); continue;
       }
       //   ,       
       //         (..   -  ),
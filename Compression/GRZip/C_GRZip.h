@@ -28,7 +28,7 @@ public:
   int     EnableLZP;
   int     MinMatchLen;
   int     HashSizeLog;
-  int     AlternativeBWTSort;
+  int     AlternativeBWTSort;       //  BWT: 0 - , 1 - "", 2 -  (SA-IS,  )
   int     AdaptiveBlockSize;
   int     DeltaFilter;
 
@@ -41,7 +41,7 @@ public:
   virtual int compress   (CALLBACK_FUNC *callback, void *auxdata);
 
   //   buf[MAX_METHOD_STRLEN] ,       (,   parse_GRZIP)
-  virtual void ShowCompressionMethod (char *buf);
+  virtual void ShowCompressionMethod (char *buf, bool purify);
 
   // /  ,   /,     
   virtual MemSize GetCompressionMem     (void)         {return BlockSize*9*GetCompressionThreads();}
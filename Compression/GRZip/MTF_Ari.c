@@ -115,7 +115,7 @@
 }                                                   \
 
 #define Init_Models()                               \
-  uint32  MTF_List[ARI_MaxByte];                    \
+  uint8   MTF_List[ARI_MaxByte];                    \
                                                     \
   uint32  Model_L0_0[5];                            \
   uint32  Model_L0_1[ARI_MaxByte][5];               \
@@ -131,7 +131,7 @@
                                                     \
   uint32* Model_Log2RLE_1;                          \
                                                     \
-  Model_Log2RLE_1=(uint32*)BigAlloc(ARI_MaxByte*(GRZ_Log2MaxBlockSize+1)*sizeof(uint32));\
+  Model_Log2RLE_1=(uint32*)PoolAlloc(ARI_MaxByte*(GRZ_Log2MaxBlockSize+1)*sizeof(uint32));\
   if (Model_Log2RLE_1==NULL) return (GRZ_NOT_ENOUGH_MEMORY);\
                                                     \
   sint32 i,j,CtxRLE=0,CtxL0=0,CtxL1=0,CtxL2;        \
@@ -221,23 +221,17 @@ sint32 GRZip_MTF_Ari_Encode(uint8* Input,sint32 Size,uint8* Output)
 
     if (Output>=OutputEnd)
     {
-      BigFree(Model_Log2RLE_1);
+      PoolFree(Model_Log2RLE_1);
       return (GRZ_NOT_COMPRESSIBLE);
     }
 
     PredChar=Char; Char=*Input++;
 
-    RunSize=1;
-    while ((Input<InputEnd)&&(*Input==Char)) RunSize++,Input++;
+    RunSize=1+match_len(Input,Input-1,InputEnd-Input); Input+=RunSize-1;
 
-    WFCMTF_Rank=0; while (MTF_List[WFCMTF_Rank]!=Char) WFCMTF_Rank++;
-
-    if (WFCMTF_Rank)
-    {
-      sint32 Tmp=WFCMTF_Rank;
-      do MTF_List[Tmp]=MTF_List[Tmp-1]; while (--Tmp);
-      MTF_List[0]=Char;
-    }
+    WFCMTF_Rank=rank_find(MTF_List,Char);
+    memmove(MTF_List+1,MTF_List,WFCMTF_Rank);
+    MTF_List[0]=Char;
 
     WFCMTF_Rank=(WFCMTF_Rank-1)&0xFF;
 
@@ -377,7 +371,7 @@ sint32 GRZip_MTF_Ari_Encode(uint8* Input,sint32 Size,uint8* Output)
     CtxL2=(CtxL2<<1)|1;
   }
 
-  BigFree(Model_Log2RLE_1);
+  PoolFree(Model_Log2RLE_1);
   Low+=(Range>>=1); ARI_ShiftLow(); ARI_ShiftLow();
   ARI_ShiftLow(); ARI_ShiftLow(); ARI_ShiftLow();
   return (Output+Size-OutputEnd-24);
@@ -502,12 +496,8 @@ sint32 GRZip_MTF_Ari_Decode(uint8* Input,uint8* Output)
     WFCMTF_Rank=(WFCMTF_Rank+1)&0xFF;
 
     Char=MTF_List[WFCMTF_Rank];
-    if (WFCMTF_Rank)
-    {
-      sint32 Tmp=WFCMTF_Rank;
-      do MTF_List[Tmp]=MTF_List[Tmp-1]; while (--Tmp);
-      MTF_List[0]=Char;
-    }
+    memmove(MTF_List+1,MTF_List,WFCMTF_Rank);
+    MTF_List[0]=Char;
 
     WFCMTF_Rank=(WFCMTF_Rank-1)&0xFF;
 
@@ -557,10 +547,10 @@ sint32 GRZip_MTF_Ari_Decode(uint8* Input,uint8* Output)
        }
     RunSize+=WFCMTF_Log2RLESize[Log2RunSize];
 
-    while (RunSize--) *Output++=Char;
+    memset(Output,Char,RunSize); Output+=RunSize;
 
   }
-  BigFree(Model_Log2RLE_1);
+  PoolFree(Model_Log2RLE_1);
   return (Output-SOutput);
 }
 
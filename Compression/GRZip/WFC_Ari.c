@@ -67,50 +67,55 @@
 #define WFC_Pos12              2048
 
 #define WFC_Init()                                    \
-  uint8 * WFCBuf=(uint8 *)BigAlloc(Size);               \
+  uint8 * WFCBuf=(uint8 *)PoolAlloc(Size);               \
   if (WFCBuf==NULL) return (GRZ_NOT_ENOUGH_MEMORY);   \
                                                       \
-  sint32  WFC_List[WFC_MaxByte+1];                    \
-  sint32  Char2Index[WFC_MaxByte+1];                  \
-  sint32  CharWeight[WFC_MaxByte+1];                  \
+  int     WFC_List[WFC_MaxByte+1];                    \
+  sint32  Char2Index[WFC_MaxByte];                    \
                                                       \
   sint32  WFCBufPos=0;                                \
                                                       \
-  for (i=0;i<=WFC_MaxByte;i++)                        \
-  {                                                   \
+  for (i=0;i<WFC_MaxByte;i++)                         \
     WFC_List[i]=Char2Index[i]=i;                      \
-    CharWeight[i]=0;                                  \
-  }                                                   \
-  CharWeight[WFC_MaxByte]=-1;                         \
+  WFC_List[WFC_MaxByte]=-1;                           \
+
+#define WFC_Finish()  PoolFree(WFCBuf);                   \
 
-#define WFC_Finish()  BigFree(WFCBuf);                   \
+/*--
+  WFC_List entries are (weight<<8)+char, so the weight of the next
+  entry is compared without extra memory access: entry heavier than
+  weight W is simply the one greater than (W<<8)+255. WFC_List[256]=-1
+  stops the entry that sinks to the list end. The current char stays
+  at the list head until the next char, so its weight is updated there
+--*/
+#define WFC_Char(e)            ((e)&0xFF)
+#define WFC_Weight(W)          ((W)<<8)
 
-#define Update_Weight0(c)                             \
+#define Update_Weight0(c,j)                           \
 {                                                     \
-  CharWeight[c]+=WFC_Val0;                            \
-  sint32 j=Char2Index[c];                             \
-  if (j>0) do {                                       \
-    Char2Index[WFC_List[j]=WFC_List[j-1]]=j;          \
-  } while (--j);                                      \
-  WFC_List[0]=c;                                      \
+  sint32 n=j;                                         \
+  int    e=WFC_List[n]+WFC_Weight(WFC_Val0);          \
+  for (;n>0;n--)                                      \
+    Char2Index[WFC_Char(WFC_List[n]=WFC_List[n-1])]=n;\
+  WFC_List[0]=e;                                      \
   Char2Index[c]=0;                                    \
 }
 
 #define Update_Weight(c,Weight)                       \
 {                                                     \
-  sint32 W=(CharWeight[c]-=Weight);                   \
   if (c!=Char)                                        \
   {                                                   \
-    sint32  j=Char2Index[c];                          \
-    sint32* List=&WFC_List[j+1];                      \
-    while (CharWeight[*List]>W)                       \
-     {                                                \
-       Char2Index[List[-1]=*List]=j++;                \
-       List++;                                        \
-     }                                                \
-    WFC_List[j]=c;                                    \
+    sint32 j=Char2Index[c];                           \
+    int    e=WFC_List[j]-WFC_Weight(Weight);          \
+    while (WFC_List[j+1]>(e|0xFF))                    \
+    {                                                 \
+      Char2Index[WFC_Char(WFC_List[j]=WFC_List[j+1])]=j;\
+      j++;                                            \
+    }                                                 \
+    WFC_List[j]=e;                                    \
     Char2Index[c]=j;                                  \
   }                                                   \
+  else WFC_List[0]-=WFC_Weight(Weight);               \
 }
 
 #define Update_Weight_Full(Weight,Pos)                \
@@ -216,7 +221,7 @@
                                                     \
   WFC_Init()                                        \
                                                     \
-  Model_Log2RLE_1=(uint32*)BigAlloc(ARI_MaxByte*(GRZ_Log2MaxBlockSize+1)*sizeof(uint32));\
+  Model_Log2RLE_1=(uint32*)PoolAlloc(ARI_MaxByte*(GRZ_Log2MaxBlockSize+1)*sizeof(uint32));\
   if (Model_Log2RLE_1==NULL) {WFC_Finish();return (GRZ_NOT_ENOUGH_MEMORY);}\
                                                     \
   Model_L0_0[0]=Model_L0_0[1]=1;                    \
@@ -302,17 +307,16 @@ sint32 GRZip_WFC_Ari_Encode(uint8* Input,sint32 Size,uint8* Output)
     if (Output>=OutputEnd)
     {
       WFC_Finish();
-      BigFree(Model_Log2RLE_1);
+      PoolFree(Model_Log2RLE_1);
       return (GRZ_NOT_COMPRESSIBLE);
     }
 
     PredChar=Char; Char=*Input++;
 
-    RunSize=1;
-    while ((Input<InputEnd)&&(*Input==Char)) RunSize++,Input++;
+    RunSize=1+match_len(Input,Input-1,InputEnd-Input); Input+=RunSize-1;
 
     WFCBuf[WFCBufPos]=Char; WFCMTF_Rank=Char2Index[Char];
-    Update_Weight0(Char);
+    Update_Weight0(Char,WFCMTF_Rank);
     Update_Weight_Full(WFC_Val1,WFC_Pos1);
     Update_Weight_Full(WFC_Val2,WFC_Pos2);
     Update_Weight_Full(WFC_Val3,WFC_Pos3);
@@ -466,7 +470,7 @@ sint32 GRZip_WFC_Ari_Encode(uint8* Input,sint32 Size,uint8* Output)
     CtxL2=(CtxL2<<1)|1;
   }
   WFC_Finish();
-  BigFree(Model_Log2RLE_1);
+  PoolFree(Model_Log2RLE_1);
   Low+=(Range>>=1); ARI_ShiftLow(); ARI_ShiftLow();
   ARI_ShiftLow(); ARI_ShiftLow(); ARI_ShiftLow();
   return (Output+Size-OutputEnd-24);
@@ -592,9 +596,9 @@ sint32 GRZip_WFC_Ari_Decode(uint8* Input,uint32 Size,uint8* Output)
 
     WFCMTF_Rank=(WFCMTF_Rank+1)&0xFF;
 
-    Char=WFC_List[WFCMTF_Rank];WFCBuf[WFCBufPos]=Char;
+    Char=WFC_Char(WFC_List[WFCMTF_Rank]);WFCBuf[WFCBufPos]=Char;
 
-    Update_Weight0(Char);
+    Update_Weight0(Char,WFCMTF_Rank);
     Update_Weight_Full(WFC_Val1,WFC_Pos1);
     Update_Weight_Full(WFC_Val2,WFC_Pos2);
     Update_Weight_Full(WFC_Val3,WFC_Pos3);
@@ -658,11 +662,11 @@ sint32 GRZip_WFC_Ari_Decode(uint8* Input,uint32 Size,uint8* Output)
        }
     RunSize+=WFCMTF_Log2RLESize[Log2RunSize];
 
-    while (RunSize--) *Output++=Char;
+    memset(Output,Char,RunSize); Output+=RunSize;
 
   }
   WFC_Finish();
-  BigFree(Model_Log2RLE_1);
+  PoolFree(Model_Log2RLE_1);
   return (Output-SOutput);
 }
 
@@ -702,6 +706,8 @@ sint32 GRZip_WFC_Ari_Decode(uint8* Input,uint32 Size,uint8* Output)
 #undef Update_Weight
 #undef Update_Weight0
 #undef Update_Weight_Full
+#undef WFC_Char
+#undef WFC_Weight
 
 #undef ARI_MaxByte
 #undef WFC_MaxByte
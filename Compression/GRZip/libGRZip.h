@@ -54,6 +54,12 @@
 #define GRZ_MaxBlockSize             (8*1024*1024-512)
 #define GRZ_Log2MaxBlockSize         23
 
+//  BWT-      :  BWT   Step, 2*Step...
+//     ,     +24  ( <<8) + log2(Step).
+//       0,      ,    
+#define GRZ_BWT_MaxChains            64
+#define GRZ_BWT_MinChainLog          12
+
 //  Mode:   - 
 //                      -  -  LZP
 //                   -  (  ) - .    LZP
@@ -69,6 +75,7 @@
 
 #define GRZ_BWTSorting_Strong        0x0
 #define GRZ_BWTSorting_Fast          0x8
+#define GRZ_BWTSorting_SAIS          0x10
 
 #define Encode_LZP_MinMatchLen(Len)  ((Len)*65536)
 #define Encode_LZP_HT_Size(Size)     ((Size)*256)
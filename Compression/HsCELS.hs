@@ -84,6 +84,10 @@ decompress = runWithCallback "decompress"
 canonizeCompressionMethod :: Method -> Method
 canonizeCompressionMethod = mapMethod "canonize" []
 
+-- |Return representation of compression method saved in archive (CELS methods have no compression-only parameters)
+purifyCompressionMethod :: Method -> Method
+purifyCompressionMethod = canonizeCompressionMethod
+
 -- |Set memory used to compress/decompress, dictionary or block size of method given
 [setCompressionMem, setDecompressionMem, setDictionary, setBlockSize :: MemSize -> Method -> Method] =
   (flip map) (words "SetCompressionMem SetDecompressionMem SetDictionary SetBlockSize")
@@ -46,7 +46,7 @@ int BCJ_X86_METHOD::compress (CALLBACK_FUNC *callback, void *auxdata)
 }
 
 //   buf[MAX_METHOD_STRLEN] ,    (,   parse_BCJ_X86)
-void BCJ_X86_METHOD::ShowCompressionMethod (char *buf)
+void BCJ_X86_METHOD::ShowCompressionMethod (char *buf, bool purify)
 {
   sprintf (buf, "exe");
 }
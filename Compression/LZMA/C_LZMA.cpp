@@ -273,6 +273,7 @@ LZMA_METHOD::LZMA_METHOD()
   posStateBits      = 2;
   litContextBits    = 3;
   litPosBits        = 0;
+  large_pages       = LARGE_PAGES_DEFAULT;
 }
 
 //  
@@ -282,6 +283,8 @@ int LZMA_METHOD::decompress (CALLBACK_FUNC *callback, void *auxdata)
   static FARPROC f = LoadFromDLL ("lzma_decompress_____from_dll_is_too_slow_so_dont_use_it");
   if (!f) f = (FARPROC) lzma_decompress;
 
+  LargePagesScope large_pages_scope (large_pages);
+
   return ((int (*)(int, int, int, int, int, int, int, int, int, CALLBACK_FUNC*, void*)) f)
                          (dictionarySize,
                           hashSize,
@@ -311,6 +314,7 @@ int LZMA_METHOD::compress (CALLBACK_FUNC *callback, void *auxdata)
   //   wall clock time   
   if ((algorithm || matchFinder!=kHC4) && GetCompressionThreads()>1)
       addtime = -1;   //     wall clock time
+  LargePagesScope large_pages_scope (large_pages);
   return ((int (*)(int, int, int, int, int, int, int, int, int, CALLBACK_FUNC*, void*)) f)
                          (dictionarySize,
                           hashSize,
@@ -327,9 +331,9 @@ int LZMA_METHOD::compress (CALLBACK_FUNC *callback, void *auxdata)
 
 
 //   buf[MAX_METHOD_STRLEN] ,       (,   parse_LZMA)
-void LZMA_METHOD::ShowCompressionMethod (char *buf)
+void LZMA_METHOD::ShowCompressionMethod (char *buf, bool purify)
 {
-  char DictionaryStr[100], HashStr[100], fcStr[100], pbStr[100], lcStr[100], lpStr[100], algStr[100];
+  char DictionaryStr[100], HashStr[100], fcStr[100], pbStr[100], lcStr[100], lpStr[100], algStr[100], LargePagesStr[100];
   showMem (dictionarySize, DictionaryStr);
   showMem (hashSize, HashStr);
   LZMA_METHOD defaults;
@@ -337,11 +341,12 @@ void LZMA_METHOD::ShowCompressionMethod (char *buf)
   sprintf (pbStr, posStateBits     !=defaults.posStateBits     ? ":pb%d" : "", posStateBits);
   sprintf (lcStr, litContextBits   !=defaults.litContextBits   ? ":lc%d" : "", litContextBits);
   sprintf (lpStr, litPosBits       !=defaults.litPosBits       ? ":lp%d" : "", litPosBits);
+  sprintf (LargePagesStr, large_pages != defaults.large_pages && !purify? ":large%d" : "", large_pages);
   matchFinder==kHT4? (algorithm==2? sprintf (algStr, "a%d", algorithm)
                                   : sprintf (algStr, algorithm==0? "fast" : "normal"))
                    : sprintf (algStr, "%s:%s", algorithm==0? "fast": algorithm==1? "normal": "max", kMatchFinderIDs [matchFinder]);
   for (char *p=algStr; *p; p++)   *p = tolower(*p);  // strlwr(algStr);
-  sprintf (buf, "lzma:%s%s%s:%s:%d%s%s%s%s",
+  sprintf (buf, "lzma:%s%s%s:%s:%d%s%s%s%s%s",
                       DictionaryStr,
                       hashSize? ":h" : "",
                       hashSize? HashStr : "",
@@ -350,7 +355,8 @@ void LZMA_METHOD::ShowCompressionMethod (char *buf)
                       fcStr,
                       pbStr,
                       lcStr,
-                      lpStr);
+                      lpStr,
+                      LargePagesStr);
   //printf("\n%s\n",buf);
 }
 
@@ -454,6 +460,8 @@ COMPRESSION_METHOD* parse_LZMA (char** parameters)
       else if (start_from (param, "lc"))   p->litContextBits    = parseInt (param+2, &error);
       else if (start_from (param, "lp"))   p->litPosBits        = parseInt (param+2, &error);
       else if (start_from (param, "pb"))   p->posStateBits      = parseInt (param+2, &error);
+      else if (start_from (param, "large")) {p->large_pages      = parseInt (param+5, &error);
+                                           if (p->large_pages >= LARGE_PAGES_MODES)  error=1;}
       else if (start_from (param, "mf"))   p->matchFinder       = FindMatchFinder (param[2]=='='? param+3 : param+2);
       else if (strequ (param, "fastest"))  p->algorithm = 0,  p->matchFinder==INT_MAX && (p->matchFinder = kHT4),  p->numFastBytes = 32,   p->matchFinderCycles = 1;
       else if (strequ (param, "fast"))     p->algorithm = 0,  p->matchFinder==INT_MAX && (p->matchFinder = kHT4),  p->numFastBytes = 32,   p->matchFinderCycles = 0;
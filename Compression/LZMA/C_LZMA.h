@@ -41,6 +41,7 @@ public:
   int     posStateBits;
   int     litContextBits;
   int     litPosBits;
+  int     large_pages;        //       match finder' (LARGE_PAGES_DEFAULT -    )
 
   // ,       
   LZMA_METHOD();
@@ -51,7 +52,7 @@ public:
   virtual int compress (CALLBACK_FUNC *callback, void *auxdata);
 
   //   buf[MAX_METHOD_STRLEN] ,       (,   parse_LZMA)
-  virtual void ShowCompressionMethod (char *buf);
+  virtual void ShowCompressionMethod (char *buf, bool purify);
 
   // /  ,   /,     
   virtual MemSize GetCompressionMem     (void);
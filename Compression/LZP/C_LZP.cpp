@@ -8,6 +8,8 @@
 extern "C" {
 #include "C_LZP.h"
 }
+#include "../SIMD.h"
+#include "../MultiThreading.h"
 
 
 /* 32-bit Rotates */
@@ -56,7 +58,7 @@ static inline UINT  lzpH(UINT c,BYTE* p,int HashMask) {
 #define LZP_INIT(HashSize,Pattern)                                               \
     UINT i, k, n1=1, n=1, HashMask=HashSize-1;                                   \
     BYTE *p, *InEnd=In+Size, *OutStart=Out;                                      \
-    BYTE **HTable = (BYTE**) BigAlloc (HashSize * sizeof(BYTE*));                  \
+    BYTE **HTable = (BYTE**) PoolAlloc (HashSize * sizeof(BYTE*));                  \
     if (HTable==NULL)  return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;                 \
     for (i=0;i < HashSize;i++)              HTable[i]=Pattern+5;                 \
     lzpC(Out+4)=lzpC(In+4);                 lzpC(Out+8)=lzpC(In+8);              \
@@ -72,10 +74,7 @@ int LZPEncode(BYTE* In,UINT Size,BYTE* Out,int MinLen,int HashSize,int Barrier,i
         if ( !--n )  { HTable[k]=In;        n=n1; }
         if (i != lzpC(p))                   *Out++ = *In++;
         else if ((ml = In-p>Barrier? SmallestLen:MinLen), (In+ml <= InEnd && lzpC(p+ml) == lzpC(In+ml))) {
-            for (i=4;In+i <= InEnd && lzpC(p+i) == lzpC(In+i);i += 4)
-                    ;
-            for (i -= 4;In+i < InEnd && In[i] == p[i];i++)
-                    ;
+            i = match_len (In, p, InEnd-In);
             if (i < ml)                     goto MATCH_NOT_FOUND;
             HTable[k]=In;                   n1 += (In-p > (n1+1)*HashSize && n1 < 7);
             *Out++ = LZP_MATCH_FLAG;        In += (k=i);
@@ -90,7 +89,7 @@ MATCH_NOT_FOUND:
         }
         k=lzpH(i=lzpC(In),In,HashMask);
     } while (In<InEnd && Out<OutEnd);
-    BigFree(HTable);
+    PoolFree(HTable);
     if (Out >= OutEnd)       return 0;
     memmove(Out,OutEnd,OutStart+Size-OutEnd);
     return Size-(OutEnd-Out);
@@ -117,7 +116,7 @@ int LZPDecode(BYTE* In,UINT Size,BYTE* Out,int MinLen,int HashSize,int Barrier,i
         }
         k=lzpH(i=lzpC(Out),Out,HashMask);
     } while (In < InEnd);
-    BigFree(HTable);
+    PoolFree(HTable);
     return (Out-OutStart);
 }
 
@@ -127,73 +126,178 @@ int LZPDecode(BYTE* In,UINT Size,BYTE* Out,int MinLen,int HashSize,int Barrier,i
 /*  /,  callbacks  /     */
 /*-------------------------------------------------------------------------*/
 
+//     /:      ,  ()
+MemSize lzp_mt_mem (MemSize BlockSize, int HashSizeLog)
+{
+    int threads = GetCompressionThreads(),  jobs = threads + threads/2 + 1;
+    return jobs * BlockSize*2  +  threads * ((1<<HashSizeLog) * sizeof(BYTE*));
+}
+
 #ifndef FREEARC_DECOMPRESS_ONLY
-int lzp_compress (MemSize BlockSize, int MinCompression, int MinMatchLen, int HashSizeLog, int Barrier, int SmallestLen, CALLBACK_FUNC *callback, void *auxdata)
+struct LZPMTCompressor;
+
+//   :      OutBuf    
+struct LZPCompressionThread : WorkerThread
+{
+    LZPMTCompressor* compressor;
+    int init();
+    int process();
+    int done();
+};
+
+//  :   BlockSize      
+struct LZPMTCompressor : MTCompressor<LZPCompressionThread>
 {
-    int errcode = FREEARC_OK;   // Error code returned by last operation or FREEARC_OK
-    BYTE* In = NULL;  //    
-    BYTE* Out= NULL;  //    
-    while (1)
+    MemSize BlockSize;
+    int MinCompression, MinMatchLen, HashSizeLog, Barrier, SmallestLen;
+
+    LZPMTCompressor (MemSize BlockSize, int MinCompression, int MinMatchLen, int HashSizeLog, int Barrier, int SmallestLen, CALLBACK_FUNC *callback, void *auxdata)
     {
-        int InSize, OutSize;     //       , 
-        BIGALLOC (BYTE, In, BlockSize+2);
-    	READ_LEN_OR_EOF (InSize, In, BlockSize);
-        //In = (BYTE*) realloc(In,InSize);   -- impossible since we used BigAlloc
-        BIGALLOC (BYTE, Out, InSize+2);
-        OutSize = LZPEncode (In, InSize, Out, MinMatchLen, 1<<HashSizeLog, Barrier, SmallestLen);
-        if (OutSize<0)  {errcode=OutSize; goto finished;}
-        if (OutSize==0 || MinCompression>0 && OutSize/MinCompression>=InSize/100) {
-            //   [ ]  ,     
-            BigFreeAndNil(Out);
-            WRITE4 (-InSize);      //       -  Stored 
-            WRITE  (In, InSize);
-            BigFreeAndNil(In);
-        } else {
-            //   ,        
-            // (          )
-            BigFreeAndNil(In);
-            WRITE4 (OutSize);
-            WRITE  (Out, OutSize);
-            BigFreeAndNil(Out);
+        this->BlockSize      = BlockSize;
+        this->MinCompression = MinCompression;
+        this->MinMatchLen    = MinMatchLen;
+        this->HashSizeLog    = HashSizeLog;
+        this->Barrier        = Barrier;
+        this->SmallestLen    = SmallestLen;
+        this->callback       = callback;
+        this->auxdata        = auxdata;
+    }
+
+    int main_cycle()
+    {
+        LZPCompressionThread *job = FreeJobs.Get();   // Acquire first compression job
+        while ( (job->InSize = callback ("read", job->InBuf, BlockSize, auxdata)) > 0 )
+        {
+            if (errcode < 0)  return 0;               // Error in other thread
+            WriterJobs.Put(job);
+            job->StartOperation.Signal();
+            job = FreeJobs.Get();                     // Acquire next compression job
         }
+        return job->InSize;                           // 0 at the end of data or errcode
     }
-finished:
-    BigFreeAndNil(In); BigFreeAndNil(Out);
-    return errcode;
+};
+
+int LZPCompressionThread::init()                      // Alloc resources
+{
+    compressor = (LZPMTCompressor*) task;
+    InBuf  = (char*) PoolAlloc (compressor->BlockSize+2);
+    OutBuf = (char*) PoolAlloc (compressor->BlockSize+2+sizeof(int32));
+    return (InBuf && OutBuf? 0 : FREEARC_ERRCODE_NOT_ENOUGH_MEMORY);
+}
+
+int LZPCompressionThread::process()                   // Compress one block
+{
+    LZPMTCompressor *c = compressor;
+    BYTE *Out = (BYTE*) OutBuf + sizeof(int32);
+    int OutSize = LZPEncode ((BYTE*)InBuf, InSize, Out, c->MinMatchLen, 1<<c->HashSizeLog, c->Barrier, c->SmallestLen);
+    if (OutSize<0)  return OutSize;
+    if (OutSize==0 || c->MinCompression>0 && OutSize/c->MinCompression>=InSize/100) {
+        //   [ ]  ,     
+        setvalue32 (OutBuf, -InSize);      //       -  Stored 
+        memcpy (Out, InBuf, InSize);
+        return sizeof(int32)+InSize;
+    }
+    setvalue32 (OutBuf, OutSize);
+    return sizeof(int32)+OutSize;
+}
+
+int LZPCompressionThread::done()                      // Free resources
+{
+    PoolFree(OutBuf);  OutBuf = NULL;
+    PoolFree(InBuf);   InBuf  = NULL;
+    return 0;
+}
+
+int lzp_compress (MemSize BlockSize, int MinCompression, int MinMatchLen, int HashSizeLog, int Barrier, int SmallestLen, CALLBACK_FUNC *callback, void *auxdata)
+{
+    PoolScope pool;
+    LZPMTCompressor lzp (BlockSize, MinCompression, MinMatchLen, HashSizeLog, Barrier, SmallestLen, callback, auxdata);
+    return lzp.run();
 }
 #endif  // !defined (FREEARC_DECOMPRESS_ONLY)
 
 
-int lzp_decompress (MemSize BlockSize, int MinCompression, int MinMatchLen, int HashSizeLog, int Barrier, int SmallestLen, CALLBACK_FUNC *callback, void *auxdata)
+struct LZPMTDecompressor;
+
+//   :     OutBuf
+struct LZPDecompressionThread : WorkerThread
 {
-    int errcode = FREEARC_OK;   // Error code returned by last operation or FREEARC_OK
-    BYTE* In = NULL;  //    
-    BYTE* Out= NULL;  //    
-    for(;;) {
-        int InSize, OutSize;     //       , 
-        READ4_OR_EOF (InSize);
-        if (InSize<0) {
-            //   
-            InSize = -InSize;
-            BIGALLOC (BYTE, In, InSize);
-            READ  (In, InSize);
-            WRITE (In, InSize);
-            BigFreeAndNil(In);
-        } else {
-            //       
-            BIGALLOC (BYTE, In,  InSize);
-            BIGALLOC (BYTE, Out, BlockSize);
-            READ  (In, InSize);
-            OutSize = LZPDecode (In, InSize, Out, MinMatchLen, 1<<HashSizeLog, Barrier, SmallestLen);
-            BigFreeAndNil(In);
-            //Out = (BYTE*) realloc (Out, OutSize);   -- impossible since we used BigAlloc
-            WRITE (Out, OutSize);
-            BigFreeAndNil(Out);
-        }
+    LZPMTDecompressor* decompressor;
+    bool stored;      //     
+    int init();
+    int process();
+    int done();
+};
+
+//  :     ,   Writer    
+struct LZPMTDecompressor : MTCompressor<LZPDecompressionThread>
+{
+    MemSize BlockSize;
+    int MinMatchLen, HashSizeLog, Barrier, SmallestLen;
+
+    LZPMTDecompressor (MemSize BlockSize, int MinMatchLen, int HashSizeLog, int Barrier, int SmallestLen, CALLBACK_FUNC *callback, void *auxdata)
+    {
+        this->BlockSize   = BlockSize;
+        this->MinMatchLen = MinMatchLen;
+        this->HashSizeLog = HashSizeLog;
+        this->Barrier     = Barrier;
+        this->SmallestLen = SmallestLen;
+        this->callback    = callback;
+        this->auxdata     = auxdata;
     }
+
+    int main_cycle()
+    {
+        int errcode = FREEARC_OK;
+        for(;;)
+        {
+            //  :  ,    
+            int InSize;  READ4_OR_EOF (InSize);
+            bool stored = (InSize<0);
+            if (stored)  InSize = -InSize;
+            if (InSize<=0 || InSize>BlockSize)  return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+
+            LZPDecompressionThread *job = FreeJobs.Get();   // Acquire next decompression job
+            if (this->errcode < 0)  return 0;                // Error in other thread
+            READ (job->InBuf, InSize);
+            job->InSize = InSize;
+            job->stored = stored;
+            WriterJobs.Put(job);
+            job->StartOperation.Signal();
+        }
 finished:
-    BigFreeAndNil(In); BigFreeAndNil(Out);
-    return errcode;
+        return errcode;
+    }
+};
+
+int LZPDecompressionThread::init()                    // Alloc resources
+{
+    decompressor = (LZPMTDecompressor*) task;
+    InBuf  = (char*) PoolAlloc (decompressor->BlockSize);
+    OutBuf = (char*) PoolAlloc (decompressor->BlockSize);
+    return (InBuf && OutBuf? 0 : FREEARC_ERRCODE_NOT_ENOUGH_MEMORY);
+}
+
+int LZPDecompressionThread::process()                 // Decompress one block
+{
+    //  :   ,     
+    if (stored)  {char *tmp = InBuf;  InBuf = OutBuf;  OutBuf = tmp;  return InSize;}
+    LZPMTDecompressor *d = decompressor;
+    return LZPDecode ((BYTE*)InBuf, InSize, (BYTE*)OutBuf, d->MinMatchLen, 1<<d->HashSizeLog, d->Barrier, d->SmallestLen);
+}
+
+int LZPDecompressionThread::done()                    // Free resources
+{
+    PoolFree(OutBuf);  OutBuf = NULL;
+    PoolFree(InBuf);   InBuf  = NULL;
+    return 0;
+}
+
+int lzp_decompress (MemSize BlockSize, int MinCompression, int MinMatchLen, int HashSizeLog, int Barrier, int SmallestLen, CALLBACK_FUNC *callback, void *auxdata)
+{
+    PoolScope pool;
+    LZPMTDecompressor lzp (BlockSize, MinMatchLen, HashSizeLog, Barrier, SmallestLen, callback, auxdata);
+    return lzp.run();
 }
 
 
@@ -246,7 +350,7 @@ void LZP_METHOD::SetBlockSize (MemSize bs)
 }
 
 //   buf[MAX_METHOD_STRLEN] ,       (,   parse_LZP)
-void LZP_METHOD::ShowCompressionMethod (char *buf)
+void LZP_METHOD::ShowCompressionMethod (char *buf, bool purify)
 {
     LZP_METHOD defaults; char BlockSizeStr[100], MinCompressionStr[100], BarrierTempStr[100], BarrierStr[100], SmallestLenStr[100];
     showMem (BlockSize, BlockSizeStr);
@@ -260,14 +364,16 @@ void LZP_METHOD::ShowCompressionMethod (char *buf)
 //   ,       
 void LZP_METHOD::SetCompressionMem (MemSize mem)
 {
+  //      (. lzp_mt_mem):    ,     -  
+  int threads = GetCompressionThreads(),  jobs = threads + threads/2 + 1;
   MemSize hashsize = (1<<HashSizeLog) * sizeof(BYTE*);
   //       -   .    
-  if (hashsize > mem/4) {
-    HashSizeLog = lb(mem/16);
+  if (hashsize > mem/threads/4) {
+    HashSizeLog = lb(mem/threads/16);
     if (GetCompressionMem() <= mem)  return;
     hashsize = (1<<HashSizeLog) * sizeof(BYTE*);
   }
-  SetBlockSize ((mem-hashsize)/2);
+  SetBlockSize ((mem-hashsize*threads)/2/jobs);
 }
 
 
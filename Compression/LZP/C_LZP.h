@@ -2,6 +2,7 @@
 
 int lzp_compress   (MemSize BlockSize, int MinCompression, int MinMatchLen, int HashSizeLog, int Barrier, int SmallestLen, CALLBACK_FUNC *callback, void *auxdata);
 int lzp_decompress (MemSize BlockSize, int MinCompression, int MinMatchLen, int HashSizeLog, int Barrier, int SmallestLen, CALLBACK_FUNC *callback, void *auxdata);
+MemSize lzp_mt_mem (MemSize BlockSize, int HashSizeLog);   //     /
 
 
 #ifdef __cplusplus
@@ -33,10 +34,10 @@ public:
   virtual int compress   (CALLBACK_FUNC *callback, void *auxdata);
 
   //   buf[MAX_METHOD_STRLEN] ,       (,   parse_LZP)
-  virtual void ShowCompressionMethod (char *buf);
+  virtual void ShowCompressionMethod (char *buf, bool purify);
 
   // /  ,   /,     
-  virtual MemSize GetCompressionMem     (void)         {return BlockSize*2 + (1<<HashSizeLog)*sizeof(BYTE*);}
+  virtual MemSize GetCompressionMem     (void)         {return lzp_mt_mem (BlockSize, HashSizeLog);}
   virtual MemSize GetDictionary         (void)         {return BlockSize;}
   virtual MemSize GetBlockSize          (void)         {return BlockSize;}
   virtual void    SetCompressionMem     (MemSize mem);
@@ -44,7 +45,7 @@ public:
   virtual void    SetDictionary         (MemSize dict) {SetBlockSize (dict);}
   virtual void    SetBlockSize          (MemSize bs);
 #endif
-  virtual MemSize GetDecompressionMem   (void)         {return BlockSize*2 + (1<<HashSizeLog)*sizeof(BYTE*);}
+  virtual MemSize GetDecompressionMem   (void)         {return lzp_mt_mem (BlockSize, HashSizeLog);}
 };
 
 //     LZP
@@ -36,7 +36,7 @@ int MM_METHOD::compress (CALLBACK_FUNC *callback, void *auxdata)
 }
 
 //   buf[MAX_METHOD_STRLEN] ,       (,   parse_MM)
-void MM_METHOD::ShowCompressionMethod (char *buf)
+void MM_METHOD::ShowCompressionMethod (char *buf, bool purify)
 {
     MM_METHOD defaults;
     char dStr[100], cStr[100], rStr[100];
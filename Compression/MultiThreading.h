@@ -1,3 +1,6 @@
+#ifndef FREEARC_MULTITHREADING_H
+#define FREEARC_MULTITHREADING_H
+
 #include "LZMA/Windows/Thread.h"
 #include "LZMA/Windows/Synchronization.h"
 
@@ -107,13 +110,15 @@ struct WorkerThread
     char*  OutBuf;                    // Buffer pointing to output (processed) data
     volatile int InSize;              // Amount of data in inbuf
     volatile int OutSize;             // Amount of data in outbuf
+    int    LargePages;                // Large pages policy inherited from the thread that created this job
 
     virtual int  init()        {return 0;}    // Initialize job
     virtual int  process()     {return 0;}    // Perform one operation
-    virtual int  after_write() {return 0;}    // Cleanup after processed data was written
+    virtual int  after_write() {return 0;}    // Cleanup after processed data was written (or skipped due to error)
     virtual int  done()        {return 0;}    // Final cleanup
     virtual void run()                        // Thread function performing process() on each input block
     {
+        SetLargePages (LargePages);
         for(;;)
         {
             StartOperation.Lock();                    // wait for data to process
@@ -180,12 +185,14 @@ void MTCompressor<Job>::WriterThread()
             break;
         // Wait until (de)compression will be finished
         job->OperationFinished.Lock();
-        //     ,     /   
-        if (SetErrCode(callback("write", job->OutBuf, job->OutSize, auxdata)) < 0)
-            break;
-        // After-write cleanup
-        if (SetErrCode(job->after_write()) < 0)
-            break;
+        // Write processed block unless it or previous one failed or no more data are required.
+        // After error, jobs are still returned to FreeJobs, so main_cycle() can't hang in FreeJobs.Get()
+        if (job->OutSize < 0)
+            SetErrCode(job->OutSize);
+        else if (errcode == 0)
+            SetErrCode(callback("write", job->OutBuf, job->OutSize, auxdata));
+        // After-write cleanup, performed even for skipped blocks since it may free job buffers
+        SetErrCode(job->after_write());
         // Make thread available for next compression job
         FreeJobs.Put(job);
     }
@@ -221,6 +228,7 @@ void MTCompressor<Job>::CreateJobs ()
     {
         Job *job = &jobs[i];
         job->task = this;
+        job->LargePages = GetLargePages();
         if (job->init() >= 0)
         {
             threads++;
@@ -236,3 +244,294 @@ void MTCompressor<Job>::CreateJobs ()
     if (threads==0)  SetErrCode (FREEARC_ERRCODE_NOT_ENOUGH_MEMORY);   ////
 }
 
+
+// *************************************************************************************************
+// *** Helper threads joining a single job *********************************************************
+// *************************************************************************************************
+
+// When there are fewer blocks than compression threads, a single block may be processed by several
+// threads. Such job is split into many small work items (f.e. buckets to sort): each thread calls
+// work(), which takes items one by one until none are left, so faster threads take more items.
+
+// Job that can be performed by several threads simultaneously
+struct ParallelJob
+{
+    Mutex  mutex;                     // Protects job state; work() may use it to take items
+    bool   open;                      // Job is running, so helpers may join it
+    int    active;                    // Helper threads currently executing work()
+    int    queued;                    // Copies of this job waiting in the HelperThreads queue
+    Event  HelpersDone;               // Signals that last helper has left the closed job
+
+    ParallelJob(): open(FALSE), active(0), queued(0)  {}
+    virtual void work() = 0;          // Perform work items until none are left
+    virtual ~ParallelJob() {};
+};
+
+// Pool of threads joining ParallelJobs started by other threads. Job objects should live until stop(),
+// since stale copies of a finished job may remain in the queue
+struct HelperThreads
+{
+    SyncQueue<ParallelJob*> Queue;    // Jobs waiting for helpers (NULL stops one thread)
+    CThread         *threads;
+    int              NumThreads;
+
+    HelperThreads(): threads(NULL), NumThreads(0)  {}
+    ~HelperThreads()  {stop();}
+
+    void start (int num_threads, int max_jobs);  // Start threads that will serve up to max_jobs job objects
+    void stop();                                 // Finish all threads
+    void run (ParallelJob *job, int helpers);    // Perform job in the current thread, allowing up to `helpers` threads to join
+    void HelperThread();
+};
+
+static DWORD WINAPI RunHelperThread (void *param)  {((HelperThreads*) param) -> HelperThread();  return 0;}
+
+inline void HelperThreads::start (int num_threads, int max_jobs)
+{
+    Queue.SetSize (max_jobs*num_threads + num_threads);    // each job has at most num_threads copies queued, plus NULLs
+    threads = new CThread[num_threads];
+    for (NumThreads=0; NumThreads < num_threads; NumThreads++)
+        threads[NumThreads].Create (RunHelperThread, this);
+}
+
+inline void HelperThreads::stop()
+{
+    for (int i=0; i < NumThreads; i++)  Queue.Put(NULL);
+    for (int i=0; i < NumThreads; i++)  threads[i].Wait();
+    delete [] threads;  threads = NULL;  NumThreads = 0;
+}
+
+inline void HelperThreads::run (ParallelJob *job, int helpers)
+{
+    {
+        Lock _(job->mutex);
+        job->open = TRUE;
+        helpers = mymin (helpers, NumThreads) - job->queued;   // copies left in the queue by previous run() will join too
+        if (helpers > 0)  job->queued += helpers;
+    }
+    for (int i=0; i < helpers; i++)
+        Queue.Put(job);
+
+    job->work();
+
+    bool wait;
+    {
+        Lock _(job->mutex);
+        job->open = FALSE;
+        wait = (job->active > 0);
+    }
+    if (wait)  job->HelpersDone.Lock();
+}
+
+inline void HelperThreads::HelperThread()
+{
+    while (ParallelJob *job = Queue.Get())
+    {
+        {
+            Lock _(job->mutex);
+            job->queued--;
+            if (!job->open)  continue;
+            job->active++;
+        }
+        job->work();
+        {
+            Lock _(job->mutex);
+            if (--job->active == 0  &&  !job->open)
+                job->HelpersDone.Signal();
+        }
+    }
+}
+
+
+// *************************************************************************************************
+// *** Read-ahead and write-behind for sequential decompressors ************************************
+// *************************************************************************************************
+
+// Decompressors like REP process blocks strictly one after another, so they can't be split into
+// MTCompressor jobs, but their I/O still can be overlapped with decompression. OverlappedIO runs
+// the original callback in two extra threads: Reader thread fetches the next compressed block while
+// the current one is decompressed, and Writer thread saves decompressed data. Decompressor code stays
+// the same, it just calls OverlappedIO::Callback instead of the original callback.
+
+// Buffer holding one block of input or output data
+struct IOBuffer
+{
+    char *buf;                        // Buffer contents
+    int   size;                       // Amount of data in buffer
+    int   allocated;                  // Buffer size
+    int   pos;                        // Amount of data already consumed by decompressor
+    int   status;                     // read_block() result for this block
+
+    IOBuffer(): buf(NULL), size(0), allocated(0), pos(0), status(0) {}
+    ~IOBuffer()  {BigFree(buf);}
+
+    // Make room for n more bytes
+    bool reserve (int n)
+    {
+        if (size+n <= allocated)  return TRUE;
+        int newsize = mymax (size+n, allocated*2);
+        char *newbuf = (char*) BigAlloc (newsize);
+        if (newbuf==NULL)  return FALSE;
+        memcpy (newbuf, buf, size);
+        BigFree (buf);  buf = newbuf;  allocated = newsize;
+        return TRUE;
+    }
+
+    // Append up to n bytes from the input stream, return amount of bytes read or errcode
+    int read (int n, CALLBACK_FUNC *callback, void *auxdata)
+    {
+        if (n<0 || !reserve(n))  return n<0? FREEARC_ERRCODE_BAD_COMPRESSED_DATA : FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
+        int len = n? callback ("read", buf+size, n, auxdata) : 0;
+        if (len>0)  size += len;
+        return len;
+    }
+};
+
+// Reads into buf exactly the data that decompressor will request for its next block.
+// Returns 1 if more blocks may follow, 0 at the end of input, or errcode
+typedef int READ_BLOCK_FUNC (IOBuffer *buf, CALLBACK_FUNC *callback, void *auxdata);
+
+const int OVERLAPPED_BUFFERS     = 2;                    // Number of input and output buffers (double buffering)
+const int OVERLAPPED_WRITE_CHUNK = HUGE_BUFFER_SIZE;     // Size of each output buffer
+
+// Memory used by OverlappedIO buffers when input blocks are up to InBlockSize bytes
+inline MemSize OverlappedIOMem (MemSize InBlockSize)  {return OVERLAPPED_BUFFERS * (OVERLAPPED_WRITE_CHUNK + InBlockSize);}
+
+struct OverlappedIO
+{
+    CALLBACK_FUNC   *callback;        // Original I/O callback
+    void            *auxdata;         // and its additional parameter
+    READ_BLOCK_FUNC *read_block;      // Function reading one input block
+    bool             started;         // Reader and Writer threads are running
+    volatile int     werrcode;        // Error code of Writer thread or 0
+    IOBuffer         inbuf[OVERLAPPED_BUFFERS], outbuf[OVERLAPPED_BUFFERS];
+    IOBuffer        *in, *out;        // Buffers currently used by decompressor
+    SyncQueue<IOBuffer*> FreeIn, FilledIn, FreeOut, FilledOut;
+    CThread          Reader, Writer;
+
+    OverlappedIO(): started(FALSE), werrcode(0), in(NULL), out(NULL)  {}
+
+    bool start (READ_BLOCK_FUNC *read_block, CALLBACK_FUNC *callback, void *auxdata);  // Start I/O threads; FALSE means that original callback should be used
+    int  finish (int errcode);        // Flush output and stop I/O threads; returns final errcode of decompression
+    int  read  (char *data, int size);
+    int  write (char *data, int size);
+    void flush();                     // Wait until all output data are written
+
+    void ReaderThread();
+    void WriterThread();
+    static int Callback (const char *what, void *data, int size, void *auxdata);   // I/O callback that should be passed to decompressor
+};
+
+static DWORD WINAPI RunOverlappedReader (void *param)  {((OverlappedIO*) param) -> ReaderThread();  return 0;}
+static DWORD WINAPI RunOverlappedWriter (void *param)  {((OverlappedIO*) param) -> WriterThread();  return 0;}
+
+inline bool OverlappedIO::start (READ_BLOCK_FUNC *_read_block, CALLBACK_FUNC *_callback, void *_auxdata)
+{
+    read_block = _read_block,  callback = _callback,  auxdata = _auxdata;
+    FreeIn.SetSize (OVERLAPPED_BUFFERS+1);  FilledIn. SetSize (OVERLAPPED_BUFFERS);     // +1 for NULL job that stops the thread
+    FreeOut.SetSize(OVERLAPPED_BUFFERS);    FilledOut.SetSize (OVERLAPPED_BUFFERS+1);
+    for (int i=0; i<OVERLAPPED_BUFFERS; i++)
+    {
+        if (!outbuf[i].reserve (OVERLAPPED_WRITE_CHUNK))  return FALSE;
+        FreeIn.Put (&inbuf[i]);  FreeOut.Put (&outbuf[i]);
+    }
+    // Writer is started first since it doesn't touch the input stream
+    if (!Writer.Create (RunOverlappedWriter, this))  return FALSE;
+    if (!Reader.Create (RunOverlappedReader, this))  {FilledOut.Put(NULL);  Writer.Wait();  return FALSE;}
+    return started = TRUE;
+}
+
+inline int OverlappedIO::finish (int errcode)
+{
+    if (!started)  return errcode;
+    if (errcode >= 0)  {flush();  if (werrcode<0)  errcode = werrcode;}
+    else               werrcode = errcode;      // don't write remaining data after an error
+    FilledOut.Put(NULL);  Writer.Wait();
+    FreeIn.Put(NULL);     Reader.Wait();
+    started = FALSE;
+    return errcode;
+}
+
+inline void OverlappedIO::ReaderThread()
+{
+    for(;;)
+    {
+        IOBuffer *b = FreeIn.Get();
+        if (b==NULL)  break;                    // decompression finished
+        b->size = b->pos = 0;
+        b->status = read_block (b, callback, auxdata);
+        FilledIn.Put(b);
+        if (b->status <= 0)  break;             // end of input or error
+    }
+}
+
+inline void OverlappedIO::WriterThread()
+{
+    for(;;)
+    {
+        IOBuffer *b = FilledOut.Get();
+        if (b==NULL)  break;
+        if (werrcode==0 && b->size>0)
+        {
+            int x = callback ("write", b->buf, b->size, auxdata);
+            if (x<0)  werrcode = x;
+        }
+        FreeOut.Put(b);
+    }
+}
+
+// Return data prefetched by Reader thread. After the last block, return 0 (EOF) or the read error
+inline int OverlappedIO::read (char *data, int size)
+{
+    int done = 0;
+    while (done < size)
+    {
+        if (in==NULL  ||  in->pos == in->size)
+        {
+            if (in  &&  in->status <= 0)  return done? done : in->status;
+            if (in)  FreeIn.Put(in);
+            in = FilledIn.Get();
+            continue;
+        }
+        int n = mymin (size-done, in->size - in->pos);
+        memcpy (data+done, in->buf + in->pos, n);
+        in->pos += n,  done += n;
+    }
+    return done;
+}
+
+// Copy data to output buffer, passing full buffers to Writer thread
+inline int OverlappedIO::write (char *data, int size)
+{
+    for (int done=0; done < size; )
+    {
+        if (werrcode<0)  return werrcode;
+        if (out==NULL)   {out = FreeOut.Get();  out->size = 0;}
+        int n = mymin (size-done, out->allocated - out->size);
+        memcpy (out->buf + out->size, data+done, n);
+        out->size += n,  done += n;
+        if (out->size == out->allocated)  {FilledOut.Put(out);  out = NULL;}
+    }
+    return werrcode<0? werrcode : size;
+}
+
+inline void OverlappedIO::flush()
+{
+    if (out)  {FilledOut.Put(out);  out = NULL;}
+    IOBuffer *b[OVERLAPPED_BUFFERS];
+    for (int i=0; i<OVERLAPPED_BUFFERS; i++)  b[i] = FreeOut.Get();
+    for (int i=0; i<OVERLAPPED_BUFFERS; i++)  FreeOut.Put(b[i]);
+}
+
+// Other requests are passed to the original callback after all preceding output was written
+inline int OverlappedIO::Callback (const char *what, void *data, int size, void *auxdata)
+{
+    OverlappedIO *io = (OverlappedIO*) auxdata;
+    if (strequ (what, "read"))   return io->read  ((char*)data, size);
+    if (strequ (what, "write"))  return io->write ((char*)data, size);
+    io->flush();
+    return io->callback (what, data, size, io->auxdata);
+}
+
+#endif // FREEARC_MULTITHREADING_H
+
@@ -119,7 +119,7 @@ int PPMD_METHOD::compress (CALLBACK_FUNC *callback, void *auxdata)
 }
 
 //   buf[MAX_METHOD_STRLEN] ,       (,   parse_PPMD)
-void PPMD_METHOD::ShowCompressionMethod (char *buf)
+void PPMD_METHOD::ShowCompressionMethod (char *buf, bool purify)
 {
   char MemStr[100];
   showMem (mem, MemStr);
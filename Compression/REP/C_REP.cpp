@@ -5,6 +5,7 @@ extern "C" {
 
 #define REP_LIBRARY
 #include "rep.cpp"
+#include "dedup.cpp"
 
 /*-------------------------------------------------*/
 /*   REP_METHOD                    */
@@ -33,6 +34,19 @@ int REP_METHOD::decompress (CALLBACK_FUNC *callback, void *auxdata)
                           (BlockSize, MinCompression, MinMatchLen, Barrier, SmallestLen, HashSizeLog, Amplifier, callback, auxdata);
 }
 
+//  OverlappedIO,   :   
+//        (   MAX_READ )
+static MemSize RepIOMem (MemSize BlockSize)
+{
+  return OverlappedIOMem (mymin (BlockSize, MAX_READ));
+}
+
+//  ,   
+MemSize REP_METHOD::GetDecompressionMem (void)
+{
+  return BlockSize + RepIOMem(BlockSize);
+}
+
 #ifndef FREEARC_DECOMPRESS_ONLY
 
 //  
@@ -47,7 +61,7 @@ int REP_METHOD::compress (CALLBACK_FUNC *callback, void *auxdata)
 }
 
 //   buf[MAX_METHOD_STRLEN] ,       (,   parse_REP)
-void REP_METHOD::ShowCompressionMethod (char *buf)
+void REP_METHOD::ShowCompressionMethod (char *buf, bool purify)
 {
   REP_METHOD defaults; char BlockSizeStr[100], MinCompressionStr[100], BarrierTempStr[100], BarrierStr[100], SmallestLenStr[100], HashSizeLogStr[100], AmplifierStr[100], MinMatchLenStr[100];
   showMem (BlockSize, BlockSizeStr);
@@ -68,8 +82,18 @@ MemSize REP_METHOD::GetCompressionMem (void)
   int L = roundup_to_power_of (mymin(SmallestLen,MinMatchLen)/2, 2);  //  ,     
   int k = sqrtb(L*2);
   int HashSize = CalcHashSize (HashSizeLog, BlockSize, k);
+  int threads  = mymin (GetCompressionThreads(), MAX_REP_THREADS);
 
-  return BlockSize + HashSize*sizeof(int);
+  return BlockSize + HashSize*sizeof(int)
+       + RepSearchMem (mymin(BlockSize,MAX_READ), L, k, mymin(k*Amplifier,L), mymin(SmallestLen,MinMatchLen), threads)
+       + RepIOMem(BlockSize);       //  OverlappedIO   ,    
+}
+
+//    mem    ( )    OverlappedIO
+static MemSize RepMemWithoutIO (MemSize mem)
+{
+  MemSize io = RepIOMem(mem);
+  return mem > 2*io?  mem-io : mem/2;
 }
 
 // ,       
@@ -80,12 +104,19 @@ void REP_METHOD::SetCompressionMem (MemSize mem)
     //   rep_compress
     int L = roundup_to_power_of (mymin(SmallestLen,MinMatchLen)/2, 2);  //  ,     
     int k = sqrtb(L*2);
+    mem = RepMemWithoutIO (mem);
     int HashSize = CalcHashSize (HashSizeLog, mem/5*4, k);
 
     BlockSize = mem - HashSize*sizeof(int);
   }
 }
 
+//   ,   
+void REP_METHOD::SetDecompressionMem (MemSize mem)
+{
+  if (mem>0)   BlockSize = RepMemWithoutIO (mem);
+}
+
 #endif  // !defined (FREEARC_DECOMPRESS_ONLY)
 
 //    REP_METHOD    
@@ -131,3 +162,85 @@ COMPRESSION_METHOD* parse_REP (char** parameters)
 }
 
 static int REP_x = AddCompressionMethod (parse_REP);   //    REP
+
+
+/*-------------------------------------------------*/
+/*   DEDUP_METHOD                  */
+/*-------------------------------------------------*/
+
+// ,       
+DEDUP_METHOD::DEDUP_METHOD()
+{
+  ChunkSize = 64*kb;
+  strcpy (Name, "default");
+}
+
+//  
+int DEDUP_METHOD::decompress (CALLBACK_FUNC *callback, void *auxdata)
+{
+  return dedup_decompress (ChunkSize, Name, callback, auxdata);
+}
+
+//  ,    (       )
+MemSize DEDUP_METHOD::GetDecompressionMem (void)
+{
+  return DedupMaxChunk(ChunkSize);
+}
+
+#ifndef FREEARC_DECOMPRESS_ONLY
+
+//  
+int DEDUP_METHOD::compress (CALLBACK_FUNC *callback, void *auxdata)
+{
+  return dedup_compress (ChunkSize, Name, callback, auxdata);
+}
+
+//   buf[MAX_METHOD_STRLEN] ,       (,   parse_DEDUP)
+void DEDUP_METHOD::ShowCompressionMethod (char *buf, bool purify)
+{
+  DEDUP_METHOD defaults; char ChunkSizeStr[100], NameStr[300];
+  showMem (ChunkSize, ChunkSizeStr);
+  sprintf (NameStr, strequ(Name,defaults.Name)? "" : ":n%s", Name);
+  sprintf (buf, "dedup:%s%s", ChunkSizeStr, NameStr);
+}
+
+//  ,    (       )
+MemSize DEDUP_METHOD::GetCompressionMem (void)
+{
+  return DedupBufSize(ChunkSize) + DedupMaxChunk(ChunkSize);
+}
+
+#endif  // !defined (FREEARC_DECOMPRESS_ONLY)
+
+//    DEDUP_METHOD    
+//   NULL,          
+COMPRESSION_METHOD* parse_DEDUP (char** parameters)
+{
+  if (strcmp (parameters[0], "dedup") == 0) {
+    //    ( ) - "dedup",    
+
+    DEDUP_METHOD *p = new DEDUP_METHOD;
+    int error = 0;  //  ,      
+
+    //     (         )
+    while (*++parameters && !error)
+    {
+      char* param = *parameters;
+      if (*param == 'n') {                 //  :  , , '-'  '_',      
+        char *s = param+1;
+        for (; *s; s++)  if (!isalnum(*s) && *s!='-' && *s!='_')  error = 1;
+        if (param[1]=='\0' || s-param > sizeof(p->Name))  error = 1;
+        if (!error)  strcpy (p->Name, param+1);
+        continue;
+      }
+      if (*param == 'c')  param++;         //   ;    
+      p->ChunkSize = parseMem (param, &error);
+    }
+    if (p->ChunkSize < 4*kb  ||  p->ChunkSize > 64*mb)  error = 1;
+    if (error)  {delete p; return NULL;}  //     
+    return p;
+  } else
+    return NULL;   //    DEDUP
+}
+
+static int DEDUP_x = AddCompressionMethod (parse_DEDUP);   //    DEDUP
@@ -2,6 +2,8 @@
 
 int rep_compress   (MemSize BlockSize, int MinCompression, int MinMatchLen, int Barrier, int SmallestLen, int HashSizeLog, int Amplifier, CALLBACK_FUNC *callback, void *auxdata);
 int rep_decompress (MemSize BlockSize, int MinCompression, int MinMatchLen, int Barrier, int SmallestLen, int HashSizeLog, int Amplifier, CALLBACK_FUNC *callback, void *auxdata);
+int dedup_compress   (MemSize ChunkSize, char *Name, CALLBACK_FUNC *callback, void *auxdata);
+int dedup_decompress (MemSize ChunkSize, char *Name, CALLBACK_FUNC *callback, void *auxdata);
 
 
 #ifdef __cplusplus
@@ -28,21 +30,57 @@ public:
   virtual int compress   (CALLBACK_FUNC *callback, void *auxdata);
 
   //   buf[MAX_METHOD_STRLEN] ,       (,   parse_REP)
-  virtual void ShowCompressionMethod (char *buf);
+  virtual void ShowCompressionMethod (char *buf, bool purify);
 
   // /  ,   /,     
   virtual MemSize GetCompressionMem     (void);
   virtual MemSize GetDictionary         (void)         {return BlockSize;}
   virtual MemSize GetBlockSize          (void)         {return 0;}
   virtual void    SetCompressionMem     (MemSize mem);
-  virtual void    SetDecompressionMem   (MemSize mem)  {if (mem>0)   BlockSize = mem;}
+  virtual void    SetDecompressionMem   (MemSize mem);
   virtual void    SetDictionary         (MemSize dict) {if (dict>0)  BlockSize = dict;}
   virtual void    SetBlockSize          (MemSize bs)   {}
 #endif
-  virtual MemSize GetDecompressionMem   (void)         {return BlockSize;}
+  virtual MemSize GetDecompressionMem   (void);
 };
 
 //     REP
 COMPRESSION_METHOD* parse_REP (char** parameters);
 
+
+//  REP,   ,     ,    
+// (        ,   ,       - . dedup.cpp)
+class DEDUP_METHOD : public COMPRESSION_METHOD
+{
+public:
+  //    
+  MemSize ChunkSize;        //   .    ChunkSize/4  ChunkSize*4 
+  char    Name[256];        //  :  Name.dat/Name.idx   %FREEARC_DEDUP_DIR%
+
+  // ,       
+  DEDUP_METHOD();
+
+  //    
+  virtual int decompress (CALLBACK_FUNC *callback, void *auxdata);
+#ifndef FREEARC_DECOMPRESS_ONLY
+  virtual int compress   (CALLBACK_FUNC *callback, void *auxdata);
+
+  //   buf[MAX_METHOD_STRLEN] ,       (,   parse_DEDUP)
+  virtual void ShowCompressionMethod (char *buf, bool purify);
+
+  // /  ,   /,     
+  virtual MemSize GetCompressionMem     (void);
+  virtual MemSize GetDictionary         (void)         {return 0;}
+  virtual MemSize GetBlockSize          (void)         {return 0;}
+  virtual void    SetCompressionMem     (MemSize mem)  {}
+  virtual void    SetDecompressionMem   (MemSize mem)  {}
+  virtual void    SetDictionary         (MemSize dict) {}
+  virtual void    SetBlockSize          (MemSize bs)   {}
+#endif
+  virtual MemSize GetDecompressionMem   (void);
+};
+
+//     DEDUP
+COMPRESSION_METHOD* parse_DEDUP (char** parameters);
+
 #endif  // __cplusplus
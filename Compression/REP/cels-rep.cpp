@@ -1,4 +1,8 @@
 #include "../CELS.h"
+#include "../SIMD.h"
+#include "../LZMA/Windows/Thread.h"
+#define REP_SEARCH_THREADS 1
+#define REP_NO_OVERLAPPED_IO
 
 namespace CELS
 {
@@ -0,0 +1,640 @@
+// (c) Bulat Ziganshin <Bulat.Ziganshin@gmail.com>
+// DEDUP:       
+/*
+     REP  ,       - ,  
+      .        
+    (content-defined chunking),         
+    . ,    ,    ,  
+          .
+
+        <name>.dat ( -  )  <name>.idx
+    (-  ,   ),   <name>.lck, 
+       .     %FREEARC_DEDUP_DIR%,
+       -  ~/.freearc/dedup (%APPDATA%\FreeArc\dedup  Windows).
+     -  :        ,
+             .dat.
+
+        ,     .  
+         ,     
+        ,   .
+    ,   ,   : ,    , - ,
+     -  ,      ,    .
+       (callback "testing"  1)    - 
+            ,   .
+
+                
+      ,      ,     
+       . :       
+      dedup (, -       ),
+        .      ,  ,
+     ,       (. " "  ), 
+                .
+
+      :
+      : id  (8 )      (8 )
+      :    len          + len   -  ,     
+                 len|2^31     + 8     -      
+                              + 8     -   
+      0 -   
+     .dat:  DEDUP_DAT_HEADER ,   "len (4 ) + ".
+*/
+
+const uint32 DEDUP_DAT_SIGNATURE = 0x44444146;   // "FADD"
+const uint32 DEDUP_IDX_SIGNATURE = 0x49444146;   // "FADI"
+const uint32 DEDUP_VERSION       = 1;
+const int    DEDUP_DAT_HEADER    = 16;           // signature, version, id
+const int    DEDUP_RECORD_HEADER = 4;            //       .dat
+const uint32 DEDUP_REFERENCE     = 0x80000000;   //     
+const uint64 DEDUP_MIN_SLOTS     = 64*1024;      //   
+const int    DEDUP_READ          = 8*mb;         // .   ,   
+
+//       ChunkSize
+#define DedupMinChunk(ChunkSize)   ((ChunkSize)/4)
+#define DedupMaxChunk(ChunkSize)   ((ChunkSize)*4)
+#define DedupBufSize(ChunkSize)    mymax (DEDUP_READ, DedupMaxChunk(ChunkSize)*2)
+
+// / 64- 
+#define Put64(x)    {uint64 localValue = (x);  Put32 (uint32(localValue));  Put32 (uint32(localValue>>32));}
+#define READ8(var)  {uint32 localLo, localHi;  READ4 (localLo);  READ4 (localHi);  (var) = localLo + (uint64(localHi)<<32);}
+
+
+//      *****************************************************************
+
+//     gear-:  h = h*2 + gear[byte]   h    64 
+static struct DedupGearTable
+{
+    uint64 t[256];
+    DedupGearTable()
+    {
+        uint64 x = 0;
+        for (int i=0; i<256; i++) {
+            uint64 z = (x += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z>>30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z>>27)) * 0x94D049BB133111EBULL;
+            t[i] = z ^ (z>>31);
+        }
+    }
+} DedupGear;
+
+//     p[0..len):   ,     gear-.
+//        MaskS,   -   MaskL,
+//      (normalized chunking)
+static int dedup_cut (byte *p, int len, int MinChunk, int ChunkSize, int MaxChunk, uint64 MaskS, uint64 MaskL)
+{
+    if (len <= MinChunk)  return len;
+    if (len >  MaxChunk)  len = MaxChunk;
+    uint64 h = 0;
+    int i = mymax (MinChunk-64, 0),  normal = mymin (ChunkSize, len);
+    for (; i<MinChunk; i++)   h = (h<<1) + DedupGear.t[p[i]];
+    for (; i<normal; i++)    {h = (h<<1) + DedupGear.t[p[i]];  if (!(h & MaskS))  return i+1;}
+    for (; i<len; i++)       {h = (h<<1) + DedupGear.t[p[i]];  if (!(h & MaskL))  return i+1;}
+    return len;
+}
+
+//  .      ,    
+static uint64 dedup_fingerprint (byte *p, int len)
+{
+    uint64 h = len * 0x9E3779B97F4A7C15ULL;
+    for (; len>=8; p+=8, len-=8)   h = (h ^ value64(p)) * 0xFF51AFD7ED558CCDULL,  h ^= h>>32;
+    for (; len>0;  p++,  len--)    h = (h ^ *p)         * 0xFF51AFD7ED558CCDULL,  h ^= h>>32;
+    h ^= h>>29;
+    return h? h : 1;    // 0    
+}
+
+
+//   ****************************************************************************
+
+#ifdef FREEARC_WIN
+typedef HANDLE DEDUP_FILE;
+#define DEDUP_NO_FILE  INVALID_HANDLE_VALUE
+
+static DEDUP_FILE dedup_open (const char *utf8name, bool create = TRUE)
+{
+    WCHAR *name = (WCHAR*) malloc_msg (MY_FILENAME_MAX*4);
+    utf8_to_utf16 (utf8name, name);
+    if (create)  BuildPathTo (name);
+    HANDLE f = CreateFileW (name, GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, NULL, create? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    free (name);
+    return f;
+}
+static void   dedup_close (DEDUP_FILE f)  {CloseHandle (f);}
+static void   dedup_lock  (DEDUP_FILE f)  {OVERLAPPED ov = {0};  LockFileEx (f, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &ov);}
+static uint64 dedup_size  (DEDUP_FILE f)  {LARGE_INTEGER size;  return GetFileSizeEx (f, &size)? size.QuadPart : 0;}
+
+static bool dedup_pread (DEDUP_FILE f, void *buf, int len, uint64 pos)
+{
+    OVERLAPPED ov = {0};  ov.Offset = DWORD(pos),  ov.OffsetHigh = DWORD(pos>>32);
+    DWORD bytes;
+    return ReadFile (f, buf, len, &bytes, &ov)  &&  bytes==len;
+}
+static bool dedup_pwrite (DEDUP_FILE f, void *buf, int len, uint64 pos)
+{
+    OVERLAPPED ov = {0};  ov.Offset = DWORD(pos),  ov.OffsetHigh = DWORD(pos>>32);
+    DWORD bytes;
+    return WriteFile (f, buf, len, &bytes, &ov)  &&  bytes==len;
+}
+static bool dedup_truncate (DEDUP_FILE f, uint64 size)
+{
+    LARGE_INTEGER pos;  pos.QuadPart = size;
+    return SetFilePointerEx (f, pos, NULL, FILE_BEGIN)  &&  SetEndOfFile (f);
+}
+
+static void *dedup_map (DEDUP_FILE f, uint64 size)
+{
+    HANDLE mapping = CreateFileMappingW (f, NULL, PAGE_READWRITE, DWORD(size>>32), DWORD(size), NULL);
+    if (mapping == NULL)  return NULL;
+    void *p = MapViewOfFile (mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    CloseHandle (mapping);    //  ,   view
+    return p;
+}
+static void dedup_unmap (void *p, uint64 size)  {UnmapViewOfFile (p);}
+
+static bool dedup_rename (char *utf8from, char *utf8to)
+{
+    WCHAR *from = (WCHAR*) malloc_msg (MY_FILENAME_MAX*4),  *to = (WCHAR*) malloc_msg (MY_FILENAME_MAX*4);
+    utf8_to_utf16 (utf8from, from);  utf8_to_utf16 (utf8to, to);
+    bool ok = MoveFileExW (from, to, MOVEFILE_REPLACE_EXISTING);
+    free (to);  free (from);
+    return ok;
+}
+
+static void dedup_remove (char *utf8name)
+{
+    WCHAR *name = (WCHAR*) malloc_msg (MY_FILENAME_MAX*4);
+    utf8_to_utf16 (utf8name, name);
+    DeleteFileW (name);
+    free (name);
+}
+
+//    
+static void dedup_default_dir (char *dir)
+{
+    WCHAR *env = _wgetenv (L"FREEARC_DEDUP_DIR");
+    if (env)                                 {utf16_to_utf8 (env, dir);  return;}
+    if ((env = _wgetenv (L"APPDATA")) != NULL)  utf16_to_utf8 (env, dir),  strcat (dir, "\\FreeArc\\dedup");
+    else                                        strcpy (dir, "dedup");
+}
+
+#else // FREEARC_UNIX
+#include <sys/mman.h>
+#include <sys/file.h>
+typedef int DEDUP_FILE;
+#define DEDUP_NO_FILE  (-1)
+
+static DEDUP_FILE dedup_open (const char *utf8name, bool create = TRUE)
+{
+    if (create) {
+        char path[MY_FILENAME_MAX];
+        strcpy (path, utf8name);
+        BuildPathTo (path);
+    }
+    return ::open (utf8name, create? O_RDWR|O_CREAT : O_RDWR, S_IREAD|S_IWRITE);
+}
+static void   dedup_close (DEDUP_FILE f)  {::close (f);}
+static void   dedup_lock  (DEDUP_FILE f)  {flock (f, LOCK_EX);}
+static uint64 dedup_size  (DEDUP_FILE f)  {return myfilelength (f);}
+
+static bool dedup_pread    (DEDUP_FILE f, void *buf, int len, uint64 pos)  {return pread  (f, buf, len, pos) == len;}
+static bool dedup_pwrite   (DEDUP_FILE f, void *buf, int len, uint64 pos)  {return pwrite (f, buf, len, pos) == len;}
+static bool dedup_truncate (DEDUP_FILE f, uint64 size)                     {return ftruncate (f, size) == 0;}
+
+static void *dedup_map (DEDUP_FILE f, uint64 size)
+{
+    void *p = mmap (NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, f, 0);
+    return p==MAP_FAILED? NULL : p;
+}
+static void dedup_unmap (void *p, uint64 size)  {munmap (p, size);}
+
+static bool dedup_rename (char *from, char *to)  {return ::rename (from, to) == 0;}
+static void dedup_remove (char *name)            {::remove (name);}
+
+//    
+static void dedup_default_dir (char *dir)
+{
+    char *env = getenv ("FREEARC_DEDUP_DIR");
+    if (env)                              {strcpy (dir, env);  return;}
+    if ((env = getenv ("HOME")) != NULL)   sprintf (dir, "%s/.freearc/dedup", env);
+    else                                   strcpy (dir, "dedup");
+}
+#endif
+
+
+//   *****************************************************************************
+
+struct DedupEntry        {uint64 fp, pos;  uint32 len, reserved;};     // ,    .dat   
+struct DedupIndexHeader  {uint32 signature, version;  uint64 id, slots, count, datsize;  byte reserved[24];};   // datsize -  .dat,   
+
+struct DedupStore
+{
+    char             *basename;     //      
+    DEDUP_FILE        lock, dat, idx;
+    uint64            id;           //  ,    
+    uint64            size;         //   .dat (  readonly -   .tst)
+    DedupIndexHeader *hdr;          //    
+    DedupEntry       *table;        //      (hdr->slots ,  )
+    bool              readonly;     //   :   ,      .tst
+    bool              deferred;     //     .tst       commit()
+    DEDUP_FILE        tst;          //      ,    readonly/deferred
+    char             *tstname;      //     (     ,     )
+    uint64            datsize;      //    .dat;     datsize   .tst
+    DedupEntry       *pending;      //   -   .tst (  deferred,   )
+    uint64            pslots, pcount;
+
+    DedupStore()   {basename=NULL;  tstname=NULL;  lock=dat=idx=tst=DEDUP_NO_FILE;  hdr=NULL;  table=NULL;  readonly=deferred=FALSE;  pending=NULL;  pslots=pcount=0;}
+    ~DedupStore()  {close();}
+
+    char *filename (const char *ext, char *buf)  {sprintf (buf, "%s.%s", basename, ext);  return buf;}
+    static uint64 mapsize (uint64 slots)   {return sizeof(DedupIndexHeader) + slots*sizeof(DedupEntry);}
+
+    int   open (char *Name, uint64 _id, bool _readonly = FALSE, bool _deferred = FALSE);
+    void  close();
+    int   open_index();
+    int   open_tst();
+    int   map_index (DEDUP_FILE f, uint64 slots, bool create);
+    void  unmap_index();
+    int   grow_index();
+    int   index_records (uint64 from);
+    void  insert (uint64 fp, uint64 pos, uint32 len);
+    int   add_pending (uint64 fp, uint64 pos, uint32 len);
+    int64 find_in (DedupEntry *table, uint64 slots, byte *p, int len, uint64 fp, byte *tmp);
+    int64 find   (byte *p, int len, uint64 fp, byte *tmp);
+    int   add    (byte *p, int len, uint64 fp);
+    int   commit();
+    int   read   (uint64 pos, byte *p, int len);
+};
+
+//  ( )  Name.  _id!=0     id,     .
+//   _readonly    ,   .
+//   _deferred         commit()
+int DedupStore::open (char *Name, uint64 _id, bool _readonly, bool _deferred)
+{
+    char name[MY_FILENAME_MAX];
+    basename = (char*) malloc_msg (MY_FILENAME_MAX*2);
+    dedup_default_dir (basename);
+    sprintf (str_end(basename), "%s%s", STR_PATH_DELIMITER, Name);
+
+    //        .   readonly .lck  
+    // (   ):   ,    ,      
+    readonly = _readonly,  deferred = _readonly || _deferred;
+    lock = dedup_open (filename ("lck", name), !readonly);
+    if (lock == DEDUP_NO_FILE  &&  !readonly)  return FREEARC_ERRCODE_WRITE;
+    if (lock != DEDUP_NO_FILE)  dedup_lock (lock);
+    dat = dedup_open (filename ("dat", name), !readonly);
+    if (dat == DEDUP_NO_FILE  &&  !readonly)   return FREEARC_ERRCODE_WRITE;
+    byte header[DEDUP_DAT_HEADER];
+    size = (dat == DEDUP_NO_FILE? 0 : dedup_size (dat));
+    if (size == 0  &&  readonly) {
+        id = _id;
+        size = datsize = DEDUP_DAT_HEADER;
+        return FREEARC_OK;
+    }
+    if (size == 0) {
+        //  
+        id = _id? _id : (uint64(time_based_random()) << 32) + time_based_random()*2654435761U + uint64(size_t(this));
+        setvalue32 (header,   DEDUP_DAT_SIGNATURE);
+        setvalue32 (header+4, DEDUP_VERSION);
+        setvalue64 (header+8, id);
+        if (!dedup_pwrite (dat, header, DEDUP_DAT_HEADER, 0))  return FREEARC_ERRCODE_WRITE;
+        size = DEDUP_DAT_HEADER;
+    } else {
+        if (size < DEDUP_DAT_HEADER  ||  !dedup_pread (dat, header, DEDUP_DAT_HEADER, 0))  return FREEARC_ERRCODE_READ;
+        if (value32(header) != DEDUP_DAT_SIGNATURE  ||  value32(header+4) != DEDUP_VERSION)  return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+        id = value64 (header+8);
+        if (_id  &&  id != _id)  return FREEARC_ERRCODE_READ;     //   
+    }
+    datsize = size;
+    return readonly? FREEARC_OK : open_index();
+}
+
+void DedupStore::close()
+{
+    if (tst  != DEDUP_NO_FILE)  dedup_close (tst),   tst  = DEDUP_NO_FILE,  dedup_remove (tstname);
+    unmap_index();
+    if (idx  != DEDUP_NO_FILE)  dedup_close (idx),   idx  = DEDUP_NO_FILE;
+    if (dat  != DEDUP_NO_FILE)  dedup_close (dat),   dat  = DEDUP_NO_FILE;
+    if (lock != DEDUP_NO_FILE)  dedup_close (lock),  lock = DEDUP_NO_FILE;
+    free (basename);  basename = NULL;
+    free (tstname);   tstname  = NULL;
+    free (pending);   pending  = NULL,  pslots = pcount = 0;
+}
+
+//       f,  create -      slots 
+int DedupStore::map_index (DEDUP_FILE f, uint64 slots, bool create)
+{
+    if (create  &&  !(dedup_truncate (f, 0)  &&  dedup_truncate (f, mapsize(slots))))  return FREEARC_ERRCODE_WRITE;
+    hdr = (DedupIndexHeader*) dedup_map (f, mapsize(slots));
+    if (hdr == NULL)  return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
+    table = (DedupEntry*) (hdr+1);
+    if (create) {
+        hdr->signature = DEDUP_IDX_SIGNATURE,  hdr->version = DEDUP_VERSION,  hdr->id = id;
+        hdr->slots = slots,  hdr->count = 0,  hdr->datsize = DEDUP_DAT_HEADER;
+    }
+    return FREEARC_OK;
+}
+
+void DedupStore::unmap_index()
+{
+    if (hdr)  dedup_unmap (hdr, mapsize(hdr->slots)),  hdr = NULL,  table = NULL;
+}
+
+//  ,  ,       .dat,    .dat
+int DedupStore::open_index()
+{
+    char name[MY_FILENAME_MAX];
+    if ((idx = dedup_open (filename ("idx", name))) == DEDUP_NO_FILE)  return FREEARC_ERRCODE_WRITE;
+    uint64 idxsize = dedup_size (idx);
+    DedupIndexHeader h;
+    bool valid = idxsize >= sizeof(h)  &&  dedup_pread (idx, &h, sizeof(h), 0)
+              && h.signature == DEDUP_IDX_SIGNATURE  &&  h.version == DEDUP_VERSION  &&  h.id == id
+              && h.slots >= DEDUP_MIN_SLOTS  &&  (h.slots & (h.slots-1)) == 0  &&  idxsize == mapsize(h.slots)
+              && h.datsize >= DEDUP_DAT_HEADER  &&  h.datsize <= size;
+    int errcode = map_index (idx, valid? h.slots : DEDUP_MIN_SLOTS, !valid);
+    if (errcode != FREEARC_OK)  return errcode;
+    return index_records (hdr->datsize);
+}
+
+//     .dat    from.    
+int DedupStore::index_records (uint64 from)
+{
+    byte *buf = NULL;  int bufsize = 0;
+    uint64 pos = from;
+    while (pos + DEDUP_RECORD_HEADER <= size) {
+        byte header[DEDUP_RECORD_HEADER];
+        if (!dedup_pread (dat, header, DEDUP_RECORD_HEADER, pos))  break;
+        uint32 len = value32 (header);
+        if (len == 0  ||  len >= DEDUP_REFERENCE  ||  pos + DEDUP_RECORD_HEADER + len > size)  break;
+        if (len > bufsize) {
+            free (buf);  bufsize = len;
+            if ((buf = (byte*) malloc (bufsize)) == NULL)  return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
+        }
+        if (!dedup_pread (dat, buf, len, pos + DEDUP_RECORD_HEADER))  break;
+        insert (dedup_fingerprint (buf, len), pos + DEDUP_RECORD_HEADER, len);
+        pos += DEDUP_RECORD_HEADER + len;
+        hdr->datsize = pos;
+        if (hdr->count*4 >= hdr->slots*3) {
+            int errcode = grow_index();
+            if (errcode != FREEARC_OK)  {free (buf);  return errcode;}
+        }
+    }
+    free (buf);
+    if (pos < size) {
+        if (!dedup_truncate (dat, pos))  return FREEARC_ERRCODE_WRITE;
+        size = pos;
+    }
+    return FREEARC_OK;
+}
+
+//    - table  slots  ( ;      )
+static void dedup_insert (DedupEntry *table, uint64 slots, uint64 fp, uint64 pos, uint32 len)
+{
+    uint64 mask = slots-1;
+    uint64 i;
+    for (i = fp & mask;  table[i].fp;  i = (i+1) & mask);
+    table[i].fp = fp,  table[i].pos = pos,  table[i].len = len,  table[i].reserved = 0;
+}
+
+//    
+void DedupStore::insert (uint64 fp, uint64 pos, uint32 len)
+{
+    dedup_insert (table, hdr->slots, fp, pos, len);
+    hdr->count++;
+}
+
+//    .tst   pending,      3/4
+int DedupStore::add_pending (uint64 fp, uint64 pos, uint32 len)
+{
+    if (pcount*4 >= pslots*3) {
+        uint64 slots = pslots? pslots*2 : 1024;
+        DedupEntry *t = (DedupEntry*) calloc (slots, sizeof(DedupEntry));
+        if (t == NULL)  return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
+        for (uint64 i=0; i<pslots; i++)
+            if (pending[i].fp)  dedup_insert (t, slots, pending[i].fp, pending[i].pos, pending[i].len);
+        free (pending);  pending = t,  pslots = slots;
+    }
+    dedup_insert (pending, pslots, fp, pos, len);
+    pcount++;
+    return FREEARC_OK;
+}
+
+//  :         
+int DedupStore::grow_index()
+{
+    char name[MY_FILENAME_MAX], newname[MY_FILENAME_MAX];
+    DEDUP_FILE f = dedup_open (filename ("idx.new", newname));
+    if (f == DEDUP_NO_FILE)  return FREEARC_ERRCODE_WRITE;
+
+    DedupIndexHeader *old = hdr;  DedupEntry *oldtable = table;
+    int errcode = map_index (f, old->slots*2, TRUE);
+    if (errcode != FREEARC_OK)  {hdr = old, table = oldtable;  dedup_close (f);  return errcode;}
+    for (uint64 i=0; i<old->slots; i++)
+        if (oldtable[i].fp)  insert (oldtable[i].fp, oldtable[i].pos, oldtable[i].len);
+    hdr->datsize = old->datsize;
+    uint64 oldslots = old->slots,  slots = hdr->slots;
+
+    dedup_unmap (old, mapsize(oldslots));
+    unmap_index();  dedup_close (f);  dedup_close (idx);
+    bool renamed = dedup_rename (newname, filename ("idx", name));
+    if ((idx = dedup_open (name)) == DEDUP_NO_FILE)  return FREEARC_ERRCODE_WRITE;
+    errcode = map_index (idx, renamed? slots : oldslots, FALSE);   //    ,  
+    return errcode==FREEARC_OK && !renamed?  FREEARC_ERRCODE_WRITE : errcode;
+}
+
+//   - table  slots   p[0..len)   fp       -1.
+// tmp -    ,   len 
+int64 DedupStore::find_in (DedupEntry *table, uint64 slots, byte *p, int len, uint64 fp, byte *tmp)
+{
+    uint64 mask = slots-1;
+    for (uint64 i = fp & mask;  table[i].fp;  i = (i+1) & mask) {
+        DedupEntry &e = table[i];
+        if (e.fp == fp  &&  e.len == len  &&  read (e.pos, tmp, len) == FREEARC_OK  &&  memcmp (p, tmp, len) == 0)
+            return e.pos;
+    }
+    return -1;
+}
+
+//    ,         .tst
+int64 DedupStore::find (byte *p, int len, uint64 fp, byte *tmp)
+{
+    int64 pos = find_in (table, hdr->slots, p, len, fp, tmp);
+    return pos<0 && pending?  find_in (pending, pslots, p, len, fp, tmp) : pos;
+}
+
+//  len    pos 
+int DedupStore::read (uint64 pos, byte *p, int len)
+{
+    DEDUP_FILE f = (deferred && pos >= datsize? tst : dat);
+    if (f != dat)  pos -= datsize;
+    return pos+len<=size && f!=DEDUP_NO_FILE && dedup_pread (f, p, len, pos)?  FREEARC_OK : FREEARC_ERRCODE_READ;
+}
+
+//     ,    readonly/deferred.      
+//    ,            
+int DedupStore::open_tst()
+{
+    tstname = (char*) malloc_msg (MY_FILENAME_MAX*2);
+#ifdef FREEARC_WIN
+    utf16_to_utf8 (GetTempDir(), tstname);
+#else
+    strcpy (tstname, GetTempDir());
+#endif
+    sprintf (str_end(tstname), "%sfreearc-dedup-%u-%u.tst", STR_PATH_DELIMITER, time_based_random(), unsigned(size_t(this)));
+    tst = dedup_open (tstname);
+    return tst == DEDUP_NO_FILE?  FREEARC_ERRCODE_WRITE : FREEARC_OK;
+}
+
+//          
+int DedupStore::add (byte *p, int len, uint64 fp)
+{
+    byte header[DEDUP_RECORD_HEADER];
+    setvalue32 (header, len);
+    if (deferred) {
+        //    ,      ,     
+        if (tst == DEDUP_NO_FILE  &&  open_tst() != FREEARC_OK)  return FREEARC_ERRCODE_WRITE;
+        if (!dedup_pwrite (tst, header, DEDUP_RECORD_HEADER, size-datsize)  ||  !dedup_pwrite (tst, p, len, size-datsize + DEDUP_RECORD_HEADER))
+            return FREEARC_ERRCODE_WRITE;
+        uint64 pos = size + DEDUP_RECORD_HEADER;
+        size += DEDUP_RECORD_HEADER + len;
+        return readonly? FREEARC_OK : add_pending (fp, pos, len);
+    }
+    if (!dedup_pwrite (dat, header, DEDUP_RECORD_HEADER, size)  ||  !dedup_pwrite (dat, p, len, size + DEDUP_RECORD_HEADER))
+        return FREEARC_ERRCODE_WRITE;
+    insert (fp, size + DEDUP_RECORD_HEADER, len);
+    size += DEDUP_RECORD_HEADER + len;
+    hdr->datsize = size;
+    return hdr->count*4 >= hdr->slots*3?  grow_index() : FREEARC_OK;
+}
+
+//  ,   .tst   deferred,   .dat     .
+//    .tst           datsize,    .dat.
+//     , .dat    
+int DedupStore::commit()
+{
+    if (!deferred  ||  readonly  ||  size == datsize)  return FREEARC_OK;
+    const int BUFSIZE = 1*mb;
+    byte *buf = (byte*) malloc (BUFSIZE);
+    if (buf == NULL)  return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
+    for (uint64 pos = datsize;  pos < size; ) {
+        int n = size-pos < BUFSIZE?  int(size-pos) : BUFSIZE;
+        if (!dedup_pread (tst, buf, n, pos-datsize)  ||  !dedup_pwrite (dat, buf, n, pos)) {
+            free (buf);  dedup_truncate (dat, datsize);
+            return FREEARC_ERRCODE_WRITE;
+        }
+        pos += n;
+    }
+    free (buf);
+    deferred = FALSE,  datsize = size;
+
+    for (uint64 i=0; i<pslots; i++)
+        if (pending[i].fp) {
+            insert (pending[i].fp, pending[i].pos, pending[i].len);
+            if (hdr->count*4 >= hdr->slots*3) {
+                int errcode = grow_index();
+                if (errcode != FREEARC_OK)  return errcode;
+            }
+        }
+    hdr->datsize = size;
+    return FREEARC_OK;
+}
+
+
+//    ************************************************************************
+
+#ifndef FREEARC_DECOMPRESS_ONLY
+int dedup_compress (MemSize ChunkSize, char *Name, CALLBACK_FUNC *callback, void *auxdata)
+{
+    int MinChunk = DedupMinChunk(ChunkSize),  MaxChunk = DedupMaxChunk(ChunkSize),  bufsize = DedupBufSize(ChunkSize);
+    int bits = lb(ChunkSize);
+    uint64 MaskS = ((uint64(1) << (bits+2)) - 1) << (62-bits),   // bits+2  
+           MaskL = ((uint64(1) << (bits-2)) - 1) << (66-bits);   // bits-2  
+    int errcode = FREEARC_OK,  len = 0,  pos = 0,  eof = FALSE;
+    byte *buf = NULL, *verify = NULL;
+    DedupStore store;
+    FOPEN();
+    BIGALLOC (byte, buf,    bufsize);
+    BIGALLOC (byte, verify, MaxChunk);
+    if ((errcode = store.open (Name, 0, FALSE, TRUE)) != FREEARC_OK)  goto finished;
+    Put64 (store.id);
+    Put64 (store.size);
+
+    for (;;) {
+        //      MaxChunk ,     
+        if (!eof  &&  len-pos < MaxChunk) {
+            memmove (buf, buf+pos, len-pos);  len -= pos;  pos = 0;
+            int n;  READ_LEN (n, buf+len, bufsize-len);
+            if (n==0)  eof = TRUE;
+            len += n;
+            continue;
+        }
+        if (pos == len)  break;
+
+        int chunk = dedup_cut (buf+pos, len-pos, MinChunk, ChunkSize, MaxChunk, MaskS, MaskL);
+        uint64 fp = dedup_fingerprint (buf+pos, chunk);
+        int64 found = store.find (buf+pos, chunk, fp, verify);
+        if (found >= 0) {
+            Put32 (chunk | DEDUP_REFERENCE);
+            Put64 (found);
+            Put64 (fp);
+        } else {
+            if ((errcode = store.add (buf+pos, chunk, fp)) != FREEARC_OK)  goto finished;
+            Put32 (chunk);
+            FWRITE (buf+pos, chunk);
+        }
+        pos += chunk;
+    }
+    Put32 (0);    // EOF flag
+    FFLUSH();
+    //        ,     
+    errcode = store.commit();
+finished:
+    FCLOSE();
+    store.close();
+    BigFree(verify);
+    BigFree(buf);
+    return errcode>=0? 0 : errcode;
+}
+#endif // FREEARC_DECOMPRESS_ONLY
+
+int dedup_decompress (MemSize ChunkSize, char *Name, CALLBACK_FUNC *callback, void *auxdata)
+{
+    int errcode = FREEARC_OK,  MaxChunk = DedupMaxChunk(ChunkSize);
+    uint32 x;  uint64 id, base, pos, fp;
+    byte *buf = NULL, *stored = NULL;
+    bool testing = callback ("testing", NULL, 0, auxdata) > 0;     //    -    
+    DedupStore store;
+    BIGALLOC (byte, buf,    MaxChunk);
+    BIGALLOC (byte, stored, DEDUP_RECORD_HEADER+MaxChunk);
+    READ8 (id);
+    READ8 (base);
+    if ((errcode = store.open (Name, id, testing)) != FREEARC_OK)  goto finished;
+    if (store.size < base)  ReturnErrorCode (FREEARC_ERRCODE_READ);    //    ,    
+
+    for (pos=base; ; ) {
+        READ4 (x);
+        if (x == 0)  break;     // EOF flag
+        int len = x & ~DEDUP_REFERENCE;
+        if (len > MaxChunk)  ReturnErrorCode (FREEARC_ERRCODE_BAD_COMPRESSED_DATA);
+        if (x & DEDUP_REFERENCE) {
+            uint64 from;  READ8 (from);  READ8 (fp);
+            if ((errcode = store.read (from, buf, len)) != FREEARC_OK)  goto finished;
+            //   ,     
+            if (dedup_fingerprint (buf, len) != fp)  ReturnErrorCode (FREEARC_ERRCODE_READ);
+        } else {
+            READ (buf, len);
+            if (pos < store.size) {
+                //     ,        .
+                //  ,          
+                if ((errcode = store.read (pos, stored, DEDUP_RECORD_HEADER+len)) != FREEARC_OK)  goto finished;
+                if (value32(stored) != len  ||  memcmp (stored+DEDUP_RECORD_HEADER, buf, len) != 0)  ReturnErrorCode (FREEARC_ERRCODE_READ);
+            } else if (pos == store.size) {
+                if ((errcode = store.add (buf, len, dedup_fingerprint (buf, len))) != FREEARC_OK)  goto finished;
+            } else  ReturnErrorCode (FREEARC_ERRCODE_READ);
+            pos += DEDUP_RECORD_HEADER + len;
+        }
+        WRITE (buf, len);
+    }
+finished:
+    store.close();
+    BigFree(stored);
+    BigFree(buf);
+    return errcode>=0? 0 : errcode;
+}
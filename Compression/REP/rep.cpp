@@ -223,6 +223,12 @@ rep:512 (
 
 //  ************************************************************************
 #include "../Compression.h"
+#include "../SIMD.h"
+#include "../LZMA/Windows/Thread.h"
+using namespace NWindows;
+#ifndef REP_NO_OVERLAPPED_IO
+#include "../MultiThreading.h"
+#endif
 
 
 #ifdef REP_LIBRARY
@@ -265,15 +271,13 @@ inline static unsigned sqrtb (unsigned n, unsigned base = 2)
 //    ,    *p  *q
 static inline byte* find_match_start (byte* p, byte* q, byte* start)
 {
-    while (q>start)   if (*--p != *--q)  return q+1;
-    return q;
+    return q>start?  q - match_len_back (p, q, q-start) : q;
 }
 
 //     ,    *p  *q
 static inline byte* find_match_end (byte* p, byte* q, byte* end)
 {
-    while (q<end && *p==*q) p++,q++;
-    return q;
+    return q<end?  q + match_len (p, q, end-q) : q;
 }
 
 //      ,     
@@ -281,9 +285,16 @@ static inline byte* find_match_end (byte* p, byte* q, byte* end)
 //   )
 static inline void memcpy_lz_match (byte* p, byte* q, unsigned len)
 {
-    if (len)
-    do *p++ = *q++;
-    while (--len);
+    if (q+len <= p  ||  q >= p) {           //         
+        memmove (p, q, len);
+        return;
+    }
+    //   p-q,     
+    while (len > p-q) {
+        unsigned bytes = p-q;
+        memcpy (p, q, bytes);  p += bytes;  len -= bytes;
+    }
+    memcpy (p, q, len);
 }
 
 
@@ -355,14 +366,161 @@ MemSize CalcHashSize (MemSize HashBits, MemSize BlockSize, MemSize k)
 }
 
 #ifndef FREEARC_DECOMPRESS_ONLY
+
+//    ********************************************************************
+
+/*
+               L,
+              :
+      1.        ,   
+           ,      (  k )
+      2.       hasharr:     
+          ,          
+            -  ,     
+      3.          ,
+           last_match   
+         .     
+        last_match -   ,     last_match
+      :         .  
+             .
+*/
+
+//  ,       
+#ifndef REP_SEARCH_THREADS
+#define REP_SEARCH_THREADS  GetCompressionThreads()
+#endif
+const int MAX_REP_THREADS = 64;
+
+struct RepMatch  {int pos, start, end, offset;};      // pos -  ,    
+
+//    ,   
+struct RepSearch
+{
+    byte *buf;  int *hasharr;  int HashSize, HashMask;
+    int L, k, k1, test, cPOWER_PRIME_L;
+    int Base, Size, BlockSize, MinMatchLen, SmallestLen, Barrier;
+    int first, last;            //    L:  [first,last)
+    int last_match;             //      
+    int *slot, *value;          //      first, first+k...
+    int *hashes, *cand;         //     ( test     L)    
+    int threads;
+
+    bool check (int i, int last_match, RepMatch &m);
+};
+
+//      i  ,        last_match
+bool RepSearch::check (int i, int last_match, RepMatch &m)
+{
+    int n = (i-first)/L*test + (i&(L-1));
+    int hash = hashes[n],  match = cand[n];
+    if (!match || chksum!=(match&k1))  return FALSE;
+    match &= ~k1;
+    if (match>=i && match<Base+Size)   return FALSE;
+    int LowBound  = match<i? i-match : match-(Base+Size)>i? 0 : i - (match-(Base+Size));
+    int HighBound = BlockSize - match + i;
+    int start = find_match_start (buf+match, buf+i, buf+mymax(last_match,LowBound)) - buf;
+    int end   = find_match_end   (buf+match, buf+i, buf+mymin(Base+Size,HighBound)) - buf;
+    if (end-start < (i-match<Barrier? MinMatchLen : SmallestLen))  return FALSE;
+    int offset = i-match;  if (offset<0)  offset+=BlockSize;
+    m.pos = i,  m.start = start,  m.end = end,  m.offset = offset;
+    return TRUE;
+}
+
+//   
+struct RepSearchJob
+{
+    RepSearch *s;
+    int n;                      //  
+    int from, to;               //  [from,to)
+    int phase;                  //   (1..3)
+    RepMatch *matches;  int nmatches;   // ,    3
+
+    void run()  {phase==1? hash_segment() : phase==2? insert_hashes() : search_segment();}
+    void hash_segment();
+    void insert_hashes();
+    void search_segment();
+};
+
+//  1:     
+void RepSearchJob::hash_segment()
+{
+    byte *buf = s->buf;  int L = s->L, k1 = s->k1, test = s->test, cPOWER_PRIME_L = s->cPOWER_PRIME_L;
+    int hash=0;  for (int i=from; i < from+L; i++)  update_hash (0, buf[i]);
+    for (int i=from; i<to; i++) {
+        if ((i&(L-1)) < test)  s->hashes[(i-s->first)/L*test + (i&(L-1))] = hash;
+        if ((i&k1) == 0) {
+            int n = (i-s->first)/s->k;
+            s->slot[n]  = hash & s->HashMask;
+            s->value[n] = i + chksum;
+        }
+        update_hash (buf[i], buf[i+L]);
+    }
+}
+
+//  2:             .
+//   ,     ,    
+void RepSearchJob::insert_hashes()
+{
+    int part = (s->HashSize + s->threads-1) / s->threads,  lo = n*part,  hi = lo+part;
+    int L = s->L, k = s->k, test = s->test, HashMask = s->HashMask;
+    int *hashes = s->hashes, *cand = s->cand, *slot = s->slot, *value = s->value, *hasharr = s->hasharr;
+    for (int block=s->first; block<s->last; block+=L, hashes+=test, cand+=test, slot+=L/k, value+=L/k) {
+        for (int x=0; x<L; x+=k) {
+            int h;
+            if (x<test)  {h = hashes[x] & HashMask;  if (h>=lo && h<hi)  cand[x] = hasharr[h];}
+            h = slot[x/k];
+            if (h>=lo && h<hi)  hasharr[h] = value[x/k];
+            for (int j=x+1; j<test && j<x+k; j++)
+                {h = hashes[j] & HashMask;  if (h>=lo && h<hi)  cand[j] = hasharr[h];}
+        }
+    }
+}
+
+//  3:    ,     rep_compress
+void RepSearchJob::search_segment()
+{
+    int L = s->L, test = s->test, last_match = s->last_match;
+    nmatches = 0;
+    for (int block=from; block<to; block+=L)
+        for (int i=block; i<block+test; i++)
+            if (i>=last_match  &&  s->check (i, last_match, matches[nmatches]))
+                last_match = matches[nmatches++].end;
+}
+
+static DWORD WINAPI RepSearchThread (void *param)  {((RepSearchJob*)param) -> run();  return 0;}
+
+//   phase       
+static void RepRunPhase (RepSearchJob *jobs, int threads, int phase)
+{
+    CThread t[MAX_REP_THREADS];  bool started[MAX_REP_THREADS];
+    for (int n=0; n<threads; n++)  jobs[n].phase = phase;
+    for (int n=1; n<threads; n++)  started[n] = t[n].Create (RepSearchThread, &jobs[n]);
+    jobs[0].run();
+    for (int n=1; n<threads; n++)
+        if (started[n])  t[n].Wait();
+        else             jobs[n].run();     //     -    
+}
+
+//         ChunkSize 
+MemSize RepSearchMem (MemSize ChunkSize, int L, int k, int test, int SmallestLen, int threads)
+{
+    if (threads <= 1)  return 0;
+    return (ChunkSize/k+1) * 2*sizeof(int)                       // slot, value
+         + (ChunkSize/L+1) * test*2*sizeof(int)                  // hashes, cand
+         + (ChunkSize/SmallestLen + 2*threads) * sizeof(RepMatch);
+}
+
 int rep_compress (unsigned BlockSize, int MinCompression, int MinMatchLen, int Barrier, int SmallestLen, int HashBits, int Amplifier, CALLBACK_FUNC *callback, void *auxdata)
 {
     //     (  REP_METHOD::GetCompressionMem!)
     if (SmallestLen>MinMatchLen)  SmallestLen=MinMatchLen;
     int L = roundup_to_power_of (SmallestLen/2, 2);  //  ,     
     int k = sqrtb(L*2), k1=k-1, test=mymin(k*Amplifier,L), cPOWER_PRIME_L = POWER_PRIME_L;
-    int HashSize, HashMask=0, *hasharr=NULL, hash=0;  int errcode=FREEARC_OK;
+    int HashSize=0, HashMask=0, *hasharr=NULL, hash=0;  int errcode=FREEARC_OK;
     int Base=0, last_i=0, last_match=0;    // last_match points to the end of last match written, we shouldn't start new match before it
+    int threads = mymin (mymax (REP_SEARCH_THREADS, 1), MAX_REP_THREADS);
+    RepSearch search;  RepSearchJob jobs[MAX_REP_THREADS];  RepMatch *found=NULL;   //    
+    search.slot = search.value = search.hashes = search.cand = NULL;
 #ifdef DEBUG
     int matches=0, total=0, lit=0;
 #endif
@@ -373,6 +531,17 @@ int rep_compress (unsigned BlockSize, int MinCompression, int MinMatchLen, int B
     int bsize = (mymin(BlockSize,MAX_READ)/SmallestLen+1) * sizeof(int32);    // .  ,         
     Buffer lens(bsize), offsets(bsize), datalens(bsize), dataOffsets(bsize);  //     ,  ,       .       
 
+    if (threads > 1) {
+        //   ,     MAX_READ  (. RepSearchMem)
+        int ChunkSize = mymin(BlockSize,MAX_READ);
+        search.slot   = (int*) BigAlloc ((ChunkSize/k+1) * sizeof(int));
+        search.value  = (int*) BigAlloc ((ChunkSize/k+1) * sizeof(int));
+        search.hashes = (int*) BigAlloc ((ChunkSize/L+1) * test*sizeof(int));
+        search.cand   = (int*) BigAlloc ((ChunkSize/L+1) * test*sizeof(int));
+        found         = (RepMatch*) BigAlloc ((ChunkSize/SmallestLen + 2*threads) * sizeof(RepMatch));
+        if (!search.slot || !search.value || !search.hashes || !search.cand || !found)  threads = 1;   //    -    
+    }
+
     //     ,      
     //   min(1/8 ,8).     sliding window,
     //             
@@ -398,6 +567,50 @@ int rep_compress (unsigned BlockSize, int MinCompression, int MinMatchLen, int B
         }
         int literals=0; lens.empty(), offsets.empty(), datalens.empty(), dataOffsets.empty();  //  
 
+        //  :   L,    last_i... (i+L*2 < Base+Size),   
+        int blocks = Base+Size-L*2 > last_i?  (Base+Size-L*2 - last_i + L-1) / L : 0;
+        if (threads > 1  &&  blocks >= threads*4) {
+            search.buf = buf,  search.hasharr = hasharr,  search.HashSize = HashSize,  search.HashMask = HashMask;
+            search.L = L,  search.k = k,  search.k1 = k1,  search.test = test,  search.cPOWER_PRIME_L = cPOWER_PRIME_L;
+            search.Base = Base,  search.Size = Size,  search.BlockSize = BlockSize;
+            search.MinMatchLen = MinMatchLen,  search.SmallestLen = SmallestLen,  search.Barrier = Barrier;
+            search.first = last_i,  search.last = last_i + blocks*L,  search.last_match = last_match,  search.threads = threads;
+            RepMatch *m = found;
+            for (int n=0; n<threads; n++) {
+                jobs[n].s    = &search,  jobs[n].n = n,  jobs[n].matches = m;
+                jobs[n].from = last_i + blocks*n/threads*L;
+                jobs[n].to   = last_i + blocks*(n+1)/threads*L;
+                m += (jobs[n].to - jobs[n].from)/SmallestLen + 2;
+            }
+            RepRunPhase (jobs, threads, 1);
+            RepRunPhase (jobs, threads, 2);
+            RepRunPhase (jobs, threads, 3);
+
+            //  ,  .       last_match,
+            //      local -  last_match       i
+#define REP_PUT_MATCH(m)                                                                                       \
+            (dataOffsets.put32 (last_match),  datalens.put32 ((m).start-last_match),                           \
+             offsets.put32 ((m).offset),  lens.put32 ((m).end-(m).start),                                      \
+             debug ((matches++, total += (m).end-(m).start, lit += (m).start-last_match)),                     \
+             literals += (m).start-last_match,  last_match = (m).end)
+            for (int n=0; n<threads; n++) {
+                RepMatch *m = jobs[n].matches,  *mend = m + jobs[n].nmatches,  r;
+                int local = search.last_match;
+                for (int block=jobs[n].from; block<jobs[n].to; block+=L) {
+                    for (int i=block; i<block+test; i++) {
+                        for (; m<mend && m->pos<i; m++)  local = m->end;
+                        if (local == last_match)  goto synced;
+                        if (i>=last_match  &&  search.check (i, last_match, r))  REP_PUT_MATCH(r);
+                    }
+                }
+                m = mend;   //      -    
+        synced: for (; m<mend; m++)  REP_PUT_MATCH(*m);
+            }
+#undef REP_PUT_MATCH
+            last_i = search.last;
+            hash=0;  for (int i=last_i; i < last_i+L; i++)  update_hash (0, buf[i]);   //    last_i   
+        }
+
         //  ,      
         for (int i=last_i; i+L*2 < Base+Size; last_i=i) {   //   L      +   L  lookahead
 
@@ -487,6 +700,8 @@ int rep_compress (unsigned BlockSize, int MinCompression, int MinMatchLen, int B
     Put32 (0);}                         //   EOF flag (see below)
 finished:
     FCLOSE();
+    BigFree(found);
+    BigFree(search.cand);  BigFree(search.hashes);  BigFree(search.value);  BigFree(search.slot);
     BigFree(hasharr);
     BigFree(buf);
     lens.free(); offsets.free(); datalens.free(); dataOffsets.free();
@@ -496,11 +711,32 @@ finished:
 
 
 // Classical LZ77 decoder with sliding window
+#ifndef REP_NO_OVERLAPPED_IO
+//          (   OverlappedIO)
+static int rep_read_block (IOBuffer *b, CALLBACK_FUNC *callback, void *auxdata)
+{
+    int x = b->read (sizeof(int32), callback, auxdata);
+    if (x != sizeof(int32))  return x<0? x : FREEARC_ERRCODE_READ;
+    int ComprSize = value32 (b->buf);
+    if (ComprSize == 0)  return 0;     // EOF flag
+    x = b->read (ComprSize, callback, auxdata);
+    if (x != ComprSize)  return x<0? x : FREEARC_ERRCODE_READ;
+    return 1;
+}
+#endif
+
 int rep_decompress (unsigned BlockSize, int MinCompression, int MinMatchLen, int Barrier, int SmallestLen, int HashBits, int Amplifier, CALLBACK_FUNC *callback, void *auxdata)
 {
     int errcode;
+#ifndef REP_NO_OVERLAPPED_IO
+    OverlappedIO io;                                 //          
+#endif
     byte *buf0 = NULL;
     MemSize bufsize, ComprSize;
+    //         ,
+    //        
+    byte *window = NULL, *committed = NULL;          //        
+    const MemSize COMMIT_STEP = 16*mb;               //     
     //              
     const int MAX_BLOCKS = 100;                      // .   
     int       total_blocks = 0;                      //    
@@ -509,11 +745,22 @@ int rep_decompress (unsigned BlockSize, int MinCompression, int MinMatchLen, int
 
     //       
     READ4(BlockSize);
+#ifndef REP_NO_OVERLAPPED_IO
+    //  -   OverlappedIO (      - )
+    if (io.start (rep_read_block, callback, auxdata))
+        callback = OverlappedIO::Callback,  auxdata = &io;
+#endif
 
     // ,          
     {
     MemSize   cumulative_size[MAX_BLOCKS+1] = {0};   //   ,  i-
     MemSize   remaining_size = BlockSize;            //       
+    //     ,        (,  32- )
+    if (NULL  !=  (window = (byte*) ReserveAlloc (BlockSize)))
+    {
+        datap[0] = committed = window;  endp[0] = window + BlockSize;
+        cumulative_size[1] = BlockSize;  total_blocks = 1;  remaining_size = 0;
+    }
     while (remaining_size>0)
     {
         if (total_blocks >= MAX_BLOCKS)          ReturnErrorCode (FREEARC_ERRCODE_NOT_ENOUGH_MEMORY);
@@ -562,6 +809,47 @@ int rep_decompress (unsigned BlockSize, int MinCompression, int MinMatchLen, int
         int32*  offsets =  (int32*)buf;  buf += num*sizeof(int32);
         int32* datalens =  (int32*)buf;  buf += (num+1)*sizeof(int32);   // , datalens  num+1 
 
+        //       :        ,
+        //           
+        bool fast = FALSE;
+        if (window)
+        {
+            MemSize UncomprSize = 0;                 //    
+            for (int i=0; i<=num; i++)  UncomprSize += datalens[i];
+            for (int i=0; i<num;  i++)  UncomprSize += lens[i];
+            if (data==end && UncomprSize>0)          //        -     
+                last_data = data = start;
+            //      (        )
+            byte *need = data + mymin (UncomprSize, MemSize(end-data));
+            if (need > committed)
+            {
+                byte *new_committed = committed + mymin (roundUp (MemSize(need-committed), COMMIT_STEP), MemSize(end-committed));
+                if (!CommitAlloc (committed, new_committed-committed))  ReturnErrorCode (FREEARC_ERRCODE_NOT_ENOUGH_MEMORY);
+                committed = new_committed;
+            }
+            fast = (UncomprSize <= end-data);
+        }
+        if (fast)
+        {
+            for (int i=0; ; i++) {
+                int len = datalens[i];
+                memcpy (data, buf, len);  buf += len;  data += len;
+                if (i==num)  break;
+
+                int offset = offsets[i];  len = lens[i];
+                //     ,       (    )
+                if (unsigned(offset-1) >= BlockSize  ||  (offset > data-start && committed < end))  ReturnErrorCode (FREEARC_ERRCODE_BAD_COMPRESSED_DATA);
+                //              ,
+                //        
+                byte *from  = offset <= data-start?  data-offset : data-offset+BlockSize;
+                int   bytes = mymin (len, end-from);
+                memcpy_lz_match (data, from, bytes);
+                memcpy_lz_match (data+bytes, start, len-bytes);
+                data += len;
+            }
+        }
+        else
+
         //            match,  interleaved     
         for (int i=0; ; i++) {
             int len = datalens[i];
@@ -590,7 +878,7 @@ int rep_decompress (unsigned BlockSize, int MinCompression, int MinMatchLen, int
             int offset = offsets[i];  len = lens[i];
             debug (verbose>1 && printf ("Match %d %d %d\n", -offset, data-start+cumulative_size[current_block], len));
             //        
-            while (offset > data-start && len  ||  end-data < len)
+            while ((offset > data-start && len)  ||  end-data < len)
             {
                 MemSize dataPos = data-start+cumulative_size[current_block];   // Absolute position of LZ dest
                 MemSize fromPos = dataPos-offset;  int k;                      // Absolute position of LZ src
@@ -633,8 +921,13 @@ int rep_decompress (unsigned BlockSize, int MinCompression, int MinMatchLen, int
     }
     errcode = FREEARC_OK;}
 finished:
+#ifndef REP_NO_OVERLAPPED_IO
+    errcode = io.finish (errcode);
+#endif
     BigFree(buf0);
-    for(int i=total_blocks-1; i>=0; i--)
+    if (window)
+        ReserveFree (window, BlockSize);
+    else for(int i=total_blocks-1; i>=0; i--)
         BigFree(datap[i]);
     return errcode;
 }
@@ -0,0 +1,432 @@
+// (c) Bulat Ziganshin <Bulat.Ziganshin@gmail.com>
+// SIMD scanners shared by compression algorithms. Every scanner has a scalar version and
+// SSE2/AVX2 versions, selected at runtime depending on the CPU we are running on.
+// All versions return exactly the same results, so compressed data don't depend on the CPU.
+// Compile with -DFREEARC_NO_SIMD to leave only scalar code
+#ifndef FREEARC_SIMD_H
+#define FREEARC_SIMD_H
+
+#include "Common.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if !defined(FREEARC_NO_SIMD) && (defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64))  \
+    && (__GNUC__ > 4 || __GNUC__ == 4 && __GNUC_MINOR__ >= 9 || _MSC_VER >= 1700)
+#define FREEARC_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define SIMD_TARGET(isa)
+#else
+#define SIMD_TARGET(isa)  __attribute__((target(isa)))
+#endif
+#endif
+
+
+// ****************************************************************************
+// CPU DETECTION **************************************************************
+// ****************************************************************************
+
+// Best instruction set supported both by CPU and by this build
+enum SIMD_LEVEL {SIMD_NONE, SIMD_SSE2, SIMD_AVX2};
+
+static inline int detect_simd_level()
+{
+#ifdef FREEARC_SIMD
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid (info, 0);  int maxleaf = info[0];
+    __cpuid (info, 1);
+    bool sse2 = (info[3] >> 26) & 1;
+    bool avx  = (info[2] >> 28) & 1  &&  (info[2] >> 27) & 1  &&  (_xgetbv(0) & 6) == 6;   // AVX and OS saves YMM registers
+    bool avx2 = false;
+    if (avx && maxleaf >= 7)  __cpuidex (info, 7, 0),  avx2 = (info[1] >> 5) & 1;
+    return avx2? SIMD_AVX2 : sse2? SIMD_SSE2 : SIMD_NONE;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2")? SIMD_AVX2 : __builtin_cpu_supports("sse2")? SIMD_SSE2 : SIMD_NONE;
+#endif
+#else
+    return SIMD_NONE;
+#endif
+}
+
+// Detected once per module; concurrent first calls just compute the same value
+static int simd_level_cache = -1;
+static inline int simd_level()
+{
+    if (simd_level_cache < 0)  simd_level_cache = detect_simd_level();
+    return simd_level_cache;
+}
+
+
+// ****************************************************************************
+// DATA TABLE CANDIDATES (Tornado) ********************************************
+// ****************************************************************************
+
+// Quick check for data table with N-byte elements at p: the same byte at distance N,
+// and close values in the same column of next two rows, but the rows themselves aren't equal
+#define TABLE_CANDIDATE(N,p)                                                                        \
+    (   (p)[-1]==(p)[N-1]                                                                           \
+    &&  uint((p)[  N-1] - (p)[2*N-1] + 4) <= 2*4                                                    \
+    &&  uint((p)[2*N-1] - (p)[3*N-1] + 4) <= 2*4                                                    \
+    &&  !val32equ((p)+2*N-4, (p)+N-4)   )
+
+// Bitmask of TABLE_CANDIDATE(N,p+i) results for i=0..31.
+// Bytes from p-2 up to p+3*N+30 are read
+template <int N>
+static inline uint32 table_candidates_scalar (BYTE *p)
+{
+    uint32 mask = 0;
+    for (int i=0; i<32; i++)
+        if (TABLE_CANDIDATE (N, p+i))  mask |= 1u<<i;
+    return mask;
+}
+
+#ifdef FREEARC_SIMD
+template <int N>
+SIMD_TARGET("sse2") static uint32 table_candidates_sse2 (BYTE *p)
+{
+    uint32 mask = 0;  uint64 eq = 0;   // eq: bit i is set if p[i+N-4] == p[i+2*N-4]
+    const __m128i four = _mm_set1_epi8 (4);
+    for (int h=0; h<32; h+=16) {
+        BYTE *q = p+h;
+        __m128i a0 = _mm_loadu_si128 ((__m128i*)(q-1));
+        __m128i a1 = _mm_loadu_si128 ((__m128i*)(q+N-1));
+        __m128i a2 = _mm_loadu_si128 ((__m128i*)(q+2*N-1));
+        __m128i a3 = _mm_loadu_si128 ((__m128i*)(q+3*N-1));
+        // |a1-a2| <= 4 is checked as min(|a1-a2|,4) == |a1-a2|
+        __m128i d1 = _mm_or_si128 (_mm_subs_epu8 (a1,a2), _mm_subs_epu8 (a2,a1));
+        __m128i d2 = _mm_or_si128 (_mm_subs_epu8 (a2,a3), _mm_subs_epu8 (a3,a2));
+        __m128i ok = _mm_and_si128 (_mm_cmpeq_epi8 (a0,a1),
+                     _mm_and_si128 (_mm_cmpeq_epi8 (_mm_min_epu8 (d1,four), d1),
+                                    _mm_cmpeq_epi8 (_mm_min_epu8 (d2,four), d2)));
+        mask |= uint32 (_mm_movemask_epi8 (ok)) << h;
+        eq   |= uint64 (_mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_loadu_si128 ((__m128i*)(q+N-4)), _mm_loadu_si128 ((__m128i*)(q+2*N-4))))) << h;
+        eq   |= uint64 (_mm_movemask_epi8 (_mm_cmpeq_epi8 (a1,a2))) << (h+3);
+    }
+    // Rows are equal if 4 successive bytes are equal
+    return mask & ~uint32 (eq & eq>>1 & eq>>2 & eq>>3);
+}
+
+template <int N>
+SIMD_TARGET("avx2") static uint32 table_candidates_avx2 (BYTE *p)
+{
+    const __m256i four = _mm256_set1_epi8 (4);
+    __m256i a0 = _mm256_loadu_si256 ((__m256i*)(p-1));
+    __m256i a1 = _mm256_loadu_si256 ((__m256i*)(p+N-1));
+    __m256i a2 = _mm256_loadu_si256 ((__m256i*)(p+2*N-1));
+    __m256i a3 = _mm256_loadu_si256 ((__m256i*)(p+3*N-1));
+    __m256i d1 = _mm256_or_si256 (_mm256_subs_epu8 (a1,a2), _mm256_subs_epu8 (a2,a1));
+    __m256i d2 = _mm256_or_si256 (_mm256_subs_epu8 (a2,a3), _mm256_subs_epu8 (a3,a2));
+    __m256i ok = _mm256_and_si256 (_mm256_cmpeq_epi8 (a0,a1),
+                 _mm256_and_si256 (_mm256_cmpeq_epi8 (_mm256_min_epu8 (d1,four), d1),
+                                   _mm256_cmpeq_epi8 (_mm256_min_epu8 (d2,four), d2)));
+    uint32 mask = _mm256_movemask_epi8 (ok);
+    uint64 eq   = uint32 (_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (_mm256_loadu_si256 ((__m256i*)(p+N-4)), _mm256_loadu_si256 ((__m256i*)(p+2*N-4)))));
+    eq         |= uint64 (uint32 (_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (a1,a2)))) << 3;
+    return mask & ~uint32 (eq & eq>>1 & eq>>2 & eq>>3);
+}
+#endif
+
+template <int N>
+static inline uint32 table_candidates (BYTE *p)
+{
+#ifdef FREEARC_SIMD
+    switch (simd_level()) {
+    case SIMD_AVX2:  return table_candidates_avx2<N> (p);
+    case SIMD_SSE2:  return table_candidates_sse2<N> (p);
+    }
+#endif
+    return table_candidates_scalar<N> (p);
+}
+
+// Caches TABLE_CANDIDATE results for 32 successive positions, so that positions visited by
+// the compression cycle are checked by a single bit test. Should be invalidated each time data
+// in the buffer are modified (table diffed, new data read or old data shifted)
+struct TableCandidates
+{
+    BYTE   *base[2];   // First position covered by mask[] for N=2 and N=4, or NULL
+    uint32  mask[2];
+
+    TableCandidates()  {invalidate();}
+    void invalidate()  {base[0] = base[1] = NULL;}
+
+    template <int N>
+    bool check (BYTE *p)
+    {
+        const int i = N/4;
+        if (base[i]==NULL  ||  p < base[i]  ||  p >= base[i]+32)
+            base[i] = p,  mask[i] = table_candidates<N> (p);
+        return (mask[i] >> (p-base[i])) & 1;
+    }
+};
+
+
+// ****************************************************************************
+// ROW SIZE STATISTICS (Delta) ************************************************
+// ****************************************************************************
+
+// Maximum distance counted by table_distance_stats()
+#define TABLE_MAX_DIST 30
+
+// Fill count[d-1], d=1..TABLE_MAX_DIST with the number of positions in the 32-byte line
+// whose nearest preceding byte with the same 4 higher bits is d bytes back.
+// Preceding bytes are searched in the line itself and in prev[0..31] - contents of the previous
+// line as it was scanned, which ends gap bytes before the line. prev==NULL means no previous line.
+// In the 64-byte window used below the line occupies positions 32..63, so prev[j] is at j-gap
+static inline void table_distance_stats_scalar (BYTE *line, BYTE *prev, int gap, BYTE *count)
+{
+    int last[16];  iterate_var(i,16)  last[i] = -TABLE_MAX_DIST-1;   // Last position of each 4 higher bits value (line starts at 32)
+    iterate_var(i,TABLE_MAX_DIST)  count[i] = 0;
+    if (prev)
+        for (int i=0; i+gap<32; i++)  last[prev[i+gap]>>4] = i;
+    for (int i=32; i<64; i++) {
+        int v = line[i-32]>>4,  n = i - last[v];
+        last[v] = i;
+        if (n<=TABLE_MAX_DIST)  count[n-1]++;
+    }
+}
+
+#ifdef FREEARC_SIMD
+// SIMD versions build 64-byte window: the previous line and the line itself with lower 4 bits cleared,
+// and sentinel value 1 (that's never equal to x&0xF0) at positions outside of the previous line.
+// The previous line is shifted by gap bytes through tmp[], whose upper half holds sentinels.
+// Then each distance is checked for all 32 positions at once
+SIMD_TARGET("sse2") static void table_distance_stats_sse2 (BYTE *line, BYTE *prev, int gap, BYTE *count)
+{
+    const __m128i hi = _mm_set1_epi8 (BYTE(0xF0)),  one = _mm_set1_epi8 (1),  zero = _mm_setzero_si128();
+    BYTE win[64], tmp[64];
+    _mm_storeu_si128 ((__m128i*)(win),    one);
+    _mm_storeu_si128 ((__m128i*)(win+16), one);
+    if (prev && gap<32) {
+        _mm_storeu_si128 ((__m128i*)(tmp),    _mm_and_si128 (_mm_loadu_si128 ((__m128i*)(prev)),    hi));
+        _mm_storeu_si128 ((__m128i*)(tmp+16), _mm_and_si128 (_mm_loadu_si128 ((__m128i*)(prev+16)), hi));
+        _mm_storeu_si128 ((__m128i*)(tmp+32), one);
+        _mm_storeu_si128 ((__m128i*)(tmp+48), one);
+        _mm_storeu_si128 ((__m128i*)(win),    _mm_loadu_si128 ((__m128i*)(tmp+gap)));
+        _mm_storeu_si128 ((__m128i*)(win+16), _mm_loadu_si128 ((__m128i*)(tmp+gap+16)));
+    }
+    __m128i l0 = _mm_and_si128 (_mm_loadu_si128 ((__m128i*)(line)),    hi);
+    __m128i l1 = _mm_and_si128 (_mm_loadu_si128 ((__m128i*)(line+16)), hi);
+    _mm_storeu_si128 ((__m128i*)(win+32), l0);
+    _mm_storeu_si128 ((__m128i*)(win+48), l1);
+    __m128i seen0 = zero,  seen1 = zero;   // Positions whose nearest match was already found at smaller distance
+    for (int d=1; d<=TABLE_MAX_DIST; d++) {
+        __m128i eq0 = _mm_cmpeq_epi8 (l0, _mm_loadu_si128 ((__m128i*)(win+32-d)));
+        __m128i eq1 = _mm_cmpeq_epi8 (l1, _mm_loadu_si128 ((__m128i*)(win+48-d)));
+        // Number of new matches: 0..2 per byte, summed by psadbw
+        __m128i sum = _mm_sad_epu8 (_mm_add_epi8 (_mm_andnot_si128 (seen0, _mm_and_si128 (eq0, one)),
+                                                  _mm_andnot_si128 (seen1, _mm_and_si128 (eq1, one))),  zero);
+        count[d-1] = _mm_cvtsi128_si32 (sum) + _mm_extract_epi16 (sum, 4);
+        seen0 = _mm_or_si128 (seen0, eq0);
+        seen1 = _mm_or_si128 (seen1, eq1);
+    }
+}
+
+SIMD_TARGET("avx2,popcnt") static void table_distance_stats_avx2 (BYTE *line, BYTE *prev, int gap, BYTE *count)
+{
+    const __m256i hi = _mm256_set1_epi8 (BYTE(0xF0)),  one = _mm256_set1_epi8 (1);
+    BYTE win[64], tmp[64];
+    _mm256_storeu_si256 ((__m256i*)(win), one);
+    if (prev && gap<32) {
+        _mm256_storeu_si256 ((__m256i*)(tmp),    _mm256_and_si256 (_mm256_loadu_si256 ((__m256i*)(prev)), hi));
+        _mm256_storeu_si256 ((__m256i*)(tmp+32), one);
+        _mm256_storeu_si256 ((__m256i*)(win),    _mm256_loadu_si256 ((__m256i*)(tmp+gap)));
+    }
+    __m256i l = _mm256_and_si256 (_mm256_loadu_si256 ((__m256i*)(line)), hi);
+    _mm256_storeu_si256 ((__m256i*)(win+32), l);
+    uint32 seen = 0;
+    for (int d=1; d<=TABLE_MAX_DIST; d++) {
+        uint32 m = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (l, _mm256_loadu_si256 ((__m256i*)(win+32-d))));
+        count[d-1] = _mm_popcnt_u32 (m & ~seen);
+        seen |= m;
+    }
+}
+#endif
+
+static inline void table_distance_stats (BYTE *line, BYTE *prev, int gap, BYTE *count)
+{
+#ifdef FREEARC_SIMD
+    switch (simd_level()) {
+    case SIMD_AVX2:  table_distance_stats_avx2 (line, prev, gap, count);  return;
+    case SIMD_SSE2:  table_distance_stats_sse2 (line, prev, gap, count);  return;
+    }
+#endif
+    table_distance_stats_scalar (line, prev, gap, count);
+}
+
+
+// ****************************************************************************
+// MATCH EXTENSION (REP, LZP, Tornado) ****************************************
+// ****************************************************************************
+
+// Index of the lowest/highest set bit of x!=0
+static inline int lowest_bit64 (uint64 x)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    if (_BitScanForward (&i, uint32(x)))  return i;
+    _BitScanForward (&i, uint32(x>>32));   return i+32;
+#else
+    return __builtin_ctzll (x);
+#endif
+}
+
+static inline int highest_bit64 (uint64 x)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    if (_BitScanReverse (&i, uint32(x>>32)))  return i+32;
+    _BitScanReverse (&i, uint32(x));           return i;
+#else
+    return 63 - __builtin_clzll (x);
+#endif
+}
+
+// Length of the common prefix of p[0..limit) and q[0..limit)
+static inline size_t match_len_scalar (BYTE *p, BYTE *q, size_t limit)
+{
+    size_t len = 0;
+    for (; len+8 <= limit; len+=8) {
+        uint64 x = value64(p+len) ^ value64(q+len);
+        if (x)  return len + lowest_bit64(x)/8;
+    }
+    while (len<limit && p[len]==q[len])  len++;
+    return len;
+}
+
+// Length of the common suffix of p[-limit..0) and q[-limit..0)
+static inline size_t match_len_back_scalar (BYTE *p, BYTE *q, size_t limit)
+{
+    size_t len = 0;
+    for (; len+8 <= limit; len+=8) {
+        uint64 x = value64(p-len-8) ^ value64(q-len-8);
+        if (x)  return len + (63-highest_bit64(x))/8;
+    }
+    while (len<limit && p[-1-len]==q[-1-len])  len++;
+    return len;
+}
+
+#ifdef FREEARC_SIMD
+SIMD_TARGET("sse2") static size_t match_len_sse2 (BYTE *p, BYTE *q, size_t limit)
+{
+    size_t len = 0;
+    for (; len+16 <= limit; len+=16) {
+        uint32 eq = _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_loadu_si128 ((__m128i*)(p+len)), _mm_loadu_si128 ((__m128i*)(q+len))));
+        if (eq != 0xFFFF)  return len + lowest_bit64 (~eq & 0xFFFF);
+    }
+    return len + match_len_scalar (p+len, q+len, limit-len);
+}
+
+SIMD_TARGET("sse2") static size_t match_len_back_sse2 (BYTE *p, BYTE *q, size_t limit)
+{
+    size_t len = 0;
+    for (; len+16 <= limit; len+=16) {
+        uint32 eq = _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_loadu_si128 ((__m128i*)(p-len-16)), _mm_loadu_si128 ((__m128i*)(q-len-16))));
+        if (eq != 0xFFFF)  return len + 15 - highest_bit64 (~eq & 0xFFFF);
+    }
+    return len + match_len_back_scalar (p-len, q-len, limit-len);
+}
+
+SIMD_TARGET("avx2") static size_t match_len_avx2 (BYTE *p, BYTE *q, size_t limit)
+{
+    size_t len = 0;
+    for (; len+32 <= limit; len+=32) {
+        uint32 eq = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (_mm256_loadu_si256 ((__m256i*)(p+len)), _mm256_loadu_si256 ((__m256i*)(q+len))));
+        if (eq != 0xFFFFFFFF)  return len + lowest_bit64 (~eq);
+    }
+    return len + match_len_scalar (p+len, q+len, limit-len);
+}
+
+SIMD_TARGET("avx2") static size_t match_len_back_avx2 (BYTE *p, BYTE *q, size_t limit)
+{
+    size_t len = 0;
+    for (; len+32 <= limit; len+=32) {
+        uint32 eq = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (_mm256_loadu_si256 ((__m256i*)(p-len-32)), _mm256_loadu_si256 ((__m256i*)(q-len-32))));
+        if (eq != 0xFFFFFFFF)  return len + 31 - highest_bit64 (uint32(~eq));
+    }
+    return len + match_len_back_scalar (p-len, q-len, limit-len);
+}
+#endif
+
+// Length of the common prefix of p[0..limit) and q[0..limit), i.e. how far match at q may be extended forward from p.
+// Most matches are short, so the first 8 bytes are compared before dispatching to the vector code
+static inline size_t match_len (BYTE *p, BYTE *q, size_t limit)
+{
+    if (limit < 8)  return match_len_scalar (p, q, limit);
+    uint64 x = value64(p) ^ value64(q);
+    if (x)  return lowest_bit64(x)/8;
+#ifdef FREEARC_SIMD
+    switch (simd_level()) {
+    case SIMD_AVX2:  return 8 + match_len_avx2 (p+8, q+8, limit-8);
+    case SIMD_SSE2:  return 8 + match_len_sse2 (p+8, q+8, limit-8);
+    }
+#endif
+    return 8 + match_len_scalar (p+8, q+8, limit-8);
+}
+
+// Length of the common suffix of p[-limit..0) and q[-limit..0), i.e. how far match at q may be extended backward from p
+static inline size_t match_len_back (BYTE *p, BYTE *q, size_t limit)
+{
+    if (limit < 8)  return match_len_back_scalar (p, q, limit);
+    uint64 x = value64(p-8) ^ value64(q-8);
+    if (x)  return (63-highest_bit64(x))/8;
+#ifdef FREEARC_SIMD
+    switch (simd_level()) {
+    case SIMD_AVX2:  return 8 + match_len_back_avx2 (p-8, q-8, limit-8);
+    case SIMD_SSE2:  return 8 + match_len_back_sse2 (p-8, q-8, limit-8);
+    }
+#endif
+    return 8 + match_len_back_scalar (p-8, q-8, limit-8);
+}
+
+// ****************************************************************************
+// MOVE-TO-FRONT LIST (GRZip MTF) *********************************************
+// ****************************************************************************
+
+// Position of c in the list of all 256 byte values
+static inline int rank_find_scalar (BYTE *list, BYTE c)
+{
+    int i = 0;
+    while (list[i] != c)  i++;
+    return i;
+}
+
+#ifdef FREEARC_SIMD
+SIMD_TARGET("sse2") static int rank_find_sse2 (BYTE *list, BYTE c)
+{
+    const __m128i v = _mm_set1_epi8 (c);
+    for (int i=0; ; i+=16) {
+        uint32 eq = _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_loadu_si128 ((__m128i*)(list+i)), v));
+        if (eq)  return i + lowest_bit64 (eq);
+    }
+}
+
+SIMD_TARGET("avx2") static int rank_find_avx2 (BYTE *list, BYTE c)
+{
+    const __m256i v = _mm256_set1_epi8 (c);
+    for (int i=0; ; i+=32) {
+        uint32 eq = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (_mm256_loadu_si256 ((__m256i*)(list+i)), v));
+        if (eq)  return i + lowest_bit64 (eq);
+    }
+}
+#endif
+
+// Rank of c in the move-to-front list. Recent bytes are near the list head, so the first 4 positions are checked before dispatching to the vector code
+static inline int rank_find (BYTE *list, BYTE c)
+{
+    if (list[0]==c)  return 0;
+    if (list[1]==c)  return 1;
+    if (list[2]==c)  return 2;
+    if (list[3]==c)  return 3;
+#ifdef FREEARC_SIMD
+    switch (simd_level()) {
+    case SIMD_AVX2:  return rank_find_avx2 (list, c);
+    case SIMD_SSE2:  return rank_find_sse2 (list, c);
+    }
+#endif
+    return rank_find_scalar (list, c);
+}
+
+#endif // FREEARC_SIMD_H
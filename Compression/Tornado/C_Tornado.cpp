@@ -12,27 +12,64 @@ extern "C" {
 TORNADO_METHOD::TORNADO_METHOD()
 {
   m = std_Tornado_method [default_Tornado_method];
+  dictionary[0] = '\0';
+  context = NULL;
+  keep_context = FALSE;
+}
+
+//   Tornado    
+static void free_tornado_dictionary (void *cache)
+{
+  tor_free_dictionary ((TornadoDictionary*) cache);
+}
+
+//     .  Tornado (   
+//     )    .
+//   ,       
+static Mutex tornado_dictionary_lock;
+static TornadoDictionary *find_tornado_dictionary (char *name)
+{
+  COMPRESSION_DICTIONARY *d = FindCompressionDictionary (name);
+  if (!d)  return NULL;
+  Lock _(tornado_dictionary_lock);
+  if (!d->cache) {
+    d->cache      = tor_load_dictionary (d->data, d->size);
+    d->free_cache = free_tornado_dictionary;
+  }
+  return d->free_cache == free_tornado_dictionary?  (TornadoDictionary*) d->cache : NULL;
 }
 
 //  
 int TORNADO_METHOD::decompress (CALLBACK_FUNC *callback, void *auxdata)
 {
-  return tor_decompress (callback, auxdata);
+  TornadoDictionary *dict = NULL;
+  if (*dictionary && !(dict = find_tornado_dictionary (dictionary)))   return FREEARC_ERRCODE_INVALID_COMPRESSOR;
+  LargePagesScope large_pages (m.large_pages);
+  return tor_decompress (callback, auxdata, dict);
 }
 
 #ifndef FREEARC_DECOMPRESS_ONLY
 
-//  
+//  .      (doit "KeepContext"), ,    
+//    ,    compress (,  CompressMem)     
+//   .       
 int TORNADO_METHOD::compress (CALLBACK_FUNC *callback, void *auxdata)
 {
-  return tor_compress (m, callback, auxdata);
+  PackMethod m1 = m;
+  if (*dictionary && !(m1.dictionary = find_tornado_dictionary (dictionary)))   return FREEARC_ERRCODE_INVALID_COMPRESSOR;
+  if (keep_context && !context && !(context = tor_create_context()))              return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
+  m1.context = keep_context? context : NULL;
+  return tor_compress (m1, callback, auxdata);
 }
 
 //       
 void TORNADO_METHOD::SetDictionary (MemSize dict)
 {
   if (dict>0) {
-    if (dict < m.buffer)
+    if (m.caching_finder==8)
+      //  :  8      
+      m.hashsize  =  mymin (uint64(roundup_to_power_of(dict,2)) * 8,  2*gb);
+    else if (dict < m.buffer)
       //   :   ,        
       m.hashsize  =  sizeof(PtrVal)  *  mymin (m.hashsize/sizeof(PtrVal), roundup_to_power_of(dict,2));
     else
@@ -48,12 +85,13 @@ void TORNADO_METHOD::SetDictionary (MemSize dict)
 }
 
 //   buf[MAX_METHOD_STRLEN] ,       (,   parse_TORNADO)
-void TORNADO_METHOD::ShowCompressionMethod (char *buf)
+void TORNADO_METHOD::ShowCompressionMethod (char *buf, bool purify)
 {
-    struct PackMethod defaults = std_Tornado_method[m.number];  char NumStr[100], BufferStr[100], HashSizeStr[100], TempHashSizeStr[100], RowStr[100], EncStr[100], ParserStr[100], StepStr[100], TableStr[100], TempAuxHashSizeStr[100], AuxHashSizeStr[100], AuxRowStr[100];
+    struct PackMethod defaults = std_Tornado_method[m.number];  char NumStr[100], BufferStr[100], HashSizeStr[100], TempHashSizeStr[100], RowStr[100], EncStr[100], ParserStr[100], StepStr[100], TableStr[100], TempAuxHashSizeStr[100], AuxHashSizeStr[100], AuxRowStr[100], TempBlockSizeStr[100], BlockSizeStr[100], LargePagesStr[100], DictStr[MAX_METHOD_STRLEN+2];
     showMem (m.buffer,       BufferStr);
     showMem (m.hashsize,     TempHashSizeStr);
     showMem (m.auxhash_size, TempAuxHashSizeStr);
+    showMem (m.block_size,   TempBlockSizeStr);
     sprintf (NumStr,         m.number            != default_Tornado_method?     ":%d"    : "", m.number);
     sprintf (HashSizeStr,    m.hashsize          != defaults.hashsize?          ":h%s"   : "", TempHashSizeStr);
     sprintf (RowStr,         m.hash_row_width    != defaults.hash_row_width?    ":l%d"   : "", m.hash_row_width);
@@ -63,7 +101,10 @@ void TORNADO_METHOD::ShowCompressionMethod (char *buf)
     sprintf (TableStr,       m.find_tables       != defaults.find_tables?       ":t%d"   : "", m.find_tables);
     sprintf (AuxHashSizeStr, m.auxhash_size      != defaults.auxhash_size?      ":ah%s"  : "", TempAuxHashSizeStr);
     sprintf (AuxRowStr,      m.auxhash_row_width != defaults.auxhash_row_width? ":al%d"  : "", m.auxhash_row_width);
-    sprintf (buf, "tor%s:%s%s%s%s%s%s%s%s%s", NumStr, BufferStr, HashSizeStr, RowStr, EncStr, ParserStr, StepStr, TableStr, AuxHashSizeStr, AuxRowStr);
+    sprintf (BlockSizeStr,   m.block_size        != defaults.block_size?        ":m%s"   : "", TempBlockSizeStr);
+    sprintf (LargePagesStr,  m.large_pages       != LARGE_PAGES_DEFAULT && !purify? ":lp%d" : "", m.large_pages);
+    sprintf (DictStr,        *dictionary?                                   ":d%s"   : "", dictionary);
+    sprintf (buf, "tor%s:%s%s%s%s%s%s%s%s%s%s%s%s", NumStr, BufferStr, HashSizeStr, RowStr, EncStr, ParserStr, StepStr, TableStr, AuxHashSizeStr, AuxRowStr, BlockSizeStr, LargePagesStr, DictStr);
 }
 
 #endif  // !defined (FREEARC_DECOMPRESS_ONLY)
@@ -85,11 +126,16 @@ COMPRESSION_METHOD* parse_TORNADO (char** parameters)
       switch (*param) {                    // ,  
         case 'b': p->m.buffer          = parseMem (param+1, &error); continue;
         case 'h': p->m.hashsize        = parseMem (param+1, &error); continue;
-        case 'l': p->m.hash_row_width  = parseInt (param+1, &error); continue;
+        case 'l': if (param[1]=='p')  {p->m.large_pages = parseInt (param+2, &error);   //  lp
+                                       if (p->m.large_pages >= LARGE_PAGES_MODES)  error=1;
+                                       continue;}
+                  p->m.hash_row_width  = parseInt (param+1, &error); continue;
         case 'c': p->m.encoding_method = parseInt (param+1, &error); continue;
         case 'p': p->m.match_parser    = parseInt (param+1, &error); continue;
         case 'u': p->m.update_step     = parseInt (param+1, &error); continue;
         case 't': p->m.find_tables     = parseInt (param+1, &error); continue;
+        case 'm': p->m.block_size      = parseMem (param+1, &error); continue;
+        case 'd': if (param[1])  {strncopy (p->dictionary, param+1, sizeof(p->dictionary)); continue;}  else break;
         case 'a': switch (param[1]) {      //  ah/al
                     case 'h': p->m.auxhash_size       = parseMem (param+2, &error); continue;
                     case 'l': p->m.auxhash_row_width  = parseInt (param+2, &error); continue;
@@ -1,7 +1,8 @@
 #include "../Compression.h"
 
 int tor_compress   (PackMethod m, CALLBACK_FUNC *callback, void *auxdata);
-int tor_decompress (CALLBACK_FUNC *callback, void *auxdata);
+int tor_decompress (CALLBACK_FUNC *callback, void *auxdata, TornadoDictionary *dict);
+int tor_decompress_at (void *data, uint64 datasize, uint64 offset, void *out, int outsize);
 
 
 #ifdef __cplusplus
@@ -11,13 +12,22 @@ class TORNADO_METHOD : public COMPRESSION_METHOD
 {
 public:
   struct PackMethod m;      //    
+  char dictionary [MAX_METHOD_STRLEN];   //   ,  LoadCompressionDictionary ("" -  )
+  TornadoContext *context;  // ,  ,       compress (   )
+  bool keep_context;        //     compress (  "KeepContext",   )
 
   // ,       
   TORNADO_METHOD();
-  //  :      "VeryFast?"    1-4
+  virtual ~TORNADO_METHOD()  {tor_free_context (context);}
+  //  :      "VeryFast?"    1-4,
+  //  "KeepContext"  (param!=0)       compress
   virtual int doit (char *what, int param, void *data, CALLBACK_FUNC *callback)
   {
-      if (strequ (what,"VeryFast?"))  return m.hash_row_width<=2;
+      if (strequ (what,"VeryFast?"))    return m.hash_row_width<=2;
+      else if (strequ (what,"KeepContext")) {
+        keep_context = (param!=0);
+        if (!keep_context)  {tor_free_context (context);  context = NULL;}
+        return FREEARC_OK;}
       else return COMPRESSION_METHOD::doit (what, param, data, callback);
   }
 
@@ -27,10 +37,10 @@ public:
   virtual int compress   (CALLBACK_FUNC *callback, void *auxdata);
 
   //   buf[MAX_METHOD_STRLEN] ,       (,   parse_TORNADO)
-  virtual void ShowCompressionMethod (char *buf);
+  virtual void ShowCompressionMethod (char *buf, bool purify);
 
   // /  ,   /,     
-  virtual MemSize GetCompressionMem     (void)         {return m.hashsize + m.buffer + tornado_compressor_outbuf_size(m.buffer);}
+  virtual MemSize GetCompressionMem     (void)         {return m.block_size? tornado_mt_compression_mem(m) : tornado_hash_mem(m,m.hashsize)*(*dictionary? 2:1) + m.buffer + tornado_compressor_outbuf_size(m.buffer);}
   virtual MemSize GetDictionary         (void)         {return m.buffer;}
   virtual MemSize GetBlockSize          (void)         {return 0;}
   virtual void    SetCompressionMem     (MemSize mem)  {if (mem>0)   m.hashsize = 1<<lb(mem/3), m.buffer=mem-m.hashsize;}
@@ -38,7 +48,7 @@ public:
   virtual void    SetDictionary         (MemSize dict);
   virtual void    SetBlockSize          (MemSize bs)   {}
 #endif
-  virtual MemSize GetDecompressionMem   (void)         {return m.buffer;}
+  virtual MemSize GetDecompressionMem   (void)         {return m.block_size? tornado_mt_decompression_mem(m) : m.buffer;}
 };
 
 //     TORNADO
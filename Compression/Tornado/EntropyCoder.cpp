@@ -16,6 +16,9 @@ enum CodecDirection {Encoder, Decoder};
 // Masks out higher bits of x leaving only n lower ones
 #define mask(x,n) ((x) & ((1<<(n))-1))
 
+// Prices (estimated sizes of encoded data, used by optimal parser) are measured in 1/PRICE_SCALE bit units
+#define PRICE_SCALE 16
+
 
 // Byte-aligned I/O streams ***********************************************************************
 
@@ -31,17 +34,20 @@ struct OutputByteStream
     BYTE          *anchor;    // Marked position in output buffer. Shifted synchronous to buffer contents
     UINT          chunk;      // How many bytes should be written at least in each "write" call
     int           errcode;
+    bool          own_buf;    // Buffer was allocated by the stream itself
 
-    // chunk - how many bytes should be written each time, at least
-    // pad   - how many bytes may be put to buffer between flush()/putbuf() calls
-    OutputByteStream (CALLBACK_FUNC *_callback, void *_auxdata, UINT _chunk, UINT pad)
+    // chunk  - how many bytes should be written each time, at least
+    // pad    - how many bytes may be put to buffer between flush()/putbuf() calls
+    // outbuf - buffer of bufsize(chunk,pad) bytes provided by caller in order to reuse it between streams (NULL - allocate new one)
+    OutputByteStream (CALLBACK_FUNC *_callback, void *_auxdata, UINT _chunk, UINT pad, BYTE *outbuf=NULL)
     {
-        callback = _callback;  auxdata = _auxdata;  chunk = _chunk;
-        // Add 512 bytes for LZ77_ByteCoder (its LZSS scheme needs to overwrite old flag words) and 4096 for rounding written chunks
-        last_qwrite = output = buf = (byte*) BigAlloc (chunk+pad+512+4096);
+        callback = _callback;  auxdata = _auxdata;  chunk = _chunk;  own_buf = (outbuf==NULL);
+        last_qwrite = output = buf = own_buf? (byte*) BigAlloc (bufsize(chunk,pad)) : outbuf;
         errcode = buf==NULL?  FREEARC_ERRCODE_NOT_ENOUGH_MEMORY : FREEARC_OK;
     }
-    ~OutputByteStream()       {BigFree(buf);}
+    ~OutputByteStream()       {if (own_buf)  BigFree(buf);}
+    // Buffer size: add 512 bytes for LZ77_ByteCoder (its LZSS scheme needs to overwrite old flag words) and 4096 for rounding written chunks
+    static UINT bufsize (UINT chunk, UINT pad)  {return chunk+pad+512+4096;}
     // Returns error code if there was any problems in stream work
     int error()               {return errcode;}
     // Drop/use anchor which marks place in buffer
@@ -160,7 +166,7 @@ struct OutputBitStream : OutputByteStream
     int    bitcount; // Count of lower bits already filled in current bitbuf
 
     // Init and finish bit stream
-    OutputBitStream (CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad);
+    OutputBitStream (CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad, BYTE *outbuf=NULL);
     void finish();
 
     // Write n lower bits of x
@@ -194,8 +200,8 @@ struct OutputBitStream : OutputByteStream
 #define eat_at_start 0
 #define eat_at_end   0
 
-OutputBitStream::OutputBitStream (CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad)
-    : OutputByteStream (callback, auxdata, chunk, pad)
+OutputBitStream::OutputBitStream (CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad, BYTE *outbuf)
+    : OutputByteStream (callback, auxdata, chunk, pad, outbuf)
 {
     bitbuf   = 0;
     bitcount = CHAR_BIT*eat_at_start;
@@ -221,11 +227,20 @@ struct InputBitStream : InputByteStream
     // Initialize bit stream
     InputBitStream (CALLBACK_FUNC *callback, void *auxdata, UINT bufsize);
 
-    // Ensure that bitbuf contains at least n valid bits (n<=32)
+    // Ensure that bitbuf contains at least 56 valid bits. It's done without branches by reading 64 bits
+    // and consuming only whole bytes that fit into bitbuf; remaining bits of the last byte read
+    // are placed above bitcount and will be OR'ed with the same values on the next refill
+    void refill()
+    {
+        fill();
+        bitbuf   |= value64(input) << bitcount;
+        input    += (63-bitcount) >> 3;
+        bitcount |= 56;
+    }
+    // Ensure that bitbuf contains at least n valid bits (n<=56)
     uint needbits (int n)
     {
-        if (bitcount<=32)
-            bitbuf |= uint64(get32()) << bitcount, bitcount+=32;
+        refill();
         return mask(bitbuf,n);
     }
     // Throw out n used bits
@@ -255,6 +270,13 @@ InputBitStream::InputBitStream (CALLBACK_FUNC *callback, void *auxdata, UINT buf
 #define MAXHUF    2048  /* maximum number of elements allowed in huffman tree */
 #define FAST_BITS 11    /* symbols with shorter codes (<=FAST_BITS bits) are decoded much faster */
 
+// Entries of fast_index[]: first symbol, second symbol+1 (0 if there is no second symbol) and total code length.
+// Second symbol is added by HuffmanDecoder when short literal code is followed by another short code
+#define fast_entry(x,y1,nbits)  ((x) + ((y1)<<11) + ((nbits)<<23))
+#define fast_symbol(e)          ((e) & 2047)
+#define fast_second(e)          ((((e)>>11) & 4095) - 1)    /* second symbol or -1 */
+#define fast_bits(e)            ((e)>>23)
+
 // This structure used for intermediate data when building huffman tree
 struct Node {uint32 cnt, code; uint16 left, right; uint8 bits;};
 // Simplified Node structure, saving counter in higher bits and index in lower ones (in order to allow stable sorting by counter!)
@@ -275,10 +297,11 @@ struct HuffmanTree
     uint   counter[MAXHUF];           // Symbol counters used to build huffman tree
                                       // Built huffman tree:
     int    maxbits;                   //   Maximum number of bits in any code of current table
+    int    minbits;                   //   Minimum number of bits in any code of current table
     int    maxbits_so_far;            //   Maximum maxbits encountered so far
     uint8  bits[MAXHUF];              //   Number of bits for each symbol
     uint32 code[MAXHUF];              //   Code (bit sequence) for each symbol
-    int    fast_index[1<<FAST_BITS];  //   Direct decoding table for short codes (<=FAST_BITS)
+    int    fast_index[1<<FAST_BITS];  //   Direct decoding table for short codes (<=FAST_BITS), see fast_entry()
     uint16 *index;                    //   Direct decoding table for long codes
 
     HuffmanTree (CodecDirection _type, int _n);
@@ -294,7 +317,7 @@ struct HuffmanTree
         // value (flagged by x<0) then we decode using maxbits input bits
         // via index[] table which guarantees single-meaning decoding
         int x = fast_index[mask(code,FAST_BITS)];
-        return x>=0? x : index[code];
+        return x>=0? fast_symbol(x) : index[code];
     }
 };
 
@@ -407,6 +430,7 @@ void HuffmanTree::build_tree (int rescale_mode)
     } else {
         // Use symbol with smallest frequency to determine maximum number of bits in any code
         maxbits = buf[0].bits;
+        minbits = buf[b-1].bits;
         // 'index' table should contain at least 1<<maxbits elements
         if (maxbits > maxbits_so_far) {
             maxbits_so_far = maxbits;
@@ -417,11 +441,12 @@ void HuffmanTree::build_tree (int rescale_mode)
             UINT sbits = buf[i].bits;
             UINT scode = buf[i].code;
             bits[s] = sbits;
+            code[s] = scode;   // Used by HuffmanDecoder to find literals followed by short codes
             // For decoder we fill index[] table used to decode symbols using first 'maxbits' of input
             // (it is always possible because maxbits is a maximum number of bits in any code)
             // We also fill fast_index[] table used to decode short codes
             if (sbits<=FAST_BITS) {
-                iterate_var(j, 1<<(FAST_BITS-sbits))   fast_index [scode + (j<<sbits)] = s;
+                iterate_var(j, 1<<(FAST_BITS-sbits))   fast_index [scode + (j<<sbits)] = fast_entry (s, 0, sbits);
             } else {
                 fast_index[mask(scode,FAST_BITS)] = -1;
                 iterate_var(j, 1<<(maxbits-sbits))     index [scode + (j<<sbits)] = s;
@@ -454,8 +479,8 @@ struct HuffmanEncoder : OutputBitStream
     HuffmanTree  huf;           // Huffman tree used to encode symbols
     int          remainder;     // Count symbols remaining before huffman tree rebuild
 
-    HuffmanEncoder (CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad, int n)
-        : OutputBitStream (callback,auxdata,chunk,pad), huf(Encoder,n) {remainder=HUFBLOCKSIZE/4;}
+    HuffmanEncoder (CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad, int n, BYTE *outbuf=NULL)
+        : OutputBitStream (callback,auxdata,chunk,pad,outbuf), huf(Encoder,n) {remainder=HUFBLOCKSIZE/4;}
 
     // Encode symbol and count it in huffman tree
     void encode (UINT x)
@@ -470,6 +495,14 @@ struct HuffmanEncoder : OutputBitStream
         huf.Inc (x);
         putbits (huf.bits[x], huf.code[x]);
     }
+
+#ifndef FREEARC_DECOMPRESS_ONLY
+    // Estimated price of encoding symbol x (used by optimal parser)
+    uint price (UINT x)
+    {
+        return huf.bits[x] * PRICE_SCALE;
+    }
+#endif
 };
 
 // Decode symbols using huffman coder
@@ -478,18 +511,53 @@ struct HuffmanDecoder : InputBitStream
 {
     HuffmanTree  huf;           // Huffman tree used to decode symbols
 
+    int          pending;       // Second symbol decoded by the last table lookup (-1 if none)
+
     HuffmanDecoder (CALLBACK_FUNC *callback, void *auxdata, UINT bufsize, int n)
-        : InputBitStream (callback, auxdata, bufsize), huf(Decoder,n) {}
+        : InputBitStream (callback, auxdata, bufsize), huf(Decoder,n)  {pending = -1;  pair_short_codes();}
+
+    // Symbols 0..255 are LZ77 literals that are never followed by extra bits, so the next code
+    // immediately follows them. For literals with short codes we add to fast_index[] the symbol
+    // decoded from the remaining bits, when its code fits into FAST_BITS too and it's not EOB.
+    // Only literals whose codes leave room for the shortest code are checked, so it's much cheaper
+    // than rescanning whole table on each tree rebuild
+    void pair_short_codes()
+    {
+        iterate_var(x,256) {
+            UINT xbits = huf.bits[x];
+            if (xbits+huf.minbits > FAST_BITS)  continue;
+            iterate_var(j, 1<<(FAST_BITS-xbits)) {
+                int e = huf.fast_index[j];            // Entry for the code formed by remaining bits
+                if (e<0)  continue;
+                UINT y = fast_symbol(e);
+                if (y!=EOB  &&  xbits+huf.bits[y] <= FAST_BITS)
+                    huf.fast_index [huf.code[x] + (j<<xbits)] = fast_entry (x, y+1, xbits+huf.bits[y]);
+            }
+        }
+    }
 
     // Decode symbol and count it in huffman tree
     UINT decode()
     {
         UINT x;
+        if (pending >= 0) {
+            x = pending,  pending = -1;
+            huf.Inc (x);
+            return x;
+        }
         while (1) {
-            x = huf.Decode (needbits (huf.maxbits));
-            dumpbits (huf.bits[x]);
+            refill();
+            int e = huf.fast_index [mask(bitbuf,FAST_BITS)];
+            if (e >= 0) {
+                x = fast_symbol(e),  pending = fast_second(e);
+                dumpbits (fast_bits(e));
+            } else {
+                x = huf.index [mask(bitbuf,huf.maxbits)];
+                dumpbits (huf.bits[x]);
+            }
             if (x != EOB) break;
             huf.build_tree (getbits(3));  // Rebuild huffman tree on EOB code
+            pair_short_codes();
         }
         huf.Inc (x);
         return x;
@@ -522,8 +590,8 @@ private:
   }
 
 public:
-  TRangeCoder (CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad) :
-    OutputByteStream (callback, auxdata, chunk, pad),
+  TRangeCoder (CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad, BYTE *outbuf=NULL) :
+    OutputByteStream (callback, auxdata, chunk, pad, outbuf),
     low(0), range(0xffffffff), buffer(0), help(0) {}
 
   void Encode(unsigned int cum, unsigned int cnt, unsigned int bits) {
@@ -661,13 +729,27 @@ void TCounter<type> :: Rescale ()
 
 // Semi-adaptive arithmetic coder ******************************************************************
 
+#ifndef FREEARC_DECOMPRESS_ONLY
+// Prices of symbols indexed by their counters: ari_price.x[cnt] = log2(RANGE/cnt) * PRICE_SCALE
+struct AriPriceTable
+{
+    uint16 x[RANGE+1];
+    AriPriceTable()
+    {
+        x[0] = RANGE_BITS * PRICE_SCALE;
+        for (int cnt=1; cnt<=RANGE; cnt++)
+            x[cnt] = uint16 (log (double(RANGE)/cnt) / log(2.0) * PRICE_SCALE + 0.5);
+    }
+} ari_price;
+#endif
+
 template <int EOB>
 struct ArithCoder : TRangeCoder
 {
     TCounter<Encoder> c;   // Provides stats about symbol frequencies
 
-    ArithCoder (CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad, int n)
-        : TRangeCoder (callback,auxdata,chunk,pad), c(n) {}
+    ArithCoder (CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad, int n, BYTE *outbuf=NULL)
+        : TRangeCoder (callback,auxdata,chunk,pad,outbuf), c(n) {}
 
     // Encode symbol x using TCounter stats
     void encode (UINT x)
@@ -690,6 +772,14 @@ struct ArithCoder : TRangeCoder
         x>>=15, n-=15;
         Encode (mask(x,n), 1, n);
     }
+
+#ifndef FREEARC_DECOMPRESS_ONLY
+    // Estimated price of encoding symbol x (used by optimal parser)
+    uint price (UINT x)
+    {
+        return ari_price.x [c.cnt[x]];
+    }
+#endif
 };
 
 
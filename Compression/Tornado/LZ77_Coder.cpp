@@ -21,7 +21,7 @@ struct LZ77_ByteCoder : OutputByteStream
     int chars, matches2, matches3, matches4;
 
     // Init and finish encoder
-    LZ77_ByteCoder (int coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad);
+    LZ77_ByteCoder (int coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad, BYTE *outbuf=NULL);
     void finish();
 
     void shift_occurs() {}   // Called after shifting buffer contents to the beginning
@@ -63,6 +63,19 @@ struct LZ77_ByteCoder : OutputByteStream
         return 1;
     }
 
+#ifndef FREEARC_DECOMPRESS_ONLY
+    // Prices of literal/match encoding (used by optimal parser). This coder doesn't support repeated distances
+    int  prevdist (int i)                        {return -1;}
+    uint literal_price (byte *current, int rep0) {return (8+2) * PRICE_SCALE;}
+    uint match_price (int len, int dist, int repcode, const int MINLEN)
+    {
+        dist++;
+        return (len<MINLEN+16 && dist<(1<<12)?  16+2 :
+                len<MINLEN+64 && dist<(1<<18)?  24+2 :
+                32+2 + (dist>=(1<<24)? 16:0) + (len-MINLEN>=254? 32:0))  *  PRICE_SCALE;
+    }
+#endif
+
     static const bool support_tables = FALSE;
     // Send info about diffed table. type=1..4 and len is number of table elements
     void encode_table (int type, int len)
@@ -71,8 +84,8 @@ struct LZ77_ByteCoder : OutputByteStream
     }
 };
 
-LZ77_ByteCoder::LZ77_ByteCoder (int coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad)
-    : OutputByteStream (callback, auxdata, chunk, pad)
+LZ77_ByteCoder::LZ77_ByteCoder (int coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad, BYTE *outbuf)
+    : OutputByteStream (callback, auxdata, chunk, pad, outbuf)
 {
     chars = matches2 = matches3 = matches4 = 0;
     // Start a flags business
@@ -274,7 +287,7 @@ struct LZ77_BitCoder : OutputBitStream
 #endif
 
     // Init and finish encoder
-    LZ77_BitCoder (int coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad);
+    LZ77_BitCoder (int coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad, BYTE *outbuf=NULL);
     void finish();
 
     void shift_occurs() {}   // Called after shifting buffer contents to the beginning
@@ -312,6 +325,16 @@ struct LZ77_BitCoder : OutputBitStream
         return 1;
     }
 
+#ifndef FREEARC_DECOMPRESS_ONLY
+    // Prices of literal/match encoding (used by optimal parser). This coder doesn't support repeated distances
+    int  prevdist (int i)                        {return -1;}
+    uint literal_price (byte *current, int rep0) {return 9 * PRICE_SCALE;}
+    uint match_price (int len, int dist, int repcode, const int MINLEN)
+    {
+        return (9 + lc.extra_bits(lc.code(len-MINLEN)) + dc.extra_bits(dc.code(dist+1)))  *  PRICE_SCALE;
+    }
+#endif
+
     static const bool support_tables = FALSE;
     // Send info about diffed table. type=1..4 and len is number of table elements
     void encode_table (int type, int len)
@@ -320,8 +343,8 @@ struct LZ77_BitCoder : OutputBitStream
     }
 };
 
-LZ77_BitCoder::LZ77_BitCoder (int coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad)
-    : OutputBitStream (callback, auxdata, chunk, pad)
+LZ77_BitCoder::LZ77_BitCoder (int coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad, BYTE *outbuf)
+    : OutputBitStream (callback, auxdata, chunk, pad, outbuf)
 {
 #ifdef STAT
     iterate_var(i,8)   lencnt[i]  = 0;
@@ -408,7 +431,7 @@ struct LZ77_Coder : public Coder
     int prevdist3, prevdist2, prevdist1, prevdist0;  // last distances encoded so far
 
     // Init and finish encoder
-    LZ77_Coder (int coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad);
+    LZ77_Coder (int coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad, BYTE *outbuf=NULL);
     void finish();
 
     // Called after shifting buffer contents to the beginning
@@ -473,6 +496,29 @@ struct LZ77_Coder : public Coder
         Coder::putlowerbits (dbits, dist-dbase);
     }
 
+#ifndef FREEARC_DECOMPRESS_ONLY
+    // Returns i-th of the last distances encoded so far (-1 if it is unknown)
+    int prevdist (int i)
+    {
+        return i==0? prevdist0 : i==1? prevdist1 : i==2? prevdist2 : prevdist3;
+    }
+    // Price of literal encoding, provided that rep0 is the last distance encoded (used by optimal parser)
+    uint literal_price (byte *current, int rep0)
+    {
+        return Coder::price (rep0>=0 && *current == current[-rep0-1]?  REPCHAR : *current);
+    }
+    // Price of match encoding, repcode>=0 means that dist is equal to prevdist(repcode) (used by optimal parser)
+    uint match_price (int len, int dist, int repcode, const int MINLEN)
+    {
+        uint dcode, dbits;
+        if (repcode>=0)  dcode = repcode, dbits = 0;
+        else             dcode = dc.code(dist), dbits = dc.extra_bits(dcode), dcode += REPDIST_CODES;
+        if ((len-=MINLEN) > 100)  len += 4;
+        uint lcode = lc2.code(len);
+        return Coder::price (256 + dcode*elements(extra_lbits2) + lcode)  +  (lc2.extra_bits(lcode) + dbits) * PRICE_SCALE;
+    }
+#endif
+
     static const bool support_tables = TRUE;
     // Send info about diffed table. type=1..4 and len is number of table elements
     void encode_table (int type, int len)
@@ -482,8 +528,8 @@ struct LZ77_Coder : public Coder
 };
 
 template <class Coder>
-LZ77_Coder<Coder> :: LZ77_Coder (int coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad) :
-    Coder (callback, auxdata, chunk, pad, CODES)
+LZ77_Coder<Coder> :: LZ77_Coder (int coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad, BYTE *outbuf) :
+    Coder (callback, auxdata, chunk, pad, CODES, outbuf)
 {
 #ifdef STAT
     chars = matches = rep0s = 0;
@@ -581,118 +627,3 @@ struct LZ77_Decoder : Decoder
     }
 };
 
-
-// Dynamic coder (selects at run-time between byte/bit/huffman/ari coders) ************************
-struct LZ77_DynamicCoder
-{
-    bool support_tables;
-    int coder;
-    LZ77_ByteCoder                         coder1;
-    LZ77_BitCoder                          coder2;
-    LZ77_Coder<HuffmanEncoder<EOB_CODE> >  coder3;
-    LZ77_Coder<ArithCoder<EOB_CODE> >      coder4;
-
-    // Init and finish encoder
-    LZ77_DynamicCoder (int _coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad);
-    void finish()
-    {
-        switch (coder)
-        {
-        case 1: return coder1.finish();
-        case 2: return coder2.finish();
-        case 3: return coder3.finish();
-        case 4: return coder4.finish();
-        }
-    }
-
-    void shift_occurs()
-    {
-        switch (coder)
-        {
-        case 1: return coder1.shift_occurs();
-        case 2: return coder2.shift_occurs();
-        case 3: return coder3.shift_occurs();
-        case 4: return coder4.shift_occurs();
-        }
-    }
-
-    // Writes match/literal into output. Returns 0 - literal encoded, 1 - match encoded
-    int encode (int len, byte *current, byte *match, const int MINLEN)
-    {
-        switch (coder)
-        {
-        case 1: return coder1.encode (len, current, match, MINLEN);
-        case 2: return coder2.encode (len, current, match, MINLEN);
-        case 3: return coder3.encode (len, current, match, MINLEN);
-        case 4: return coder4.encode (len, current, match, MINLEN);
-        }
-    }
-
-    // Send info about diffed table. type=1..4 and len is number of table elements
-    void encode_table (int type, int len);
-
-    int error()
-    {
-        switch (coder)
-        {
-        case 1: return coder1.error();
-        case 2: return coder2.error();
-        case 3: return coder3.error();
-        case 4: return coder4.error();
-        }
-    }
-
-    void put8 (uint c)
-    {
-        switch (coder)
-        {
-        case 1: return coder1.put8(c);
-        case 2: return coder2.put8(c);
-        case 3: return coder3.put8(c);
-        case 4: return coder4.put8(c);
-        }
-    }
-
-    void put32 (uint c)
-    {
-        switch (coder)
-        {
-        case 1: return coder1.put32(c);
-        case 2: return coder2.put32(c);
-        case 3: return coder3.put32(c);
-        case 4: return coder4.put32(c);
-        }
-    }
-
-    void flush()
-    {
-        switch (coder)
-        {
-        case 1: return coder1.flush();
-        case 2: return coder2.flush();
-        case 3: return coder3.flush();
-        case 4: return coder4.flush();
-        }
-    }
-};
-
-LZ77_DynamicCoder::LZ77_DynamicCoder (int _coder, CALLBACK_FUNC *callback, void *auxdata, UINT chunk, UINT pad):
-    coder1 (_coder, callback, auxdata, _coder==1? chunk : 0, pad),
-    coder2 (_coder, callback, auxdata, _coder==2? chunk : 0, pad),
-    coder3 (_coder, callback, auxdata, _coder==3? chunk : 0, pad),
-    coder4 (_coder, callback, auxdata, _coder==4? chunk : 0, pad)
-{
-    coder = _coder;
-    support_tables = (coder>=3);
-}
-
-void LZ77_DynamicCoder::encode_table (int type, int len)
-{
-    switch (coder)
-    {
-    case 1: return coder1.encode_table (type, len);
-    case 2: return coder2.encode_table (type, len);
-    case 3: return coder3.encode_table (type, len);
-    case 4: return coder4.encode_table (type, len);
-    }
-}
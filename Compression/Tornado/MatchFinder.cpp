@@ -11,6 +11,12 @@ typedef uint32 HintVal;      // Cached bytes from buf stored in HTable
 // Also it's number of bytes reserved after bufend in order to simplify p+N<=bufend checks
 #define MAX_HASHED_BYTES 12
 
+// Hash rows are prefetched for strings located this number of bytes ahead of the current position,
+// so they are already in cache when searched (0 disables prefetching)
+#ifndef PREFETCH_DISTANCE
+#define PREFETCH_DISTANCE 16
+#endif
+
 
 #ifdef DEBUG
 void check_match (BYTE *p, BYTE *q, int len)
@@ -37,12 +43,33 @@ void print_match (int pos, int len, int dist)
 // Just for readability
 #define MINLEN       min_length()
 
+// Match returned by find_all_matches()
+struct Match
+{
+    UINT  len;             // Match length
+    BYTE *q;               // Match pointer
+};
+// Size of matches[] passed to find_all_matches(). Match finder stores at most 'limit' (>=1) matches,
+// when there is no more room, each next (longer) match replaces the last one
+#define MAX_MATCHES 1024
+
 // Checks that bigDist/64 is bigger than smallDist
 static inline bool ChangePair (uint smallDist, uint bigDist)
 {
     return (bigDist/64 > smallDist);
 }
 
+// find_all_matches() implementation for match finders that are able to find only the best match
+template <class MatchFinder>
+int find_best_match (MatchFinder &mf, BYTE *p, void *bufend, Match *matches, int limit)
+{
+    UINT len = mf.find_matchlen (p, bufend, 0);
+    if (len < mf.min_length())  return 0;
+    matches[0].len = len;
+    matches[0].q   = mf.get_matchptr();
+    return 1;
+}
+
 // Hash function hashing 4..7 bytes
 inline uint hashx (int len, BYTE *p, UINT HashShift, UINT HashMask = ~0)
 {
@@ -55,6 +82,12 @@ inline uint hashx (int len, BYTE *p, UINT HashShift, UINT HashMask = ~0)
     }
 }
 
+// Extend match at q whose first len bytes are known to be equal to p, up to bufend
+static inline UINT extend_match (BYTE *p, BYTE *q, UINT len, void *bufend)
+{
+    return p+len < (BYTE*)bufend?  len + match_len (p+len, q+len, (BYTE*)bufend-(p+len)) : len;
+}
+
 // Check match at q:len
 inline int accept_match (int len, BYTE *p, BYTE *q, void *bufend)
 {
@@ -71,6 +104,41 @@ inline int accept_match (int len, BYTE *p, BYTE *q, void *bufend)
 
 
 
+// ****************************************************************************
+// Match finder state may be restored from snapshot made after priming by preset dictionary.
+// Restoration is lazy: HTable is split into blocks of ROW_BLOCK entries, and only blocks holding
+// hash rows of data being compressed are copied (once per generation), so restoration cost
+// depends on amount of data rather than on hash size. Other rows keep outdated entries.
+// Small hashes are copied entirely since it's cheaper than hashing every string
+// ****************************************************************************
+
+#define ROW_BLOCK 16
+
+struct RestoredBlocks
+{
+    uint16 *tag;           // Generation in which each block of HTable was restored
+    uint16  generation;    // Current generation
+    UINT    blocks;
+
+    RestoredBlocks()  {tag = NULL;  generation = 0;  blocks = 0;}
+    ~RestoredBlocks() {free (tag);}
+    // Start new generation making all blocks unrestored (without tags every block is restored on each access)
+    void next (UINT _blocks)
+    {
+        if (!tag)  blocks = _blocks,  tag = (uint16*) calloc (blocks, sizeof(*tag));
+        if (++generation == 0  &&  tag)  memset (tag, 0, blocks * sizeof(*tag)),  generation = 1;
+    }
+    // Returns TRUE if block should be restored now
+    bool fresh (UINT block)
+    {
+        if (!tag)  return TRUE;
+        if (tag[block] == generation)  return FALSE;
+        tag[block] = generation;
+        return TRUE;
+    }
+};
+
+
 // ****************************************************************************
 // Abstract Match Finder class which defines codebase common for all concrete Match Finders
 // ****************************************************************************
@@ -80,8 +148,11 @@ struct BaseMatchFinder
     UINT HashSize, HashShift, HashMask;
     PtrVal *HTable;        // Hash table usd to quickly find matches
     BYTE *base;            // Base value (offsets to this ptr are stored in HTable)
+    PtrVal lowest;         // Offset of the first usable position in the window (smaller offsets are outdated hash entries)
     BYTE *q;               // Pointer to last match found
     int hash_row_width;
+    RestoredBlocks restored;  // Blocks of HTable restored from snapshot in current generation
+    PtrVal restore_delta;     // Difference between offsets of the same position in this match finder and snapshot
 
     // Empty contructor
     BaseMatchFinder() {};
@@ -91,8 +162,22 @@ struct BaseMatchFinder
     int error();
     // Called on initialization and when next data chunk read into NON-SLIDING buffer
     void clear_hash (BYTE *buf);
-    // Called after data was shifted 'shift' bytes backwards in SLIDING WINDOW buf[]
-    void shift (BYTE *buf, int shift);
+    // Called after window start was moved to buf and data were shifted 'shift' bytes backwards in SLIDING WINDOW
+    void shift (BYTE *buf, int shift, int stride=1);
+    // Start restoring state of match finder with the same parameters from snapshot whose window starts at frombuf
+    // (called after reset() of this match finder with window at buf). Rows of 'width' entries will be restored
+    // for 'strings' strings - if most blocks would be restored anyway, whole HTable is restored right now and FALSE is returned.
+    // 'rows' is the number of restoration tags (by default, one per ROW_BLOCK entries)
+    bool restore_start (BaseMatchFinder &from, BYTE *frombuf, BYTE *buf, UINT strings, UINT width, int stride=1, UINT rows=0);
+    // Restore width entries of hash row starting at HTable[row] (each 'stride' entry holds offset, other ones - cached data)
+    void restore_row (BaseMatchFinder &from, UINT row, UINT width, int stride=1);
+    void restore_entries (BaseMatchFinder &from, UINT start, UINT end, int stride);
+    // Convert offset stored in snapshot into offset of the same position in this match finder
+    PtrVal restore_offset (BaseMatchFinder &from, PtrVal x)  {return x >= from.lowest?  x + restore_delta : 0;}
+    // Forget all strings inserted so far, preparing to compress new data placed at buf. window is the maximum
+    // distance from window start to any position inserted into hash, see next_generation()
+    bool next_generation (BYTE *buf, uint window);
+    void reset (BYTE *buf, uint window)  {if (!next_generation (buf, window))  clear_hash (buf);}
     // Minimal length of matches returned by this Match Finder
     uint min_length()     {return 4;}
     // Returns pointer of last match found (length is returned by find_matchlen() itself)
@@ -101,23 +186,24 @@ struct BaseMatchFinder
     uint hash (uint x)    {return ((x*123456791) >> HashShift) & HashMask;}
     // Invalidate previously found match
     void invalidate_match ()   {}
-#ifdef FREEARC_64BIT
-    // Convert 32-bit value, stored in HTable, into pointer
-    BYTE *toPtr(PtrVal n) {return base+n;}
+    // Prefetch hash row that will be searched for string at p
+    void prefetch (BYTE *p)    {prefetch_data (HTable + hash(value(p)));}
+    // Convert 32-bit value, stored in HTable, into pointer.
+    // Outdated entries, pointing before the window start, are converted into pointer to its first usable position
+    BYTE *toPtr(PtrVal n) {return base + (n>lowest? n : lowest);}
     // And back
     PtrVal fromPtr(BYTE *p) {return p-base;}
-#else
-    // In 32-bit world
-    BYTE  *toPtr  (PtrVal n) {return (BYTE*) n;}
-    PtrVal fromPtr(BYTE  *p) {return (PtrVal) p;}
-#endif
 };
 
+// Offsets stored in HTable are rebased when window start goes this far from base
+#define MAX_BASE_DISTANCE (1u<<30)
+
 // This contructor is common for several match finder classes.
 // It allocs and inits HTable and inits Hash* fields
 BaseMatchFinder::BaseMatchFinder (BYTE *buf, int hashsize, int _hash_row_width, uint, int)
 {
     base      = buf;
+    lowest    = fromPtr(buf+1);
     hash_row_width = _hash_row_width;
     HashSize  = (1<<lb(hashsize)) / sizeof(*HTable);
     HashShift = 32-lb(HashSize);
@@ -134,15 +220,68 @@ int BaseMatchFinder::error()
 // Called when next data chunk read into NON-SLIDING buffer
 void BaseMatchFinder::clear_hash (BYTE *buf)
 {
-    if (HTable)  iterate_var(i,HashSize)  HTable[i] = fromPtr(buf+1);
+    lowest = fromPtr(buf+1);
+    if (HTable)  iterate_var(i,HashSize)  HTable[i] = lowest;
+}
+
+// Start restoring state of match finder with the same parameters from snapshot whose window starts at frombuf.
+// Snapshot offsets are translated so that they point to the same data in our window,
+// outdated ones are replaced by zero (it's outdated in any generation)
+bool BaseMatchFinder::restore_start (BaseMatchFinder &from, BYTE *frombuf, BYTE *buf, UINT strings, UINT width, int stride, UINT rows)
+{
+    restore_delta = PtrVal ((from.base - frombuf) - (base - buf));
+    if (uint64(strings) * mymax (width, ROW_BLOCK) >= HashSize)  {restore_entries (from, 0, HashSize, stride);  return FALSE;}
+    restored.next (rows? rows : (HashSize + ROW_BLOCK-1) / ROW_BLOCK);
+    return TRUE;
+}
+
+// Restore width entries of hash row starting at HTable[row], copying all blocks of the row that weren't restored yet.
+// Blocks start at even entries, so offsets and cached data are never mixed up
+void BaseMatchFinder::restore_row (BaseMatchFinder &from, UINT row, UINT width, int stride)
+{
+    for (UINT block = row/ROW_BLOCK;  block*ROW_BLOCK < row+width;  block++)
+        if (restored.fresh (block))
+            restore_entries (from, block*ROW_BLOCK, mymin ((block+1)*ROW_BLOCK, HashSize), stride);
 }
 
-// Called after data was shifted 'shift' bytes backwards in SLIDING WINDOW buf[]
-// We should make appropriate corrections in HTable. We set HTable entries minimum
-// to buf+1 because with lazy matching we can extend match found one byte backward
-void BaseMatchFinder::shift (BYTE *buf, int shift)
+void BaseMatchFinder::restore_entries (BaseMatchFinder &from, UINT start, UINT end, int stride)
 {
-    iterate_var(i,HashSize)  HTable[i]  =  HTable[i] > fromPtr(buf+shift)?  HTable[i]-shift : fromPtr(buf+1);
+    for (UINT i=start; i<end; i+=stride) {
+        HTable[i] = restore_offset (from, from.HTable[i]);
+        if (stride==2)  HTable[i+1] = from.HTable[i+1];
+    }
+}
+
+// Start new generation of hash entries, used when compressor is reused for independent data.
+// Instead of clearing HTable, we move base so that offsets of all positions inserted so far
+// become smaller than new 'lowest', i.e. outdated. Returns FALSE if offsets would grow too large -
+// in this case hash should be cleared as usual
+bool BaseMatchFinder::next_generation (BYTE *buf, uint window)
+{
+    PtrVal top = lowest + window;   // All offsets stored in HTable are smaller than this value
+    if (top >= MAX_BASE_DISTANCE)  {base = buf;  return FALSE;}
+    base   = buf+1 - top;
+    lowest = top;
+    return TRUE;
+}
+
+// Called after window start was moved to buf and data were shifted 'shift' bytes backwards in SLIDING WINDOW
+// (shift==0 when window slides over mirrored ring buffer without moving data). HTable entries are offsets
+// from base, so we just move base. Entries that are now pointing before buf+1 are converted by toPtr()
+// into buf+1 (not buf because with lazy matching we can extend match found one byte backward).
+// Once window start went too far from base, we subtract the distance from every entry (each 'stride' entry
+// of HTable holds offset, other ones - cached data) in order to avoid overflow of 32-bit offsets
+void BaseMatchFinder::shift (BYTE *buf, int shift, int stride)
+{
+    base  -= shift;
+    lowest = fromPtr(buf+1);
+    if (lowest >= MAX_BASE_DISTANCE) {
+        PtrVal delta = lowest-1;
+        for (int i=0; i<HashSize; i+=stride)
+            HTable[i]  =  HTable[i] > delta?  HTable[i]-delta : 0;
+        base   += delta;
+        lowest -= delta;
+    }
 }
 
 
@@ -163,14 +302,18 @@ struct MatchFinder1 : BaseMatchFinder
         UINT h = hash(value(p));
         q = toPtr(HTable[h]);  HTable[h] = fromPtr(p);
         if (val32equ(p, q)) {
-            UINT len;
-            for (len=MINLEN-1; p+len+4<bufend && val32equ(p+len, q+len); len+=4);
-            for (            ; p+len  <bufend && p[len] == q[len];       len++);
-            return len;
+            return extend_match (p, q, MINLEN-1, bufend);
         } else {
             return MINLEN-1;
         }
     }
+    int find_all_matches (byte *p, void *bufend, Match *matches, int limit)  {return find_best_match (*this, p, bufend, matches, limit);}
+    // Restore from snapshot hash rows of strings at [p,end)
+    void restore (MatchFinder1 &from, BYTE *frombuf, BYTE *buf, BYTE *p, BYTE *end)
+    {
+        if (restore_start (from, frombuf, buf, end-p, 1))
+            for (; p<end; p++)  restore_row (from, hash(value(p)), 1);
+    }
     void update_hash (BYTE *p, UINT len, UINT step)
     {
 // No hash update in fastest mode!
@@ -202,24 +345,28 @@ struct MatchFinder2 : BaseMatchFinder
         BYTE *q1 = toPtr (HTable[h+1]);   HTable[h+1] = HTable[h];
               q  = toPtr (HTable[h]);     HTable[h]   = fromPtr(p);
         if (val32equ(p, q)) {
-            for (len=MINLEN-1; p+len+4<bufend && val32equ(p+len, q+len); len+=4);
-            for (            ; p+len  <bufend && p[len] == q[len];       len++);
+            len = extend_match (p, q, MINLEN-1, bufend);
 
             if (p[len] == q1[len]) {
-                UINT len1;
-                for (len1=0; p+len1<bufend && p[len1]==q1[len1]; len1++);
+                UINT len1 = extend_match (p, q1, 0, bufend);
                 if (len1>len)  len=len1, q=q1;
             }
             return len;
         } else if (val32equ(p, q1)) {
             q=q1;
-            for (len=MINLEN-1; p+len+4<bufend && val32equ(p+len, q+len); len+=4);
-            for (            ; p+len  <bufend && p[len] == q[len];       len++);
+            len = extend_match (p, q, MINLEN-1, bufend);
             return len;
         } else {
             return MINLEN-1;
         }
     }
+    int find_all_matches (byte *p, void *bufend, Match *matches, int limit)  {return find_best_match (*this, p, bufend, matches, limit);}
+    // Restore from snapshot hash rows of strings at [p,end)
+    void restore (MatchFinder2 &from, BYTE *frombuf, BYTE *buf, BYTE *p, BYTE *end)
+    {
+        if (restore_start (from, frombuf, buf, end-p, 2))
+            for (; p<end; p++)  restore_row (from, hash(value(p)), 2);
+    }
 
     void update_hash (BYTE *p, UINT len, UINT step)
     {   // len may be as low as 1 if LazyMatching and Hash3 are used together
@@ -253,8 +400,7 @@ struct MatchFinderN : BaseMatchFinder
         q = toPtr(x0);
         // Start with checking first element of hash row
         if (val32equ(p, q)) {
-            for (len=MINLEN; p+len+4<=bufend && val32equ(p+len, q+len); len+=4);
-            for (          ; p+len  < bufend && p[len] == q[len];       len++);
+            len = extend_match (p, q, MINLEN, bufend);
             if (len==4 && p-q>=48*kb  ||
                 len==5 && p-q>=192*kb ||
                 len==6 && p-q>=1*mb)
@@ -266,8 +412,7 @@ struct MatchFinderN : BaseMatchFinder
             x1=HTable[h+j];  HTable[h+j]=x0;
             BYTE *q1 = toPtr(x1);
             if (val32equ(p+len+1-MINLEN, q1+len+1-MINLEN)) {
-                UINT len1;
-                for (len1=0;  p+len1<bufend && p[len1]==q1[len1];  len1++);
+                UINT len1 = extend_match (p, q1, 0, bufend);
                 if (len1==4 && p-q1>=48*kb  ||
                     len1==5 && p-q1>=192*kb ||
                     len1==6 && p-q1>=1*mb)
@@ -278,6 +423,14 @@ struct MatchFinderN : BaseMatchFinder
         }
         return len;
     }
+    int find_all_matches (byte *p, void *bufend, Match *matches, int limit)  {return find_best_match (*this, p, bufend, matches, limit);}
+    void prefetch (BYTE *p)  {prefetch_data (HTable + hashx (N, p, HashShift, HashMask));}
+    // Restore from snapshot hash rows of strings at [p,end)
+    void restore (MatchFinderN &from, BYTE *frombuf, BYTE *buf, BYTE *p, BYTE *end)
+    {
+        if (restore_start (from, frombuf, buf, end-p, hash_row_width))
+            for (; p<end; p++)  restore_row (from, hashx (N, p, HashShift, HashMask), hash_row_width);
+    }
 
     void update_hash1 (BYTE *p)
     {
@@ -326,6 +479,14 @@ struct ExactMatchFinder : BaseMatchFinder
         }
         return MINLEN-1;
     }
+    int find_all_matches (byte *p, void *bufend, Match *matches, int limit)  {return find_best_match (*this, p, bufend, matches, limit);}
+    void prefetch (BYTE *p)  {prefetch_data (HTable + hashx (N, p, HashShift, HashMask));}
+    // Restore from snapshot hash rows of strings at [p,end)
+    void restore (ExactMatchFinder &from, BYTE *frombuf, BYTE *buf, BYTE *p, BYTE *end)
+    {
+        if (restore_start (from, frombuf, buf, end-p, hash_row_width))
+            for (; p<end; p++)  restore_row (from, hashx (N, p, HashShift, HashMask), hash_row_width);
+    }
 
     void update_hash1 (BYTE *p)
     {
@@ -366,7 +527,9 @@ struct CachingMatchFinder : BaseMatchFinder
     ~CachingMatchFinder() {BigFree(HTable);}
 
     void clear_hash (BYTE *buf);
-    void shift (BYTE *buf, int shift);
+    void shift (BYTE *buf, int shift)  {BaseMatchFinder::shift (buf, shift, 2);}
+    // Outdated entries keep their cached keys, so output may slightly differ from output of MF with cleared hash
+    void reset (BYTE *buf, uint window)  {if (!next_generation (buf, window))  clear_hash (buf);}
 
     // Key value stored in hash for each string
     uint key (BYTE *p)
@@ -436,24 +599,27 @@ len6:   q = toPtr(x1);
 len7:   q = toPtr(x1);
         len = MINLEN-1;
         if (val32equ(p, q)) {
-            len = mymin(MINLEN-1, 4);
-            for (; p+len<bufend && val32equ(p+len, q+len); len+=4);
-            for (; p+len<bufend && p[len] == q[len];       len++);
+            len = extend_match (p, q, mymin(MINLEN-1, 4), bufend);
         }
 
         while (table!=tabend) {
             next_pair();
             BYTE *q1 = toPtr(x1);
             if (t == 0 && p[len] == q1[len] && val32equ(p, q1)) {
-                UINT len1 = mymin(MINLEN-1, 4);
-                for (; p+len1<bufend && val32equ(p+len1, q1+len1); len1+=4);
-                for (; p+len1<bufend && p[len1] == q1[len1];       len1++);
+                UINT len1 = extend_match (p, q1, mymin(MINLEN-1, 4), bufend);
                 if (len1>len)  len=len1, q=q1;
             }
         }
         return len;
 #undef next_pair
     }
+    int find_all_matches (byte *p, void *bufend, Match *matches, int limit)  {return find_best_match (*this, p, bufend, matches, limit);}
+    // Restore from snapshot hash rows of strings at [p,end)
+    void restore (CachingMatchFinder &from, BYTE *frombuf, BYTE *buf, BYTE *p, BYTE *end)
+    {
+        if (restore_start (from, frombuf, buf, end-p, hash_row_width*2, 2))
+            for (; p<end; p++)  restore_row (from, hash(value(p)), hash_row_width*2, 2);
+    }
 
     // Update half of hash row corresponding to string pointed by p
     // (hash updated via this procedure only when skipping match contents)
@@ -479,23 +645,17 @@ len7:   q = toPtr(x1);
 template <uint N>
 void CachingMatchFinder<N>::clear_hash (BYTE *buf)
 {
+    lowest = fromPtr(buf+1);
     if (HTable)
     {
         for (int i=0; i<HashSize; i+=2)
         {
-            HTable[i]   = fromPtr(buf+1);
+            HTable[i]   = lowest;
             HTable[i+1] = key(buf+1);
         }
     }
 }
 
-template <uint N>
-void CachingMatchFinder<N>::shift (BYTE *buf, int shift)
-{
-    for (int i=0; i<HashSize; i+=2)
-        HTable[i]  =  HTable[i] > fromPtr(buf+shift)?  HTable[i]-shift  :  fromPtr(buf+1);
-}
-
 
 // *****************************************************************************************************
 // One more caching match finder. This one doesn't shift data in hash rows, but keeps head index instead
@@ -511,7 +671,33 @@ struct CycledCachingMatchFinder : BaseMatchFinder
     ~CycledCachingMatchFinder()  {BigFree(Head); BigFree(HTable);}
 
     void clear_hash (BYTE *buf);
-    void shift (BYTE *buf, int shift);
+    void shift (BYTE *buf, int shift)  {BaseMatchFinder::shift (buf, shift, 2);}
+    // Restore from snapshot hash rows of strings at [p,end) together with their heads
+    void restore (CycledCachingMatchFinder &from, BYTE *frombuf, BYTE *buf, BYTE *p, BYTE *end)
+    {
+        // Only valid entries of the row are restored, usually it's much less than the row width
+        if (!restore_start (from, frombuf, buf, end-p, 2, 2, HeadSize))
+            {memcpy (Head, from.Head, HeadSize * sizeof(*Head));  return;}
+        for (; p<end; p++) {
+            UINT h = hashx(N,p,HashShift);
+            if (restored.fresh (h))  restore_chain (from, h);
+        }
+    }
+    // Restore entries of hash row h from its head up to the first outdated one, that ends the row search
+    void restore_chain (CycledCachingMatchFinder &from, UINT h)
+    {
+        PtrVal *row = HTable + h*hash_row_width*2,  *fromrow = from.HTable + h*hash_row_width*2;
+        UINT i = Head[h] = from.Head[h];
+        for (int j=0; j<hash_row_width; j++) {
+            PtrVal x = fromrow[i*2];
+            row[i*2]   = restore_offset (from, x);
+            row[i*2+1] = fromrow[i*2+1];
+            if (x < from.lowest)  break;
+            if (++i == hash_row_width)  i = 0;
+        }
+    }
+    // Row search stops at the first outdated entry, so Head[] may be left intact
+    void reset (BYTE *buf, uint window)  {if (!next_generation (buf, window))  clear_hash (buf);}
 
     // Key value stored in hash for each string
     uint key (BYTE *p)
@@ -536,9 +722,9 @@ struct CycledCachingMatchFinder : BaseMatchFinder
         // (there are five loops here - one used before any match is found,
         //  three are used when a match of size N/N+1/N+2 already found,
         //  and last one used when match of size >=N+3 already found)
-// Read next ptr/key pair from hash
+// Read next ptr/key pair from hash (row ends at empty or outdated entry - all entries after it are even older)
 #define next_pair()                                                    \
-            x1 = *table++;  if(!x1) break;                             \
+            x1 = *table++;  if(x1<lowest) break;                       \
             UINT v1 = *table++;                                        \
             if (table==rowend)  table = rowstart;                      \
             UINT t = v1 ^ key(p);
@@ -589,18 +775,14 @@ len6:   q = toPtr(x1);
 len7:   len = MINLEN-1;
         q = toPtr(x1);
         if (val32equ(p, q)) {
-            len = mymin(MINLEN-1, 4);
-            for (; p+len<bufend && val32equ(p+len, q+len); len+=4);
-            for (; p+len<bufend && p[len] == q[len];       len++);
+            len = extend_match (p, q, mymin(MINLEN-1, 4), bufend);
         }
 
         while (table!=tabend) {
             next_pair();
             BYTE *q1 = toPtr(x1);
             if (t == 0 && p[len] == q1[len] && val32equ(p, q1)) {
-                UINT len1 = mymin(MINLEN-1, 4);
-                for (; p+len1<bufend && val32equ(p+len1, q1+len1); len1+=4);
-                for (; p+len1<bufend && p[len1] == q1[len1];       len1++);
+                UINT len1 = extend_match (p, q1, mymin(MINLEN-1, 4), bufend);
                 if (len1>len  &&  !(len1==len+1 && ChangePair(p-q, p-q1)) )
                     len=len1, q=q1;
             }
@@ -609,6 +791,49 @@ len7:   len = MINLEN-1;
 #undef next_pair
     }
 
+    // Find all matches for the string pointed by p: each next match found is longer than previous ones.
+    // Unlike find_matchlen(), checks all strings in the hash row and doesn't reject far short matches
+    int find_all_matches (byte *p, void *bufend, Match *matches, int limit)
+    {
+        UINT h = hashx(N,p,HashShift);    // Hash key of string for which we perform match search
+        UINT i = (Head[h]  =  Head[h]==0?  hash_row_width-1  :  Head[h]-1);  // index of new head of this hash row
+        // Pointers to the current hash element and end of hash row
+        PtrVal *rowstart = HTable+h*hash_row_width*2,  *rowend = rowstart + hash_row_width*2;
+        PtrVal *table = rowstart + i*2,  *tabend = table;
+        // Save current ptr and its key to the first hash slot
+        *table++ = fromPtr(p);
+        *table++ = key(p);
+        if (table==rowend)  table = rowstart;
+
+        int n = 0;  UINT len = MINLEN-1;   // Number of matches and length of the longest match found so far
+        while (table!=tabend) {
+            PtrVal x1 = *table++;  if(x1<lowest) break;
+            UINT   v1 = *table++;
+            if (table==rowend)  table = rowstart;
+            BYTE *q1 = toPtr(x1);
+            // Key contains p[N-1..N+2], so its lower byte should be equal for any match of N+ bytes
+            if (((v1 ^ key(p)) & 0xff) == 0  &&  p[len] == q1[len]  &&  val32equ(p, q1)) {
+                // extend_match() returns 4 even if there are fewer bytes left before bufend
+                UINT len1 = mymin (extend_match (p, q1, 4, bufend), (BYTE*)bufend-p);
+                if (len1>len) {
+                    if (n==limit)  n--;
+                    len=len1, matches[n].len=len, matches[n].q=q1, n++;
+                }
+            }
+        }
+        return n;
+    }
+
+    // Prefetch hash row for string at p. Searching starts at the row head whose index is kept in Head[],
+    // so Head[] entry is prefetched PREFETCH_DISTANCE bytes further - it will be used by one of next calls
+    void prefetch (BYTE *p)
+    {
+        prefetch_data (Head + hashx(N,p+PREFETCH_DISTANCE,HashShift));
+        UINT h = hashx(N,p,HashShift);
+        UINT i = Head[h]==0?  hash_row_width-1  :  Head[h]-1;
+        prefetch_data (HTable + (h*hash_row_width+i)*2);
+    }
+
     // Update hash row corresponding to string pointed by p
     // (hash updated via this procedure only when skipping match contents)
     void update_hash1 (BYTE *p)
@@ -622,8 +847,10 @@ len7:   len = MINLEN-1;
     // Skip match starting from p with length len and update hash with strings using given step
     void update_hash (BYTE *p, UINT len, UINT step)
     {
-        for (int i=1; i<len; i++)
+        for (int i=1; i<len; i++) {
+            if (PREFETCH_DISTANCE)  prefetch (p+i+PREFETCH_DISTANCE);
             update_hash1 (p+i);
+        }
     }
     // Minimal length of matches returned by this Match Finder
     uint min_length()     {return N;}
@@ -652,17 +879,173 @@ CycledCachingMatchFinder<N>::CycledCachingMatchFinder (BYTE *buf, uint hashsize,
 template <uint N>
 void CycledCachingMatchFinder<N>::clear_hash (BYTE *buf)
 {
+    lowest = fromPtr(buf+1);
     if (HTable)  iterate_var(i,HashSize)  HTable[i]=0;
     if (Head)    iterate_var(i,HeadSize)  Head[i]=0;
 }
 
-template <uint N>
-void CycledCachingMatchFinder<N>::shift (BYTE *buf, int shift)
+
+
+// ****************************************************************************
+// Binary tree match finder (like LZMA's BT4). Strings with the same hash of their
+// first 4 bytes are kept in binary search tree ordered by string contents, so search
+// needs only logarithmic number of steps instead of checking every string in hash row.
+// Two children of each string are stored in cyclic array indexed by string position,
+// strings older than array size are dropped from the tree.
+// hashsize is the array size (8 bytes per position, hash heads take 1/4 of this
+// amount additionally), hash_row_width is maximum number of tree nodes checked
+// ****************************************************************************
+
+#define BT_NICE_LEN 64    /* Tree search stops at match of this length, which is then extended to the real length */
+
+struct BinaryTreeMatchFinder : BaseMatchFinder
+{
+    PtrVal *Tree;          // Offsets of smaller and larger child for each position in the cyclic array
+    UINT    TreeMask;      // Tree holds TreeMask+1 last positions
+    BYTE   *bufend;        // Data end used by the last search (it's also used when skipping match contents)
+
+    BinaryTreeMatchFinder (BYTE *buf, uint hashsize, int _hash_row_width, uint auxhash_size, int auxhash_row_width);
+    ~BinaryTreeMatchFinder()  {BigFree(Tree); BigFree(HTable);}
+
+    int  error()  {return HTable==NULL || Tree==NULL?  FREEARC_ERRCODE_NOT_ENOUGH_MEMORY : FREEARC_OK;}
+    void clear_hash (BYTE *buf);
+    void shift (BYTE *buf, int shift);
+    void restore (BinaryTreeMatchFinder &from, BYTE *frombuf, BYTE *buf, BYTE *p, BYTE *end);
+    // Tree search stops at outdated nodes, so Tree[] may be left intact
+    void reset (BYTE *buf, uint window)  {if (!next_generation (buf, window))  clear_hash (buf);}
+
+    // Insert string at p into the tree, searching for matches on the way. Each next match found is longer
+    // than previous ones, they are saved to matches[] unless it's NULL (at most 'maxcnt' ones, see MAX_MATCHES).
+    // Returns length of the longest match (limited by BT_NICE_LEN)
+    UINT insert (BYTE *p, Match *matches, int &n, int maxcnt=0)
+    {
+        if (bufend-p < MINLEN)  return MINLEN-1;     // Too close to the data end - string isn't inserted at all
+        UINT limit = mymin (bufend-p, BT_NICE_LEN);
+        UINT h = hashx (4, p, HashShift);
+        PtrVal cur = fromPtr(p),  x = HTable[h];  HTable[h] = cur;
+        // Where to link subtrees with strings smaller/larger than p, and common prefix of p with all strings in these subtrees
+        PtrVal *smaller = Tree + ((cur&TreeMask)<<1),  *larger = smaller+1;
+        UINT smallerlen = 0,  largerlen = 0,  len = MINLEN-1;
+
+        for (int depth=hash_row_width; ; ) {
+            // Tree ends at empty or outdated node (cur-x-1 also excludes p itself that may be inserted again after invalidate_match)
+            if (x < lowest  ||  cur-x-1 >= TreeMask  ||  depth-- == 0)  {*smaller = *larger = 0;  break;}
+            BYTE   *q1   = base + x;
+            PtrVal *pair = Tree + ((x&TreeMask)<<1);
+            UINT len1 = mymin (smallerlen, largerlen);
+            if (q1[len1] == p[len1]) {
+                if (++len1 < limit)  len1 += match_len (p+len1, q1+len1, limit-len1);
+                // Bytes before min(smallerlen,largerlen) aren't compared by tree search, but they may be changed
+                // since the string was inserted (when data table is diffed), so we recheck them for matches reported
+                if (len1 > len  &&  memcmp (p, q1, mymin (smallerlen, largerlen)) == 0) {
+                    len = len1,  q = q1;
+                    if (matches) {
+                        if (n==maxcnt)  n--;
+                        matches[n].len = len,  matches[n].q = q,  n++;
+                    }
+                }
+                if (len1 >= limit)  {*smaller = pair[0];  *larger = pair[1];  break;}
+            }
+            if (q1[len1] < p[len1])  {*smaller = x;  smaller = pair+1;  x = *smaller;  smallerlen = len1;}
+            else                     {*larger  = x;  larger  = pair;    x = *larger;   largerlen  = len1;}
+        }
+        return len;
+    }
+    // Extend match found beyond BT_NICE_LEN
+    UINT extend (BYTE *p, UINT len)
+    {
+        return len == BT_NICE_LEN?  extend_match (p, q, len, bufend) : len;
+    }
+
+    uint find_matchlen (byte *p, void *_bufend, UINT prevlen)
+    {
+        int n = 0;
+        bufend = (BYTE*)_bufend;
+        return extend (p, insert (p, NULL, n));
+    }
+    // Find all matches for the string pointed by p: each next match found is longer than previous ones
+    int find_all_matches (byte *p, void *_bufend, Match *matches, int limit)
+    {
+        int n = 0;
+        bufend = (BYTE*)_bufend;
+        UINT len = insert (p, matches, n, limit);
+        if (n)  matches[n-1].len = extend (p, len);
+        return n;
+    }
+
+    // Prefetch hash head for string PREFETCH_DISTANCE bytes further, and tree root for string at p (its head was prefetched earlier)
+    void prefetch (BYTE *p)
+    {
+        prefetch_data (HTable + hashx (4, p+PREFETCH_DISTANCE, HashShift));
+        PtrVal x = HTable[hashx (4, p, HashShift)];
+        prefetch_data (Tree + ((x&TreeMask)<<1));
+        prefetch_data (base + x);
+    }
+
+    // Skip match starting from p with length len: all strings inside the match should be inserted into tree
+    void update_hash (BYTE *p, UINT len, UINT step)
+    {
+        int n = 0;
+        for (int i=1; i<len; i++) {
+            if (PREFETCH_DISTANCE)  prefetch (p+i+PREFETCH_DISTANCE);
+            insert (p+i, NULL, n);
+        }
+    }
+};
+
+BinaryTreeMatchFinder::BinaryTreeMatchFinder (BYTE *buf, uint hashsize, int _hash_row_width, uint, int)
+{
+    base      = bufend = buf;
+    hash_row_width = _hash_row_width;
+    TreeMask  = (1 << lb (mymax (hashsize, 64*kb) / (sizeof(*Tree)*2))) - 1;
+    Tree      = (PtrVal*) BigAlloc ((TreeMask+1) * 2 * sizeof(*Tree));
+    HashSize  = (TreeMask+1) / 2;
+    HTable    = (PtrVal*) BigAlloc (HashSize * sizeof(*HTable));
+    HashShift = 32 - lb(HashSize);
+    HashMask  = ~0;
+    clear_hash (buf);
+}
+
+// Restore from snapshot hash heads of strings at [p,end). Any insertion may relink tree nodes of older strings,
+// so nodes of all dictionary strings (preceding p) are restored, that costs proportionally to dictionary size
+void BinaryTreeMatchFinder::restore (BinaryTreeMatchFinder &from, BYTE *frombuf, BYTE *buf, BYTE *p, BYTE *end)
+{
+    bool lazy    = restore_start (from, frombuf, buf, end-p, 1);
+    PtrVal last  = fromPtr(p) - restore_delta;                             // Snapshot offset of p
+    PtrVal first = last - mymin (last - from.lowest, TreeMask+1);          // Older nodes were overwritten in the cyclic array
+    for (PtrVal x = first; x < last; x++) {
+        PtrVal *pair = from.Tree + ((x&TreeMask)<<1),  *to = Tree + (((x+restore_delta)&TreeMask)<<1);
+        to[0] = restore_offset (from, pair[0]);
+        to[1] = restore_offset (from, pair[1]);
+    }
+    if (lazy)
+        for (; p<end; p++)  restore_row (from, hashx (4, p, HashShift), 1);
+}
+
+// Called on initialization and when next data chunk read into NON-SLIDING buffer.
+// Tree isn't cleared since nodes can be reached only from hash heads
+void BinaryTreeMatchFinder::clear_hash (BYTE *buf)
 {
-    for (int i=0; i<HashSize; i+=2)
-        HTable[i]  =  HTable[i] > fromPtr(buf+shift)?  HTable[i]-shift  :  0;
+    lowest = fromPtr(buf+1);
+    if (HTable)  iterate_var(i,HashSize)  HTable[i] = 0;
 }
 
+// The same as BaseMatchFinder::shift() except that tree is indexed by offset modulo its size,
+// so offsets are rebased by multiple of this size
+void BinaryTreeMatchFinder::shift (BYTE *buf, int shift)
+{
+    base  -= shift;
+    lowest = fromPtr(buf+1);
+    if (lowest >= MAX_BASE_DISTANCE) {
+        PtrVal delta = (lowest-1) & ~TreeMask;
+        iterate_var(i,HashSize)          HTable[i] = HTable[i] > delta?  HTable[i]-delta : 0;
+        iterate_var(i,(TreeMask+1)*2)    Tree[i]   = Tree[i]   > delta?  Tree[i]-delta   : 0;
+        base   += delta;
+        lowest -= delta;
+    }
+}
+
+
 
 // ****************************************************************************
 // This is MF transformer which makes lazy MF from ordinary one ***************
@@ -692,9 +1075,22 @@ struct LazyMatching
         nextq -= shift;
     }
 
+    void restore (LazyMatching &from, BYTE *frombuf, BYTE *buf, BYTE *p, BYTE *end)
+    {
+        mf.restore (from.mf, frombuf, buf, p, end);
+        nextlen = 0;
+    }
+
+    void reset (BYTE *buf, uint window)
+    {
+        mf.reset (buf, window);
+        nextlen = 0;
+    }
+
     int  error()          {return mf.error();}
     uint min_length()     {return mf.min_length();}
     byte *get_matchptr()  {return prevq;}
+    void prefetch (BYTE *p)  {mf.prefetch (p);}
 
     uint find_matchlen (byte *p, void *bufend, UINT _prevlen)
     {
@@ -771,6 +1167,8 @@ struct Hash3
     void clear_hash  (BYTE *buf);         // Clear all hash tables
     void clear_hash3 (BYTE *buf);         // Clear only its own hash tables
     void shift (BYTE *buf, int shift);
+    void restore (Hash3 &from, BYTE *frombuf, BYTE *buf, BYTE *p, BYTE *end);  // Restore state of Hash3 with the same parameters from snapshot
+    void reset (BYTE *buf, uint window);  // Start new generation of mf entries and clear own hash tables
 
     uint min_length()     {return 2;}
     byte *get_matchptr()  {return q;}
@@ -806,6 +1204,21 @@ struct Hash3
         return len;
     }
 
+    // Find 2/3-byte matches, then longer ones (at least one entry of matches[] is left for them)
+    int find_all_matches (byte *p, void *bufend, Match *matches, int limit)
+    {
+        int n = 0;
+        UINT h = hash2(value16(p));
+        BYTE *q2 = HTable2[h];  HTable2[h] = p;
+        if (p-q2<256 && p+2<=bufend && val16equ(p, q2) && n<limit-1)
+            matches[n].len=2, matches[n].q=q2, n++;
+        h = hash(value24(p));
+        BYTE *q3 = HTable[h];  HTable[h] = p;
+        if (p-q3<6*kb && p+3<=bufend && val24equ(p, q3) && n<limit-1)
+            matches[n].len=3, matches[n].q=q3, n++;
+        return n + mf.find_all_matches (p, bufend, matches+n, limit-n);
+    }
+
     void update_hash1 (BYTE *p)
     {
         UINT              h = hash(value24(p));  HTable[h]  = p;
@@ -824,6 +1237,13 @@ struct Hash3
     }
     // Invalidate previously found match
     void invalidate_match ()   {mf.invalidate_match();}
+    // Prefetch rows of all hashes for string at p
+    void prefetch (BYTE *p)
+    {
+        mf.prefetch (p);
+        prefetch_data (HTable  + hash (value24(p)));
+        prefetch_data (HTable2 + hash2(value16(p)));
+    }
 };
 
 template <class MatchFinder, int HASH3_LOG, int HASH2_LOG, bool FULL_UPDATE>
@@ -865,6 +1285,27 @@ void Hash3<MatchFinder, HASH3_LOG, HASH2_LOG, FULL_UPDATE> :: clear_hash3 (BYTE
     if (HTable2) iterate_var(i,HashSize2)  HTable2[i]=buf+1;
 }
 
+// Own tables are restored only for strings at [p,end) (other entries were cleared by reset()),
+// pointers into snapshot window are moved to our window
+template <class MatchFinder, int HASH3_LOG, int HASH2_LOG, bool FULL_UPDATE>
+void Hash3<MatchFinder, HASH3_LOG, HASH2_LOG, FULL_UPDATE> :: restore (Hash3 &from, BYTE *frombuf, BYTE *buf, BYTE *p, BYTE *end)
+{
+    mf.restore (from.mf, frombuf, buf, p, end);
+    for (; p<end; p++) {
+        UINT h = hash(value24(p));   HTable[h]  = buf + (from.HTable[h]  - frombuf);
+             h = hash2(value16(p));  HTable2[h] = buf + (from.HTable2[h] - frombuf);
+    }
+}
+
+// Own tables hold pointers rather than offsets, and outdated pointer may point after current position,
+// so they are cleared. That's cheap since they are small
+template <class MatchFinder, int HASH3_LOG, int HASH2_LOG, bool FULL_UPDATE>
+void Hash3<MatchFinder, HASH3_LOG, HASH2_LOG, FULL_UPDATE> :: reset (BYTE *buf, uint window)
+{
+    mf.reset (buf, window);
+    clear_hash3 (buf);
+}
+
 template <class MatchFinder, int HASH3_LOG, int HASH2_LOG, bool FULL_UPDATE>
 void Hash3<MatchFinder, HASH3_LOG, HASH2_LOG, FULL_UPDATE> :: shift (BYTE *buf, int shift)
 {
@@ -914,6 +1355,13 @@ struct CombineMF
         else        {q=q2; return len2;}
     }
 
+    // Return matches found by both match finders (at least one entry of matches[] is left for mf2)
+    int find_all_matches (byte *p, void *bufend, Match *matches, int limit)
+    {
+        int n = mf1.find_all_matches (p, bufend, matches, limit-1);
+        return n + mf2.find_all_matches (p, bufend, matches+n, limit-n);
+    }
+
     void clear_hash (BYTE *buf)
     {
         mf1.clear_hash (buf);
@@ -927,6 +1375,18 @@ struct CombineMF
         q -= shift;
     }
 
+    void restore (CombineMF &from, BYTE *frombuf, BYTE *buf, BYTE *p, BYTE *end)
+    {
+        mf1.restore (from.mf1, frombuf, buf, p, end);
+        mf2.restore (from.mf2, frombuf, buf, p, end);
+    }
+
+    void reset (BYTE *buf, uint window)
+    {
+        mf1.reset (buf, window);
+        mf2.reset (buf, window);
+    }
+
     void update_hash1 (BYTE *p)
     {
         mf1.update_hash1 (p);
@@ -945,6 +1405,12 @@ struct CombineMF
         mf2.invalidate_match();
     }
 
+    void prefetch (BYTE *p)
+    {
+        mf1.prefetch (p);
+        mf2.prefetch (p);
+    }
+
     int  error()          {return mymin (mf1.error(),      mf2.error());     }
     uint min_length()     {return mymin (mf1.min_length(), mf2.min_length());}
     byte *get_matchptr()  {return q;}
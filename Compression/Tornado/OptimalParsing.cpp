@@ -1,44 +1,242 @@
-main
+// (c) Bulat Ziganshin <Bulat.Ziganshin@gmail.com>
+// GPL'ed code of optimal (price-based) LZ77 parser
+
+// ****************************************************************************
+// This is MF transformer which makes optimal parser from ordinary MF. For each
+// window of up to OPTIMAL_WINDOW positions it:
+//   1. collects all matches at each position using mf.find_all_matches()
+//      plus matches at last distances (which are much cheaper to encode),
+//   2. finds the cheapest sequence of literals and matches to the window end
+//      using prices returned by the coder (dynamic programming over prices),
+//   3. returns this sequence, decision by decision, to the compression cycle.
+// Window is finished early when a match of OPTIMAL_NICE_LEN+ bytes is found -
+// such match is just accepted.
+// ****************************************************************************
+
+#define OPTIMAL_WINDOW   4096   /* maximum number of positions parsed at once */
+#define OPTIMAL_NICE_LEN 64     /* matches of this length are accepted without further analysis */
+
+// Compute last distances after a step: repcode<REPDIST_CODES means that dist is equal to the last distance #repcode,
+// repcode==REPDIST_CODES means literal, -1 - new distance. It's the same procedure as in LZ77_Coder::encode_match()
+static inline void update_dists (int *to, int *from, int dist, int repcode)
+{
+    switch (repcode) {
+    case 0:  to[0]=from[0], to[1]=from[1], to[2]=from[2], to[3]=from[3];  break;
+    case 1:  to[0]=from[1], to[1]=from[0], to[2]=from[2], to[3]=from[3];  break;
+    case 2:  to[0]=from[2], to[1]=from[0], to[2]=from[1], to[3]=from[3];  break;
+    case 3:  to[0]=from[3], to[1]=from[0], to[2]=from[1], to[3]=from[2];  break;
+    case REPDIST_CODES:
+             to[0]=from[0], to[1]=from[1], to[2]=from[2], to[3]=from[3];  break;
+    default: to[0]=dist,    to[1]=from[0], to[2]=from[1], to[3]=from[2];  break;
+    }
+}
+
+template <class MatchFinder, class Coder>
+struct OptimalParsing
 {
-    // 1.   
-    for (i=0; i<CHUNK; i++)
+    MatchFinder mf;
+    Coder *coder;             // Coder whose statistics are used to estimate prices (assigned by attach_coder)
+    BYTE  *buf;               // Window start (last distances can't point before it)
+    BYTE  *hashed_end;        // All positions before it are already inserted into hash
+    BYTE  *q;                 // Match pointer returned by the last find_matchlen() call
+    Match *matches;           // Matches found at current position
+
+    // Cheapest path to each position of the window: its price, last step (len==1 && q==NULL - literal) and last distances after this step
+    struct Position  {uint price; UINT len; BYTE *q; int dist[REPDIST_CODES];}  *pos;
+    // Decisions made for current window, in the encoding order
+    struct Decision  {BYTE *p; UINT len; BYTE *q;}  *plan;
+    int planned, next;        // Number of decisions in plan[] and index of the next one to return
+
+    OptimalParsing (BYTE *_buf, int hashsize, int hash_row_width, uint auxhash_size, int auxhash_row_width)
+        : mf (_buf, hashsize, hash_row_width, auxhash_size, auxhash_row_width)
     {
-        matches[i] = matchp;                  //        
-        matchp = fill_matches(buf,i,matchp);  //          
+        coder      = NULL;
+        buf        = hashed_end = _buf;
+        planned    = next = 0;
+        matches    = (Match*)    MidAlloc (sizeof(Match)    * MAX_MATCHES);
+        pos        = (Position*) MidAlloc (sizeof(Position) * (OPTIMAL_WINDOW+1));
+        plan       = (Decision*) MidAlloc (sizeof(Decision) * (OPTIMAL_WINDOW+1));
     }
-    // 1.5   matches   2/3- 
-    // 2.    
-    iterate (CHUNK, price[i]=INT_MAX);  price[0]=0;
-    for (i=0; i<CHUNK; i++)
+    ~OptimalParsing()  {MidFree(plan); MidFree(pos); MidFree(matches);}
+
+    int error()           {return matches && pos && plan?  mf.error() : FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;}
+    uint min_length()     {return mf.min_length();}
+    byte *get_matchptr()  {return q;}
+
+    void clear_hash (BYTE *_buf)
     {
-        suggest (i+1, 1, buf[i], price[i] + charPrice(buf[i]));  //    i+1   + 
-        lastlen = MINMATCH-1;
-        for (our matches)
-            while (++lastlen <= len)   //      .     (todo: if len>256,     128     )
-            {
-                // todo:       4 ,    ..
-                suggest (i+lastlen, lastlen, dist, price[i] + matchPrice(lastlen,dist)); //  =    +  
-            }
+        mf.clear_hash (_buf);
+        buf = hashed_end = _buf;
+        planned = next = 0;
     }
-    // 3.       
-    for (i=CHUNK-1; i; i-=len[i])
+
+    void shift (BYTE *_buf, int shift)
     {
-        push (len[i], dist[i]);
+        mf.shift (_buf, shift);
+        buf = _buf;
+        hashed_end = mymax (hashed_end-shift, _buf);
+        planned = next = 0;
     }
-    // 4.     
-    while (stack not empty)
+
+    // Strings before p were inserted into snapshot
+    void restore (OptimalParsing &from, BYTE *frombuf, BYTE *_buf, BYTE *p, BYTE *end)
+    {
+        mf.restore (from.mf, frombuf, _buf, p, end);
+        buf = _buf,  hashed_end = p;
+        planned = next = 0;
+    }
+
+    void reset (BYTE *_buf, uint window)
+    {
+        mf.reset (_buf, window);
+        buf = hashed_end = _buf;
+        planned = next = 0;
+    }
+
+    // Positions are prefetched by make_plan() itself, in the order they are searched
+    void prefetch (BYTE *p)  {}
+
+    // Data at current position were changed (table was diffed), so we should throw away our plans
+    void invalidate_match ()
+    {
+        mf.invalidate_match();
+        planned = next = 0;
+    }
+
+    // Return next decision of the plan, building new plan if required
+    uint find_matchlen (byte *p, void *bufend, UINT prevlen)
     {
-        len, dist = pop();
-        encode (len,dist);
+        if (next==planned  ||  plan[next].p != p)
+            make_plan (p, (BYTE*)bufend);
+        Decision &d = plan[next++];
+        q = d.q;
+        return d.len;
     }
+
+    // Insert into hash strings inside the match that weren't inserted while planning
+    void update_hash (BYTE *p, UINT len, UINT step)
+    {
+        if (p+len <= hashed_end)  return;
+        BYTE *start = mymax (p, hashed_end-1);
+        mf.update_hash (start, p+len-start, step);
+        hashed_end = p+len;
+    }
+
+    void make_plan (BYTE *p, BYTE *bufend);
+    int  prepare_matches (int n, BYTE *p, const UINT MINLEN);
+};
+
+// Sort matches by length and remove those that have longer and closer alternative.
+// Also remove matches pointing to p itself (it may be found in hash when positions are parsed once again after invalidate_match)
+template <class MatchFinder, class Coder>
+int OptimalParsing<MatchFinder,Coder> :: prepare_matches (int n, BYTE *p, const UINT MINLEN)
+{
+    for (int i=1; i<n; i++) {
+        Match m = matches[i];  int j;
+        for (j=i; j>0 && (matches[j-1].len > m.len  ||  (matches[j-1].len == m.len && matches[j-1].q < m.q)); j--)
+            matches[j] = matches[j-1];
+        matches[j] = m;
+    }
+    // Walk from the longest match down, keeping only matches closer than all longer ones
+    int k = n;  BYTE *closest = NULL;
+    for (int i=n-1; i>=0; i--)
+        if (matches[i].len >= MINLEN  &&  matches[i].q > closest  &&  matches[i].q < p)
+            closest = matches[i].q,  matches[--k] = matches[i];
+    iterate_var(i,n-k)  matches[i] = matches[k+i];
+    return n-k;
 }
 
-suggest (i, len, dist, match_price)
+template <class MatchFinder, class Coder>
+void OptimalParsing<MatchFinder,Coder> :: make_plan (BYTE *p, BYTE *bufend)
 {
-    if (price[i] < match_price)        //    
-    {
-        price[i] = match_price;
-        len[i]  = len;
-        dist[i] = dist;
+    const UINT MINLEN = mf.min_length();
+    planned = next = 0;
+    int n = mymin (bufend-p, OPTIMAL_WINDOW);    // Window size
+    if (n <= 0) {                                // Too close to the data end - just encode a literal
+        plan[0].p = p,  plan[0].len = 0,  plan[0].q = p;
+        planned = 1;
+        return;
+    }
+
+    pos[0].price = 0;
+    iterate_var(k,REPDIST_CODES)  pos[0].dist[k] = coder->prevdist(k);
+    int  filled = 0;                             // Last position whose price was initialized
+    int  end = n;                                // Window end (when path should be finished)
+    UINT final_len = 0;  BYTE *final_q = NULL;   // Long match accepted at the window end
+
+// Propose a path to position t with the given price, last step and its distance
+#define suggest(t, _price, _len, _q, _dist, _repcode)                                     \
+    {                                                                                     \
+        while (filled < (t))  pos[++filled].price = UINT_MAX;                             \
+        Position &y = pos[t];                                                             \
+        uint pr = (_price);                                                               \
+        if (pr < y.price) {                                                               \
+            y.price = pr,  y.len = (_len),  y.q = (_q);                                   \
+            update_dists (y.dist, x.dist, (_dist), (_repcode));                           \
+        }                                                                                 \
+    }
+
+    for (int i=0; i<n; i++) {
+        BYTE *cur = p+i;
+        Position &x = pos[i];
+
+        // 1. Find all matches at current position, including ones at last distances
+        if (PREFETCH_DISTANCE)  mf.prefetch (cur+PREFETCH_DISTANCE);
+        int cnt = mf.find_all_matches (cur, bufend, matches, MAX_MATCHES);
+        if (cur >= hashed_end)  hashed_end = cur+1;
+        cnt = prepare_matches (cnt, cur, MINLEN);
+        UINT maxlen = cnt? matches[cnt-1].len : 0;   BYTE *maxq = cnt? matches[cnt-1].q : NULL;
+
+        UINT replen[REPDIST_CODES];
+        iterate_var(k,REPDIST_CODES) {
+            int d = x.dist[k];  replen[k] = 0;
+            if (d < 0  ||  cur-d-1 < buf)  continue;
+            BYTE *r = cur-d-1;
+            UINT len = extend_match (cur, r, 0, bufend);
+            if (len >= MINLEN)  replen[k] = len;
+            if (len >= MINLEN  &&  len > maxlen)  maxlen = len,  maxq = r;
+        }
+
+        // Long match or match crossing the window end - finish the window here
+        if (maxlen >= OPTIMAL_NICE_LEN  ||  i+maxlen > n) {
+            end = i,  final_len = maxlen,  final_q = maxq;
+            break;
+        }
+
+        // 2. Propose paths to next positions
+        suggest (i+1, x.price + coder->literal_price (cur, x.dist[0]), 1, NULL, 0, REPDIST_CODES);
+        iterate_var(k,REPDIST_CODES) {
+            for (UINT len=MINLEN; len<=replen[k]; len++)
+                suggest (i+len, x.price + coder->match_price (len, x.dist[k], k, MINLEN), len, cur-x.dist[k]-1, x.dist[k], k);
+        }
+        UINT len = MINLEN;
+        iterate_var(j,cnt) {
+            int d = cur - matches[j].q - 1,  repcode = -1;
+            iterate_var(k,REPDIST_CODES)  if (d == x.dist[k])  {repcode = k; break;}
+            for (; len <= matches[j].len; len++)
+                suggest (i+len, x.price + coder->match_price (len, d, repcode, MINLEN), len, matches[j].q, d, repcode);
+        }
+    }
+#undef suggest
+
+    // 3. Extract the cheapest path to the window end
+    for (int t=end; t>0; t-=pos[t].len)  planned++;
+    int k = planned;
+    for (int t=end; t>0; t-=pos[t].len) {
+        Decision &d = plan[--k];
+        d.p   = p + t - pos[t].len;
+        d.len = pos[t].q? pos[t].len : 0;
+        d.q   = pos[t].q? pos[t].q   : d.p;
+    }
+    if (final_len) {
+        Decision &d = plan[planned++];
+        d.p = p+end,  d.len = final_len,  d.q = final_q;
     }
 }
+
+// Optimal parser needs access to the coder in order to estimate prices. Other MFs don't need it
+template <class MatchFinder, class Coder>
+void attach_coder (MatchFinder &mf, Coder &coder)  {}
+
+template <class MatchFinder, class Coder>
+void attach_coder (OptimalParsing<MatchFinder,Coder> &mf, Coder &coder)  {mf.coder = &coder;}
@@ -2,10 +2,18 @@
 // (c) Joachim Henke
 // GPL'ed code of Tornado - fast LZ77 compression algorithm.
 #include "../Compression.h"
+#include "../SIMD.h"
 #include "MatchFinder.cpp"
 #include "EntropyCoder.cpp"
 #include "LZ77_Coder.cpp"
 #include "DataTables.cpp"
+#include "../MultiThreading.h"
+#ifndef FREEARC_DECOMPRESS_ONLY
+#include "OptimalParsing.cpp"
+#endif
+
+struct TornadoDictionary;
+struct TornadoContext;
 
 // Compression method parameters
 struct PackMethod
@@ -23,16 +31,28 @@ struct PackMethod
     int  update_step;       // How much bytes are skipped in mf.update()
     uint auxhash_size;      // Auxiliary hash size
     int  auxhash_row_width; // Length of auxiliary hash row
+    uint block_size;        // Size of independently compressed blocks in multithreaded mode (0 - compress whole stream in single thread)
+    int  large_pages;       // Large pages policy for hash tables and buffers (LARGE_PAGES_DEFAULT - keep policy of the calling thread)
+    TornadoDictionary *dictionary;  // Preset dictionary (NULL - not used), the same dictionary should be used for decompression
+    TornadoContext    *context;     // Context keeping compressor between calls (NULL - not used)
 };
 
 extern "C" {
 // Main compression and decompression routines
 int tor_compress   (PackMethod m, CALLBACK_FUNC *callback, void *auxdata);
-int tor_decompress (CALLBACK_FUNC *callback, void *auxdata);
+int tor_decompress (CALLBACK_FUNC *callback, void *auxdata, TornadoDictionary *dict = NULL);
+// Random access to framed stream with index held in memory
+int tor_decompress_at (void *data, uint64 datasize, uint64 offset, void *out, int outsize);
+// Load preset dictionary (data are copied) and free it
+TornadoDictionary *tor_load_dictionary (void *data, uint size);
+void               tor_free_dictionary (TornadoDictionary *dict);
+// Create and free compression context
+TornadoContext    *tor_create_context  (void);
+void               tor_free_context    (TornadoContext *ctx);
 }
 
 enum { STORING=0, BYTECODER=1, BITCODER=2, HUFCODER=3, ARICODER=4 };
-enum { GREEDY=1, LAZY=2 };
+enum { GREEDY=1, LAZY=2, OPTIMAL=4 };
 
 // Preconfigured compression modes
 PackMethod std_Tornado_method[] =
@@ -49,6 +69,9 @@ PackMethod std_Tornado_method[] =
     , {  9, ARICODER,  true,  256,  2048*mb, 5,   1024*mb,  LAZY  ,   2,    0,    1,  512*kb,    4 }
     , { 10, ARICODER,  true,  256,  2048*mb, 6,   1024*mb,  LAZY  ,   2,    0,    1,    2*mb,   32 }
     , { 11, ARICODER,  true,  200,  1600*mb, 7,   1024*mb,  LAZY  ,   2,    0,    1,  512*mb,  256 }
+    , { 12, ARICODER,  true,   32,   128*mb, 5,    256*mb,  OPTIMAL,  2,    0,    1,  128*kb,    4 }
+    , { 13, ARICODER,  true,  128,   512*mb, 6,   1024*mb,  OPTIMAL,  2,    0,    1,    2*mb,   32 }
+    , { 14, ARICODER,  true,   32,  2048*mb, 8,    256*mb,  OPTIMAL,  2,    0,    1,       0,    0 }
     };
 
 // Default compression parameters are equivalent to option -5
@@ -68,51 +91,231 @@ uint tornado_compressor_outbuf_size (uint buffer, int bytes_to_compress = -1)
                                HUGE_BUFFER_SIZE;}
 
 
+// Framed stream *********************************************************************************
+
+// In multithreaded mode, input data are split into blocks that are compressed independently of each other.
+// Stream header holds FRAMED_STREAM signature and flags instead of encoding method and minimum match length,
+// and maximum block size instead of buffer size.
+// Each compressed block (frame) is an ordinary Tornado stream prepended by 8-byte header
+// containing its compressed and original sizes. Zero compressed size marks the end of stream.
+// With FRAMES_INDEX flag, the end-of-stream marker is followed by index allowing to start decompression
+// from any frame (see tor_decompress_at): for every frame and then for the stream end - 64-bit offsets
+// of the frame header (from the start of stream) and of its data in original stream,
+// then 32-bit number of frames and FRAMES_INDEX_SIGNATURE
+const int FRAMED_STREAM = 255;
+#define FRAME_HEADER_SIZE 8
+#define FRAMED_STREAM_HEADER_SIZE 6
+const int FRAMES_INDEX = 1;
+const uint32 FRAMES_INDEX_SIGNATURE = 0x58444954;   // "TIDX"
+#define FRAMES_INDEX_ENTRY  16
+#define FRAMES_INDEX_FOOTER 8
+
+// Maximum size of frame produced by compression of block of given size (it's the size of coder output buffer, see OutputByteStream)
+uint tornado_frame_bound (uint block)
+{return tornado_compressor_outbuf_size (block, block) + 2*LARGE_BUFFER_SIZE + 512 + 4096;}
+
+// Memory buffer that serves as data source or destination while single frame is (de)compressed
+struct TornadoFrame
+{
+    CALLBACK_FUNC *callback;  // Outer callback and its parameter
+    void          *auxdata;
+    BYTE          *buf;       // Frame contents
+    int            size;      // Size of buf[]
+    int            pos;       // Current position in buf[]
+    uint64         written;   // Amount of decompressed data passed to outer callback
+};
+
+// Callback collecting written data in the frame buffer: used to compress one block into frame
+// and to decompress one frame into memory block
+int tor_frame_writer (const char *what, void *data, int size, void *auxdata)
+{
+    TornadoFrame &f = *(TornadoFrame*)auxdata;
+    if (strequ(what,"write")) {
+        if (size > f.size-f.pos)  return FREEARC_ERRCODE_OUTBLOCK_TOO_SMALL;
+        memcpy (f.buf+f.pos, data, size);
+        f.pos += size;
+        return size;
+    }
+    return FREEARC_ERRCODE_NOT_IMPLEMENTED;
+}
+
+// Callback used for decompression of one frame: compressed data are read from the frame buffer,
+// decompressed ones are passed to outer callback
+int tor_frame_reader (const char *what, void *data, int size, void *auxdata)
+{
+    TornadoFrame &f = *(TornadoFrame*)auxdata;
+    if (strequ(what,"read")) {
+        int bytes = mymin (size, f.size-f.pos);
+        memcpy (data, f.buf+f.pos, bytes);
+        f.pos += bytes;
+        return bytes;
+    }
+    if (strequ(what,"write"))  f.written += size;
+    return f.callback (what, data, size, f.auxdata);
+}
+
+
+// Preset dictionary *****************************************************************************
+
+// Preset dictionary is placed into the window before data being (de)compressed, so that matches may refer
+// to its contents. This greatly improves compression of small inputs similar to the dictionary.
+// Only last tor_dictionary_size() bytes of dictionary are used, leaving at least half of window for data.
+// Dictionary also caches match finders primed by it (they are read-only once made), plus compressors and
+// decompression buffers that aren't used at the moment. The caches are guarded by lock, so dictionary
+// may be used by several threads simultaneously, each one taking its own compressor or buffer
+struct TornadoDictionary
+{
+    BYTE *data;                            // Dictionary contents
+    uint  size;                            // Dictionary size
+    Mutex lock;                            // Guards lists below
+    struct TornadoSnapshot   *snapshots;   // Match finders primed by this dictionary, one per compression method
+    struct TornadoCompressor *compressors; // Idle compressors made for this dictionary
+    struct TornadoOutbuf     *outbufs;     // Idle decompression buffers
+};
+
+#ifndef FREEARC_DECOMPRESS_ONLY
+// Match finder primed by preset dictionary, see TornadoCachedCompressor
+struct TornadoSnapshot
+{
+    PackMethod m;             // Compression method the match finder was made for
+    TornadoSnapshot *next;
+    virtual int error() = 0;
+    virtual ~TornadoSnapshot() {}
+};
+
+// Compressor kept between calls by dictionary or context, see tor_compress_cached()
+struct TornadoCompressor
+{
+    PackMethod m;             // Compression method the compressor was made for
+    TornadoCompressor *next;  // Next idle compressor of the same dictionary
+    virtual int error() = 0;
+    virtual int compress (CALLBACK_FUNC *callback, void *auxdata) = 0;
+    virtual ~TornadoCompressor() {}
+};
+#endif
+
+// Decompression buffer kept by dictionary between calls
+struct TornadoOutbuf
+{
+    BYTE *buf;
+    uint  size;
+    TornadoOutbuf *next;
+};
+
+// Amount of dictionary data used with given buffer size
+uint tor_dictionary_size (TornadoDictionary *dict, uint buffer)
+{return mymin (dict->size, buffer/2);}
+
+// Load preset dictionary (data are copied)
+TornadoDictionary *tor_load_dictionary (void *data, uint size)
+{
+    TornadoDictionary *dict = new TornadoDictionary;
+    if (!dict)  return NULL;
+    dict->data = (BYTE*) malloc (mymax(size,1));
+    if (!dict->data)  {delete dict; return NULL;}
+    memcpy (dict->data, data, size);
+    dict->size = size;
+    dict->snapshots = NULL,  dict->compressors = NULL,  dict->outbufs = NULL;
+    return dict;
+}
+
+// Free preset dictionary and everything cached in it
+void tor_free_dictionary (TornadoDictionary *dict)
+{
+    if (!dict)  return;
+#ifndef FREEARC_DECOMPRESS_ONLY
+    while (dict->compressors)  {TornadoCompressor *c = dict->compressors;  dict->compressors = c->next;  delete c;}
+    while (dict->snapshots)    {TornadoSnapshot   *s = dict->snapshots;    dict->snapshots   = s->next;  delete s;}
+#endif
+    while (dict->outbufs)      {TornadoOutbuf     *o = dict->outbufs;      dict->outbufs     = o->next;  BigFree (o->buf);  free (o);}
+    free (dict->data);
+    delete dict;
+}
+
+
+// Compression context ****************************************************************************
+
+// Context keeps compressor made by tor_compress() call (its window, match finder and coder buffer),
+// so next call with the same method doesn't need to allocate and clear them again.
+// It greatly speeds up compression of many small independent blocks, f.e. by CompressMem().
+// Context shouldn't be used by several threads simultaneously
+struct TornadoContext
+{
+    struct TornadoCompressor *compressor;   // Compressor made by last tor_compress() call
+};
+
+TornadoContext *tor_create_context (void)
+{
+    return (TornadoContext*) calloc (sizeof(TornadoContext), 1);
+}
+
+void tor_free_context (TornadoContext *ctx)
+{
+    if (!ctx)  return;
+#ifndef FREEARC_DECOMPRESS_ONLY
+    delete ctx->compressor;
+#endif
+    free (ctx);
+}
+
+
 #ifndef FREEARC_DECOMPRESS_ONLY
 
 // Check for data table with N byte elements at current pos
+// (quick check is made for 32 positions at once by SIMD code, see TableCandidates,
+// except for the sparse checking mode where only one position of table_shift ones is checked)
 #define CHECK_FOR_DATA_TABLE(N)                                                                         \
 {                                                                                                       \
-    if (p[-1]==p[N-1]                                                                                   \
-    &&  uint(p[  N-1] - p[2*N-1] + 4) <= 2*4                                                            \
-    &&  uint(p[2*N-1] - p[3*N-1] + 4) <= 2*4                                                            \
-    &&  !val32equ(p+2*N-4, p+N-4))                                                                      \
+    if (p-last_found > table_dist?  TABLE_CANDIDATE (N,p)  :  candidates.check<N> (p))                  \
     {                                                                                                   \
         int type, items;                                                                                \
         if (check_for_data_table (N, type, items, p, bufend, table_end, buf, offset, last_checked)) {   \
             coder.encode_table (type, items);                                                           \
             /* If data table was diffed, we should invalidate match cached by lazy match finder */      \
             mf.invalidate_match();                                                                      \
+            candidates.invalidate();                                                                    \
             goto found;                                                                                 \
         }                                                                                               \
     }                                                                                                   \
 }
 
 
-// Read next datachunk into buffer, shifting old contents if required
+// Read next datachunk into buffer, shifting old contents if required.
+// buf is the window start. When ringsize>0, data are placed into mirrored ring buffer of ringsize bytes starting at ring
+// (see MirrorAlloc), and window slides without moving data: we just advance buf and move all pointers ringsize bytes back
+// when buf leaves the first copy of ring. So sliding costs O(1) since match finders store offsets relative to movable base
 template <class MatchFinder, class Coder>
-int read_next_chunk (PackMethod &m, CALLBACK_FUNC *callback, void *auxdata, MatchFinder &mf, Coder &coder, byte *&p, byte *buf, BYTE *&bufend, BYTE *&table_end, BYTE *&last_found, BYTE *&read_point, int &bytes, int &chunk, uint64 &offset, byte *(&last_checked)[MAX_TABLE_ROW][MAX_TABLE_ROW])
+int read_next_chunk (PackMethod &m, CALLBACK_FUNC *callback, void *auxdata, MatchFinder &mf, Coder &coder, byte *&p, byte *&buf, BYTE *ring, uint ringsize, BYTE *&bufend, BYTE *&table_end, BYTE *&last_found, BYTE *&read_point, int &bytes, int &chunk, uint64 &offset, byte *(&last_checked)[MAX_TABLE_ROW][MAX_TABLE_ROW])
 {
     if (bytes==0 || compress_all_at_once)  return 0;     // All input data was successfully compressed
     // If we can't provide 256 byte lookahead then shift data toward buffer beginning,
     // freeing space at buffer end for the new data
     if (bufend-buf > m.buffer-LOOKAHEAD) {
         int sh;
-        if (m.shift==-1) {
+        if (m.shift==-1)
             sh = p-(buf+2);  // p should become buf+2 after this shift
-            memcpy (buf, buf+sh, bufend-(buf+sh));
-            mf.clear_hash (buf);
-        } else {
+        else
             sh = m.shift>0? m.shift : bufend-buf+m.shift;
-            memcpy (buf, buf+sh, bufend-(buf+sh));
-            mf.shift (buf, sh);
-        }
-        p      -= sh;
-        bufend -= sh;
+        BYTE *start = buf+sh;   // New window start
         offset += sh;
         if (coder.support_tables && m.find_tables)
-            table_end  = table_end >buf+sh? table_end -sh : buf,
-            last_found = last_found>buf+sh? last_found-sh : buf;
+            table_end  = mymax (table_end,  start),
+            last_found = mymax (last_found, start);
+        else
+            table_end  = start+m.buffer+LOOKAHEAD;
+        if (ringsize)
+            sh = start >= ring+ringsize? ringsize : 0;
+        else
+            memcpy (buf, start, bufend-start);
+        buf         = start-sh;
+        p          -= sh;
+        bufend     -= sh;
+        table_end  -= sh;
+        last_found -= sh;
+        if (m.shift==-1)
+            mf.clear_hash (buf);
+        else
+            mf.shift (buf, sh);
         iterate_var(i,MAX_TABLE_ROW)  iterate_var(j,MAX_TABLE_ROW)  last_checked[i][j] = buf;
         mf.invalidate_match();  // invalidate match stored in lazy MF; otherwise it may fuck up the NEXT REPCHAR checking
         coder.shift_occurs();   // Tell to the coder what shift occurs
@@ -128,47 +331,52 @@ int read_next_chunk (PackMethod &m, CALLBACK_FUNC *callback, void *auxdata, Matc
 }
 
 
-// Compress one chunk of data
+// Data are read in chunks of this size
+static inline int tor_chunk_size (PackMethod &m)
+{return compress_all_at_once? m.buffer : mymin (m.shift>0? m.shift:m.buffer, LARGE_BUFFER_SIZE);}
+
+// Compress one chunk of data (buf may be mirrored ring buffer of ringsize bytes, see read_next_chunk).
+// Window may start with dictsize bytes of preset dictionary that were already indexed by mf.
+// First bytes of data were already placed after them by the caller
 template <class MatchFinder, class Coder>
-int tor_compress_chunk (PackMethod m, CALLBACK_FUNC *callback, void *auxdata, byte *buf, int bytes_to_compress)
+int tor_compress_chunk (PackMethod m, CALLBACK_FUNC *callback, void *auxdata, MatchFinder &mf, byte *buf, uint dictsize, int bytes, int bytes_to_compress, uint ringsize, BYTE *outbuf)
 {
+    BYTE *ring = buf;
     // Read data in these chunks
-    int chunk = compress_all_at_once? m.buffer : mymin (m.shift>0? m.shift:m.buffer, LARGE_BUFFER_SIZE);
+    int chunk = tor_chunk_size (m);
     uint64 offset = 0;                        // Current offset of buf[] contents relative to file (increased with each shift() operation)
-    int bytes = bytes_to_compress!=-1? bytes_to_compress : callback ("read", buf, chunk, auxdata);   // Number of bytes read by last "read" call
-    if (bytes<0)  return bytes;               // Return errcode on error
-    BYTE *bufend = buf + bytes;               // Current end of real data in buf[]
+    BYTE *bufend = buf + dictsize + bytes;    // Current end of real data in buf[]
     BYTE *matchend = bufend - mymin (MAX_HASHED_BYTES, bufend-buf);   // Maximum pos where match may finish (less than bufend in order to simplify hash updating)
     BYTE *read_point = compress_all_at_once || bytes_to_compress!=-1? bufend : bufend-mymin(LOOKAHEAD,bytes); // Next point where next chunk of data should be read to buf
-    // Match finder will search strings similar to current one in previous data
-    MatchFinder mf (buf, m.hashsize, m.hash_row_width, m.auxhash_size, m.auxhash_row_width);
-    if (mf.error() != FREEARC_OK)  return mf.error();
-    // Coder will encode LZ output into bits and put them to outstream
-    Coder coder (m.encoding_method, callback, auxdata, tornado_compressor_outbuf_size (m.buffer, bytes_to_compress), chunk*2);   // Data should be written in HUGE_BUFFER_SIZE chunks (at least) plus chunk*2 bytes should be allocated to ensure that no buffer overflow may occur (because we flush() data only after processing each 'chunk' input bytes)
+    // Coder will encode LZ output into bits and put them to outstream (outbuf, if provided, should be tor_coder_bufsize() bytes long)
+    Coder coder (m.encoding_method, callback, auxdata, tornado_compressor_outbuf_size (m.buffer, bytes_to_compress), chunk*2, outbuf);   // Data should be written in HUGE_BUFFER_SIZE chunks (at least) plus chunk*2 bytes should be allocated to ensure that no buffer overflow may occur (because we flush() data only after processing each 'chunk' input bytes)
     if (coder.error() != FREEARC_OK)  return coder.error();
+    attach_coder (mf, coder);
     BYTE *table_end  = coder.support_tables && m.find_tables? buf : buf+m.buffer+LOOKAHEAD;    // The end of last data table processed
     BYTE *last_found = buf;                             // Last position where data table was found
     byte *last_checked[MAX_TABLE_ROW][MAX_TABLE_ROW];   // Last position where data table of size %1 with offset %2 was tried
     if(coder.support_tables)  {iterate_var(i,MAX_TABLE_ROW)  iterate_var(j,MAX_TABLE_ROW)  last_checked[i][j] = buf;}
+    TableCandidates candidates;                         // Positions passing quick check for data table
     // Use first output bytes to store encoding_method, minlen and buffer size
     coder.put8 (m.encoding_method);
     coder.put8 (mf.min_length());
     coder.put32(m.buffer);
     // Encode first four bytes directly (at least 2 bytes should be saved directly in order to avoid problems with using p-2 in MatchFinder.update())
-    for (BYTE *p=buf; p<buf+4; p++) {
+    for (BYTE *p=buf+dictsize; p<buf+4; p++) {
         if (p>=bufend)  goto finished;
         coder.encode (0, p, buf, mf.min_length());
     }
 
     // ========================================================================
     // MAIN CYCLE: FIND AND ENCODE MATCHES UNTIL DATA END
-    for (BYTE *p=buf+4; TRUE; ) {
+    for (BYTE *p=buf+mymax(dictsize,4); TRUE; ) {
         // Read next chunk of data if all data up to read_point was already processed
         if (p >= read_point) {
             if (bytes_to_compress!=-1)  goto finished;  // We shouldn't read/write any data!
             byte *p1=p;  // This trick allows to not take address of p and this buys us a bit better program optimization
-            int res = read_next_chunk (m, callback, auxdata, mf, coder, p1, buf, bufend, table_end, last_found, read_point, bytes, chunk, offset, last_checked);
+            int res = read_next_chunk (m, callback, auxdata, mf, coder, p1, buf, ring, ringsize, bufend, table_end, last_found, read_point, bytes, chunk, offset, last_checked);
             p=p1, matchend = bufend - mymin (MAX_HASHED_BYTES, bufend-buf);
+            candidates.invalidate();       // Data in the buffer were changed
             if (res==0)  goto finished;    // All input data was successfully compressed
             if (res<0)   return res;       // Error occured while reading data
         }
@@ -185,6 +393,7 @@ int tor_compress_chunk (PackMethod m, CALLBACK_FUNC *callback, void *auxdata, by
         }
 
         // Find match length and position
+        if (PREFETCH_DISTANCE)  mf.prefetch (p+PREFETCH_DISTANCE);
         UINT len = mf.find_matchlen (p, matchend, 0);
         BYTE *q  = mf.get_matchptr();
         // Encode either match or literal
@@ -211,12 +420,382 @@ finished:
     return coder.error();
 }
 
+// Compress one chunk of data with a new match finder
+template <class MatchFinder, class Coder>
+int tor_compress_chunk (PackMethod m, CALLBACK_FUNC *callback, void *auxdata, byte *buf, int bytes_to_compress, uint ringsize = 0)
+{
+    // Data are read before match finder creation since caching match finders fill hash with data at buf
+    int bytes = bytes_to_compress!=-1? bytes_to_compress : callback ("read", buf, tor_chunk_size(m), auxdata);   // Number of bytes read by last "read" call
+    if (bytes<0)  return bytes;               // Return errcode on error
+    // Match finder will search strings similar to current one in previous data
+    MatchFinder mf (buf, m.hashsize, m.hash_row_width, m.auxhash_size, m.auxhash_row_width);
+    if (mf.error() != FREEARC_OK)  return mf.error();
+    return tor_compress_chunk<MatchFinder,Coder> (m, callback, auxdata, mf, buf, 0, bytes, bytes_to_compress, ringsize, NULL);
+}
+
+// Size of coder output buffer used by tor_compress_chunk() with bytes_to_compress==-1
+static inline uint tor_coder_bufsize (PackMethod &m)
+{return OutputByteStream::bufsize (tornado_compressor_outbuf_size (m.buffer), tor_chunk_size(m)*2);}
+
+// Alocate buffer for input data. Sliding window is placed into mirrored ring buffer of ringsize bytes if OS allows it
+static byte *tor_alloc_window (PackMethod &m, uint &ringsize)
+{
+    ringsize = m.shift!=-1 && !compress_all_at_once?  MirrorRoundUp (m.buffer+LOOKAHEAD)  :  0;
+    byte *buf = ringsize?  (byte*) MirrorAlloc (ringsize)  :  NULL;
+    if (!buf)  ringsize = 0,
+               buf = (byte*) calloc (m.buffer+LOOKAHEAD, 1);     // make Valgrind happy :)
+    return buf;
+}
+
+static void tor_free_window (byte *buf, uint ringsize)
+{
+    if (ringsize)  MirrorFree (buf, ringsize);
+    else           free (buf);
+}
+
+
+// Compression with preset dictionary or context ************************************************
+
+// Index dictionary contents by match finder. Strings are inserted into hash the same way as by greedy parser
+template <class MatchFinder>
+void prime_mf (MatchFinder &mf, BYTE *p, BYTE *end)
+{
+    BYTE *matchend = end - mymin (MAX_HASHED_BYTES, end-p);
+    while (p < matchend) {
+        UINT len = mf.find_matchlen (p, matchend, 0);
+        if (len >= mf.min_length())  mf.update_hash (p, len, 1),  p += len;
+        else                         p++;
+    }
+}
+
+// Lazy and optimal parsers are bypassed since only strings inserted into underlying match finder are required
+template <class MatchFinder>
+void prime_mf (LazyMatching<MatchFinder> &mf, BYTE *p, BYTE *end)
+{
+    prime_mf (mf.mf, p, end);
+    mf.nextlen = 0;
+}
+
+template <class MatchFinder, class Coder>
+void prime_mf (OptimalParsing<MatchFinder,Coder> &mf, BYTE *p, BYTE *end)
+{
+    prime_mf (mf.mf, p, end);
+    mf.hashed_end = end;
+}
+
+// Callback wrapper counting bytes read by compressor
+struct TornadoReadCounter
+{
+    CALLBACK_FUNC *callback;
+    void          *auxdata;
+    uint64         bytes;     // Bytes read so far
+};
+
+int tor_read_counter (const char *what, void *buf, int size, void *auxdata)
+{
+    TornadoReadCounter *c = (TornadoReadCounter*) auxdata;
+    int result = c->callback (what, buf, size, c->auxdata);
+    if (strequ (what, "read")  &&  result>0)  c->bytes += result;
+    return result;
+}
+
+// Match finder primed by preset dictionary. It's made once per dictionary and compression method,
+// and then only read by compressors restoring their match finders from it, see TornadoCachedCompressor
+template <class MatchFinder>
+struct TornadoPrimedMF : TornadoSnapshot
+{
+    BYTE *buf;              // Window holding only dictionary contents
+    uint  dictsize;
+    MatchFinder *mf;        // Match finder that has indexed dictionary contents
+
+    TornadoPrimedMF (PackMethod _m, BYTE *dict, uint _dictsize) : dictsize (_dictsize), mf (NULL)
+    {
+        m = _m;
+        buf = (BYTE*) calloc (dictsize+LOOKAHEAD, 1);
+        if (!buf)  return;
+        memcpy (buf, dict, dictsize);   // Window should be filled before match finder is created
+        mf = new MatchFinder (buf, m.hashsize, m.hash_row_width, m.auxhash_size, m.auxhash_row_width);
+        if (mf && mf->error() == FREEARC_OK)  prime_mf (*mf, buf, buf+dictsize);
+    }
+    ~TornadoPrimedMF()  {delete mf;  free (buf);}
+
+    int error()  {return buf && mf?  mf->error() : FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;}
+};
+
+// Compressor that keeps its window, match finder and coder buffer between calls. Before each compression
+// match finder just starts new generation of hash entries instead of clearing hash (see BaseMatchFinder::next_generation),
+// so the call overhead doesn't depend on buffer and hash sizes.
+// Compressor made for preset dictionary has window starting with dictionary contents. Before each compression
+// the dictionary is copied to the window start and hash rows of data being compressed are restored
+// from the primed match finder (see RestoredBlocks), that is much faster than hashing dictionary again
+template <class MatchFinder, class Coder>
+struct TornadoCachedCompressor : TornadoCompressor
+{
+    BYTE *buf;              // Window (mirrored ring buffer of ringsize bytes if ringsize>0)
+    uint  ringsize;
+    BYTE *outbuf;           // Coder output buffer
+    uint  dictsize;         // Size of dictionary part placed at the window start
+    uint  filled;           // Maximum window part filled by previous compression
+    TornadoPrimedMF<MatchFinder> *snapshot;   // Match finder primed by dictionary (NULL without dictionary), shared with other compressors
+    MatchFinder mf;         // Match finder used for compression
+
+    TornadoCachedCompressor (PackMethod _m, BYTE *_buf, uint _ringsize, TornadoPrimedMF<MatchFinder> *_snapshot)
+        : buf (_buf), ringsize (_ringsize), dictsize (_snapshot? _snapshot->dictsize : 0), filled (0), snapshot (_snapshot),
+          mf (_buf, _m.hashsize, _m.hash_row_width, _m.auxhash_size, _m.auxhash_row_width)
+    {
+        m = _m;
+        outbuf = (BYTE*) BigAlloc (tor_coder_bufsize (m));
+    }
+    ~TornadoCachedCompressor()  {BigFree (outbuf);  tor_free_window (buf, ringsize);}
+
+    int error()  {return outbuf?  mf.error() : FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;}
+
+    int compress (CALLBACK_FUNC *callback, void *auxdata)
+    {
+        TornadoReadCounter counter = {callback, auxdata, 0};
+        // Data are read before match finder reset since caching match finders may fill hash with data at buf
+        int bytes = tor_read_counter ("read", buf+dictsize, mymin (tor_chunk_size(m), m.buffer-dictsize), &counter);
+        if (bytes<0)  return bytes;
+        // All-at-once compression reads input only once, so it should fit into the window after dictionary
+        if (compress_all_at_once  &&  bytes == m.buffer-dictsize) {
+            BYTE extra;  int more = callback ("read", &extra, 1, auxdata);
+            if (more != 0)  return more<0? more : FREEARC_ERRCODE_INVALID_COMPRESSOR;
+        }
+        if (snapshot)  memcpy (buf, snapshot->buf, dictsize);   // Previous compression may shift the window
+        mf.reset (buf, filled);
+        if (snapshot)  mf.restore (*snapshot->mf, snapshot->buf, buf, buf+dictsize, buf+dictsize+bytes);
+        int result = tor_compress_chunk<MatchFinder,Coder> (m, tor_read_counter, &counter, mf, buf, dictsize, bytes, -1, ringsize, outbuf);
+        // Window never contains more than m.buffer bytes, so all positions inserted into hash are below buf+filled
+        filled = mymin (dictsize+counter.bytes, m.buffer);
+        return result;
+    }
+};
+
+// Check that compressor made for method a may be used for method b
+static bool same_compressor_method (PackMethod &a, PackMethod &b)
+{
+    return a.encoding_method==b.encoding_method  &&  a.find_tables==b.find_tables  &&  a.hash_row_width==b.hash_row_width
+        && a.hashsize==b.hashsize  &&  a.caching_finder==b.caching_finder  &&  a.buffer==b.buffer  &&  a.match_parser==b.match_parser
+        && a.hash3==b.hash3  &&  a.shift==b.shift  &&  a.update_step==b.update_step
+        && a.auxhash_size==b.auxhash_size  &&  a.auxhash_row_width==b.auxhash_row_width;
+}
+
+// Make compressor for method m, restoring its match finder from snapshot (if it's not NULL)
+template <class MatchFinder, class Coder>
+int tor_make_compressor (PackMethod m, TornadoPrimedMF<MatchFinder> *snapshot, TornadoCompressor *&compressor)
+{
+    uint ringsize = 0;
+    BYTE *buf = snapshot?  (BYTE*) calloc (m.buffer+LOOKAHEAD, 1)   // Dictionary should be placed at the window start
+                        :  tor_alloc_window (m, ringsize);
+    if (!buf)  return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
+    TornadoCompressor *c = new TornadoCachedCompressor<MatchFinder,Coder> (m, buf, ringsize, snapshot);
+    if (!c)  {tor_free_window (buf, ringsize); return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;}
+    if (c->error() != FREEARC_OK)  {int errcode = c->error();  delete c;  return errcode;}
+    compressor = c;
+    return FREEARC_OK;
+}
+
+// Compress data using compressor cached in context. Cached compressor is reused while compression method is the same
+template <class MatchFinder, class Coder>
+int tor_compress_cached (PackMethod m, CALLBACK_FUNC *callback, void *auxdata, TornadoCompressor *&compressor)
+{
+    if (!compressor  ||  !same_compressor_method (compressor->m, m))
+    {
+        delete compressor;  compressor = NULL;
+        int errcode = tor_make_compressor<MatchFinder,Coder> (m, NULL, compressor);
+        if (errcode != FREEARC_OK)  return errcode;
+    }
+    return compressor->compress (callback, auxdata);
+}
+
+// Compress data using preset dictionary d. Each call takes idle compressor made for the same method (or makes new one)
+// and returns it to the dictionary afterwards, so simultaneous calls never share compressors.
+// Dictionary is primed once per method, primed match finder is shared by all compressors made for this method
+template <class MatchFinder, class Coder>
+int tor_compress_dictionary (PackMethod m, CALLBACK_FUNC *callback, void *auxdata, TornadoDictionary *d)
+{
+    TornadoCompressor *c = NULL;  TornadoPrimedMF<MatchFinder> *snapshot = NULL;
+    {
+        Lock _(d->lock);
+        for (TornadoCompressor **p = &d->compressors;  *p;  p = &(*p)->next)
+            if (same_compressor_method ((*p)->m, m))  {c = *p;  *p = c->next;  break;}
+        if (!c) {
+            for (TornadoSnapshot *s = d->snapshots;  s;  s = s->next)
+                if (same_compressor_method (s->m, m))  {snapshot = (TornadoPrimedMF<MatchFinder>*) s;  break;}
+            if (!snapshot) {
+                uint dictsize = tor_dictionary_size (d, m.buffer);
+                snapshot = new TornadoPrimedMF<MatchFinder> (m, d->data + d->size - dictsize, dictsize);
+                if (!snapshot)  return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
+                if (snapshot->error() != FREEARC_OK)  {int errcode = snapshot->error();  delete snapshot;  return errcode;}
+                snapshot->next = d->snapshots;  d->snapshots = snapshot;
+            }
+        }
+    }
+    if (!c) {
+        int errcode = tor_make_compressor<MatchFinder,Coder> (m, snapshot, c);
+        if (errcode != FREEARC_OK)  return errcode;
+    }
+    int result = c->compress (callback, auxdata);
+    Lock _(d->lock);
+    c->next = d->compressors;  d->compressors = c;
+    return result;
+}
+
+
+// Multithreaded compression ***********************************************************************
+
+template <class MatchFinder, class Coder>
+struct TornadoMTCompressor;
+
+// Single Tornado compression thread: compresses one block into one frame
+template <class MatchFinder, class Coder>
+struct TornadoCompressionThread : WorkerThread
+{
+    TornadoMTCompressor<MatchFinder,Coder>* compressor;
+    int init();
+    int process();
+    int after_write()  {return compressor->add_frame (OutSize, InSize);}
+    int done();
+};
+
+// Multi-threaded Tornado compressor
+template <class MatchFinder, class Coder>
+struct TornadoMTCompressor : MTCompressor< TornadoCompressionThread<MatchFinder,Coder> >
+{
+    PackMethod m;    // Compression parameters, m.buffer is the size of blocks
+    uint64 *index;   // Frames index: compressed and original offset of each frame written so far
+    int     frames;  // Number of frames written
+    uint64  comppos, origpos;   // Current offsets in compressed and original stream
+
+    TornadoMTCompressor (PackMethod _m, CALLBACK_FUNC *callback, void *auxdata)
+    {
+        m = _m;
+        this->callback = callback;
+        this->auxdata  = auxdata;
+        index = NULL;  frames = 0;
+        comppos = FRAMED_STREAM_HEADER_SIZE,  origpos = 0;
+    }
+    ~TornadoMTCompressor()  {free(index);}
+
+    // Called by writer thread for each frame written, in the stream order.
+    // Also called once more for the end-of-stream marker
+    int add_frame (uint compsize, uint origsize)
+    {
+        if (frames%1024 == 0) {
+            uint64 *p = (uint64*) realloc (index, (frames+1024) * 2*sizeof(uint64));
+            if (!p)  return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
+            index = p;
+        }
+        index[2*frames] = comppos,  index[2*frames+1] = origpos;
+        frames++,  comppos += compsize,  origpos += origsize;
+        return FREEARC_OK;
+    }
+
+    int main_cycle()
+    {
+        for(;;)
+        {
+            TornadoCompressionThread<MatchFinder,Coder> *job = this->FreeJobs.Get();   // Acquire next compression job
+            job->InSize = this->callback ("read", job->InBuf, m.buffer, this->auxdata);
+            if (job->InSize <= 0)     return job->InSize;   // Error or no more data
+            if (this->errcode < 0)    return 0;             // Error in other thread
+            this->WriterJobs.Put(job);
+            job->StartOperation.Signal();
+        }
+    }
+};
+
+template <class MatchFinder, class Coder>
+int TornadoCompressionThread<MatchFinder,Coder>::init()      // Alloc resources
+{
+    compressor = (TornadoMTCompressor<MatchFinder,Coder>*) task;
+    InBuf  = (char*) BigAlloc (compressor->m.buffer+LOOKAHEAD);
+    OutBuf = (char*) BigAlloc (FRAME_HEADER_SIZE + tornado_frame_bound(compressor->m.buffer));
+    return (InBuf && OutBuf? 0 : FREEARC_ERRCODE_NOT_ENOUGH_MEMORY);
+}
+
+template <class MatchFinder, class Coder>
+int TornadoCompressionThread<MatchFinder,Coder>::process()   // Compress one block
+{
+    // Bytes after block end are read by the match finder, so clear them in order to make compressed output repeatable
+    memset (InBuf+InSize, 0, LOOKAHEAD);
+    TornadoFrame frame;
+    frame.buf  = (BYTE*) OutBuf + FRAME_HEADER_SIZE;
+    frame.size = tornado_frame_bound (compressor->m.buffer);
+    frame.pos  = 0;
+    int result = tor_compress_chunk<MatchFinder,Coder> (compressor->m, tor_frame_writer, &frame, (byte*)InBuf, InSize);
+    if (result < 0)  return result;
+    setvalue32 (OutBuf,   frame.pos);
+    setvalue32 (OutBuf+4, InSize);
+    return FRAME_HEADER_SIZE + frame.pos;
+}
+
+template <class MatchFinder, class Coder>
+int TornadoCompressionThread<MatchFinder,Coder>::done()      // Free resources
+{
+    BigFree(OutBuf);  OutBuf = NULL;
+    BigFree(InBuf);   InBuf  = NULL;
+    return 0;
+}
+
+// Compress data as sequence of frames, each compressed by separate thread
+template <class MatchFinder, class Coder>
+int tor_compress_mt (PackMethod m, CALLBACK_FUNC *callback, void *auxdata)
+{
+    int errcode;
+    BYTE header[2] = {FRAMED_STREAM, FRAMES_INDEX};
+    BYTE *index = NULL;
+    WRITE  (header, 2);
+    WRITE4 (m.buffer);
+    {
+        TornadoMTCompressor<MatchFinder,Coder> tor (m, callback, auxdata);
+        errcode = tor.run();
+        if (errcode < 0)  goto finished;
+        WRITE4 (0);   // End-of-stream marker
+        // Write frames index, terminated by the entry for stream end
+        errcode = tor.add_frame (0, 0);
+        if (errcode < 0)  goto finished;
+        int indexsize = tor.frames*FRAMES_INDEX_ENTRY + FRAMES_INDEX_FOOTER;
+        BIGALLOC (BYTE, index, indexsize);
+        iterate_var(i,tor.frames)
+            setvalue64 (index + i*FRAMES_INDEX_ENTRY,   tor.index[2*i]),
+            setvalue64 (index + i*FRAMES_INDEX_ENTRY+8, tor.index[2*i+1]);
+        setvalue32 (index + indexsize-8, tor.frames-1);
+        setvalue32 (index + indexsize-4, FRAMES_INDEX_SIGNATURE);
+        WRITE (index, indexsize);
+    }
+finished:
+    BigFree (index);
+    return errcode<0? errcode : FREEARC_OK;
+}
+
+// Memory used by match finder with hash of hashsize bytes. Binary tree (see BinaryTreeMatchFinder)
+// rounds it down to power of 2 and additionally allocates hash heads of 1/4 of this size
+MemSize tornado_hash_mem (PackMethod m, uint hashsize)
+{
+    if (m.caching_finder != 8)  return hashsize;
+    MemSize tree = (1 << lb (mymax (hashsize, 64*kb) / (sizeof(PtrVal)*2))) * 2*sizeof(PtrVal);
+    return tree + tree/4;
+}
+
+// Memory used by multithreaded compression: every compression thread has its own match finder and coder,
+// and every job (including extra ones used for I/O buffering) holds input block and output frame
+MemSize tornado_mt_compression_mem (PackMethod m)
+{
+    uint block = mymin (m.buffer, m.block_size);
+    int  threads = GetCompressionThreads(),  jobs = threads + threads/2 + 1;
+    return threads * (tornado_hash_mem (m, mymin (m.hashsize, block*8)) + m.auxhash_size + tornado_frame_bound(block))
+         + jobs    * (block + tornado_frame_bound(block));
+}
+
 
 // tor_compress template parameterized by MatchFinder and Coder
 template <class MatchFinder, class Coder>
 int tor_compress0 (PackMethod m, CALLBACK_FUNC *callback, void *auxdata)
 {
     //SET_JMP_POINT( FREEARC_ERRCODE_GENERAL);
+    // Blocks are compressed independently, so the buffer larger than block isn't needed
+    if (m.block_size)  m.buffer = mymin (m.buffer, m.block_size);
     // Make buffer at least 32kb long and round its size up to 4kb chunk
     m.buffer = (mymax(m.buffer, 32*kb) + 4095) & ~4095;
     // If hash is too large - make it smaller
@@ -228,36 +807,21 @@ int tor_compress0 (PackMethod m, CALLBACK_FUNC *callback, void *auxdata)
                                      m.hash_row_width>2? m.buffer/2   :
                                      m.hashsize>=512*kb? m.buffer/4*3 :
                                                          -1);
+    // Multithreaded compression of independent blocks (can't be combined with preset dictionary)
+    if (m.block_size)  return m.dictionary? FREEARC_ERRCODE_INVALID_COMPRESSOR : tor_compress_mt<MatchFinder,Coder> (m, callback, auxdata);
+    // Compression with preset dictionary or reusable context
+    if (m.dictionary)  return tor_compress_dictionary<MatchFinder,Coder> (m, callback, auxdata, m.dictionary);
+    if (m.context)     return tor_compress_cached    <MatchFinder,Coder> (m, callback, auxdata, m.context->compressor);
+
     // Alocate buffer for input data
-    byte *buf = (byte*) calloc (m.buffer+LOOKAHEAD, 1);     // make Valgrind happy :)
+    uint ringsize;
+    byte *buf = tor_alloc_window (m, ringsize);
     if (!buf)  return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
 
-#if 0
-    // Create compression threads
-    for (int i=0; i<NumThreads; i++)
-    {
-        CThread t; t.Create(TornadoCompressionThread, &job[i]);
-    }
-    // Perform I/O and assign compression jobs
-    for (int i=0; ; i=(i+1)%NumThreads)
-    {
-        // Save results of previous compression job
-        job[i].Finished.Wait();
-        callback ("write", job[i].outbuf, job[i].outsize, auxdata);
-
-        // Read next chunk of data
-        int bytes = callback ("read", buf, m.buffer, auxdata);   // Number of bytes read by last "read" call
-        if (bytes<0)  return bytes;               // Return errcode on error
-
-        // Send signal to start compression
-        job[i].Compress.Signal();
-    }
-#endif
-
     // MAIN COMPRESSION FUNCTION
-    int result = tor_compress_chunk<MatchFinder,Coder> (m, callback, auxdata, buf, -1);
+    int result = tor_compress_chunk<MatchFinder,Coder> (m, callback, auxdata, buf, -1, ringsize);
 
-    free(buf);
+    tor_free_window (buf, ringsize);
     return result;
 }
 
@@ -268,6 +832,8 @@ int tor_compress4 (PackMethod m, CALLBACK_FUNC *callback, void *auxdata)
     switch (m.match_parser) {
     case GREEDY: return tor_compress0 <             MatchFinder,  Coder> (m, callback, auxdata);
     case LAZY:   return tor_compress0 <LazyMatching<MatchFinder>, Coder> (m, callback, auxdata);
+    case OPTIMAL: return tor_compress0 <OptimalParsing<MatchFinder,Coder>, Coder> (m, callback, auxdata);
+    default:     return FREEARC_ERRCODE_INVALID_COMPRESSOR;
     }
 }
 
@@ -278,6 +844,7 @@ int tor_compress3 (PackMethod m, CALLBACK_FUNC *callback, void *auxdata)
     case 0: return tor_compress4 <MatchFinder, Coder> (m, callback, auxdata);
     case 1: return tor_compress4 <Hash3<MatchFinder,12,10,FALSE>, Coder> (m, callback, auxdata);
     case 2: return tor_compress4 <Hash3<MatchFinder,16,12,TRUE >, Coder> (m, callback, auxdata);
+    default: return FREEARC_ERRCODE_INVALID_COMPRESSOR;
     }
 }
 
@@ -294,30 +861,59 @@ int tor_compress2 (PackMethod m, CALLBACK_FUNC *callback, void *auxdata)
                     return tor_compress3 <MatchFinder, LZ77_Coder <HuffmanEncoder<EOB_CODE> > > (m, callback, auxdata);
     case ARICODER:  // Arithmetic encoding
                     return tor_compress3 <MatchFinder, LZ77_Coder <ArithCoder<EOB_CODE> >     > (m, callback, auxdata);
+    default:        return FREEARC_ERRCODE_INVALID_COMPRESSOR;
+    }
+}
+
+#ifndef FULL_COMPILE
+// Lazy/optimal parsing with the coder selected by m.encoding_method. Coder is chosen once here,
+// so the main cycle is compiled separately for every coder and doesn't check coder type for every literal/match
+template <class MatchFinder>
+int tor_compress_lazy (PackMethod m, CALLBACK_FUNC *callback, void *auxdata)
+{
+    switch (m.encoding_method) {
+    case STORING:
+    case BYTECODER: return tor_compress0 <LazyMatching<MatchFinder>, LZ77_ByteCoder>                          (m, callback, auxdata);
+    case BITCODER:  return tor_compress0 <LazyMatching<MatchFinder>, LZ77_BitCoder>                           (m, callback, auxdata);
+    case HUFCODER:  return tor_compress0 <LazyMatching<MatchFinder>, LZ77_Coder <HuffmanEncoder<EOB_CODE> > > (m, callback, auxdata);
+    case ARICODER:  return tor_compress0 <LazyMatching<MatchFinder>, LZ77_Coder <ArithCoder<EOB_CODE> >     > (m, callback, auxdata);
+    default:        return FREEARC_ERRCODE_INVALID_COMPRESSOR;
     }
 }
 
 template <class MatchFinder>
-int tor_compress2d (PackMethod m, CALLBACK_FUNC *callback, void *auxdata)
+int tor_compress_optimal (PackMethod m, CALLBACK_FUNC *callback, void *auxdata)
 {
-    return tor_compress3 <MatchFinder, LZ77_DynamicCoder> (m, callback, auxdata);
+    typedef LZ77_Coder <HuffmanEncoder<EOB_CODE> >  HufCoder;
+    typedef LZ77_Coder <ArithCoder<EOB_CODE> >      AriCoder;
+    switch (m.encoding_method) {
+    case STORING:
+    case BYTECODER: return tor_compress0 <OptimalParsing<MatchFinder,LZ77_ByteCoder>, LZ77_ByteCoder> (m, callback, auxdata);
+    case BITCODER:  return tor_compress0 <OptimalParsing<MatchFinder,LZ77_BitCoder>,  LZ77_BitCoder>  (m, callback, auxdata);
+    case HUFCODER:  return tor_compress0 <OptimalParsing<MatchFinder,HufCoder>,       HufCoder>       (m, callback, auxdata);
+    case ARICODER:  return tor_compress0 <OptimalParsing<MatchFinder,AriCoder>,       AriCoder>       (m, callback, auxdata);
+    default:        return FREEARC_ERRCODE_INVALID_COMPRESSOR;
+    }
 }
+#endif
 
 // Compress data using compression method m and callback for i/o
 int tor_compress (PackMethod m, CALLBACK_FUNC *callback, void *auxdata)
 {
+    LargePagesScope large_pages (m.large_pages);
 // When FULL_COMPILE is defined, we compile all the 4*8*3*2=192 possible compressor variants
-// Otherwise, we compile only 8 variants actually used by -0..-11 predefined modes
+// Otherwise, we compile only variants actually used by -0..-14 predefined modes
 #ifdef FULL_COMPILE
     switch (m.caching_finder) {
     case 7:  if (m.hash_row_width > 256)  return FREEARC_ERRCODE_INVALID_COMPRESSOR;
-             return tor_compress2d <CombineMF <CycledCachingMatchFinder<7>, CycledCachingMatchFinder<4> > > (m, callback, auxdata);
+             return tor_compress2 <CombineMF <CycledCachingMatchFinder<7>, CycledCachingMatchFinder<4> > > (m, callback, auxdata);
     case 6:  if (m.hash_row_width > 256)  return FREEARC_ERRCODE_INVALID_COMPRESSOR;
-             return tor_compress2d <CombineMF <CycledCachingMatchFinder<6>, CycledCachingMatchFinder<4> > > (m, callback, auxdata);
+             return tor_compress2 <CombineMF <CycledCachingMatchFinder<6>, CycledCachingMatchFinder<4> > > (m, callback, auxdata);
     case 5:  if (m.hash_row_width > 256)  return FREEARC_ERRCODE_INVALID_COMPRESSOR;
-             return tor_compress2d <CombineMF <CycledCachingMatchFinder<5>, ExactMatchFinder<4> > >         (m, callback, auxdata);
+             return tor_compress2 <CombineMF <CycledCachingMatchFinder<5>, ExactMatchFinder<4> > >         (m, callback, auxdata);
+    case 8:  return tor_compress2 <BinaryTreeMatchFinder>        (m, callback, auxdata);
     case 2:  if (m.hash_row_width > 256)  return FREEARC_ERRCODE_INVALID_COMPRESSOR;
-             return tor_compress2d <CycledCachingMatchFinder<4> > (m, callback, auxdata);
+             return tor_compress2 <CycledCachingMatchFinder<4> > (m, callback, auxdata);
     case 1:  return tor_compress2  <CachingMatchFinder<4> >       (m, callback, auxdata);
 
     default: switch (m.hash_row_width) {
@@ -345,15 +941,22 @@ int tor_compress (PackMethod m, CALLBACK_FUNC *callback, void *auxdata)
 
     // -7..-9
     } else if (m.hash_row_width>=2 && m.hash3==2 && m.caching_finder==5 && m.match_parser==LAZY ) {
-        return tor_compress0 <LazyMatching <CombineMF <CycledCachingMatchFinder<5>, Hash3<ExactMatchFinder<4>,16,12,TRUE> > >,
-                              LZ77_DynamicCoder > (m, callback, auxdata);
+        return tor_compress_lazy <CombineMF <CycledCachingMatchFinder<5>, Hash3<ExactMatchFinder<4>,16,12,TRUE> > > (m, callback, auxdata);
     // -10 and -11
     } else if (m.hash_row_width>=2 && m.hash3==2 && m.caching_finder==6 && m.match_parser==LAZY ) {
-        return tor_compress0 <LazyMatching <CombineMF <CycledCachingMatchFinder<6>, Hash3<CycledCachingMatchFinder<4>,16,12,TRUE> > >,
-                              LZ77_DynamicCoder > (m, callback, auxdata);
+        return tor_compress_lazy <CombineMF <CycledCachingMatchFinder<6>, Hash3<CycledCachingMatchFinder<4>,16,12,TRUE> > > (m, callback, auxdata);
     } else if (m.hash_row_width>=2 && m.hash3==2 && m.caching_finder==7 && m.match_parser==LAZY ) {
-        return tor_compress0 <LazyMatching <CombineMF <CycledCachingMatchFinder<7>, Hash3<CycledCachingMatchFinder<4>,16,12,TRUE> > >,
-                              LZ77_DynamicCoder > (m, callback, auxdata);
+        return tor_compress_lazy <CombineMF <CycledCachingMatchFinder<7>, Hash3<CycledCachingMatchFinder<4>,16,12,TRUE> > > (m, callback, auxdata);
+
+    // -12..-13 (optimal parsing)
+    } else if (m.hash_row_width>=2 && m.hash3==2 && m.caching_finder==5 && m.match_parser==OPTIMAL ) {
+        return tor_compress_optimal <CombineMF <CycledCachingMatchFinder<5>, Hash3<ExactMatchFinder<4>,16,12,TRUE> > > (m, callback, auxdata);
+    } else if (m.hash_row_width>=2 && m.hash3==2 && m.caching_finder==6 && m.match_parser==OPTIMAL ) {
+        return tor_compress_optimal <CombineMF <CycledCachingMatchFinder<6>, Hash3<CycledCachingMatchFinder<4>,16,12,TRUE> > > (m, callback, auxdata);
+
+    // -14 and any other -x8 combination: binary tree is compiled with all coders, hash3 modes and parsers
+    } else if (m.caching_finder==8 ) {
+        return tor_compress2 <BinaryTreeMatchFinder> (m, callback, auxdata);
 
     } else {
         return FREEARC_ERRCODE_INVALID_COMPRESSOR;
@@ -396,20 +999,86 @@ int tor_compress (PackMethod m, CALLBACK_FUNC *callback, void *auxdata)
 }
 
 
+// Match copying in tor_decompress0() may write up to this number of bytes after the match end.
+// These bytes are overwritten by the following data, and outbuf is made larger than dictionary
+// by the same amount so that they never hold data that may be referenced by the following matches
+#define MATCH_COPY_OVERRUN 16
+
+// Distances 1..7 are replaced with their multiples that are >=8 after first 8 bytes of match are copied
+static const uint8 match_pattern_dist[8] = {0, 8, 8, 9, 8, 10, 12, 14};
+
+// Copy match of len bytes at distance dist to output using 8/16-byte moves.
+// Returns pointer to the match end; up to MATCH_COPY_OVERRUN bytes after it are filled with garbage
+static inline BYTE *copy_match (BYTE *output, UINT dist, UINT len)
+{
+    BYTE *end = output+len,  *p = output-dist;
+    if (dist >= 16) {
+        do {
+            uint64 a = value64(p),  b = value64(p+8);
+            setvalue64 (output, a);  setvalue64 (output+8, b);
+            output += 16,  p += 16;
+        } while (output < end);
+        return end;
+    }
+    if (dist < 8) {
+        // Overlapped match: make the repeated pattern 8+ bytes long byte-by-byte
+        output[0] = p[0];  output[1] = p[1];  output[2] = p[2];  output[3] = p[3];
+        output[4] = p[4];  output[5] = p[5];  output[6] = p[6];  output[7] = p[7];
+        output += 8,  p = output - match_pattern_dist[dist];
+    }
+    while (output < end) {
+        setvalue64 (output, value64(p));
+        output += 8,  p += 8;
+    }
+    return end;
+}
+
+// Take idle decompression buffer kept by preset dictionary (or make new one) and reallocate it to the given size
+TornadoOutbuf *tor_take_outbuf (TornadoDictionary *dict, uint size)
+{
+    TornadoOutbuf *ob;
+    {
+        Lock _(dict->lock);
+        ob = dict->outbufs;
+        if (ob)  dict->outbufs = ob->next;
+    }
+    if (!ob  &&  !(ob = (TornadoOutbuf*) calloc (sizeof(TornadoOutbuf), 1)))  return NULL;
+    if (ob->size != size) {
+        BigFree (ob->buf);
+        ob->buf  = (BYTE*) BigAlloc (size);
+        ob->size = ob->buf? size : 0;
+    }
+    if (!ob->buf)  {free(ob); return NULL;}
+    return ob;
+}
+
+// Return decompression buffer to the dictionary
+void tor_return_outbuf (TornadoDictionary *dict, TornadoOutbuf *ob)
+{
+    Lock _(dict->lock);
+    ob->next = dict->outbufs;  dict->outbufs = ob;
+}
+
 template <class Decoder>
-int tor_decompress0 (CALLBACK_FUNC *callback, void *auxdata, int _bufsize, int minlen)
+int tor_decompress0 (CALLBACK_FUNC *callback, void *auxdata, int _bufsize, int minlen, TornadoDictionary *dict)
 {
     //SET_JMP_POINT (FREEARC_ERRCODE_GENERAL);
     int errcode = FREEARC_OK;                             // Error code of last "write" call
     Decoder decoder (callback, auxdata, _bufsize);        // LZ77 decoder parses raw input bitstream and returns literals&matches
     if (decoder.error() != FREEARC_OK)  return decoder.error();
     uint bufsize = compress_all_at_once? _bufsize : mymax (_bufsize, HUGE_BUFFER_SIZE);   // Make sure that outbuf is at least 8mb in order to avoid excessive disk seeks (not required in programs compiled for one-shot compression)
-    BYTE *outbuf = (byte*) BigAlloc (bufsize+PAD_FOR_TABLES*2);  // Circular buffer for decompressed data
+    bufsize += MATCH_COPY_OVERRUN;
+    TornadoOutbuf *cached = dict?  tor_take_outbuf (dict, bufsize+PAD_FOR_TABLES*2) : NULL;
+    BYTE *outbuf = dict?  (cached? cached->buf : NULL)                                   // Circular buffer for decompressed data
+                       :  (byte*) BigAlloc (bufsize+PAD_FOR_TABLES*2);
     if (!outbuf)  return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
     outbuf += PAD_FOR_TABLES;       // We need at least PAD_FOR_TABLES bytes available before and after outbuf in order to simplify datatables undiffing
-    BYTE *output      = outbuf;     // Current position in decompressed data buffer
-    BYTE *write_start = outbuf;     // Data up to this point was already writen to outsream
-    BYTE *write_end   = outbuf + mymin (bufsize, HUGE_BUFFER_SIZE); // Flush buffer when output pointer reaches this point
+    // Preset dictionary is placed at the buffer start (it may be overwritten by previous decompression)
+    uint dictsize = dict? tor_dictionary_size (dict, _bufsize) : 0;
+    if (dict)  memcpy (outbuf, dict->data + dict->size - dictsize, dictsize);
+    BYTE *output      = outbuf + dictsize;  // Current position in decompressed data buffer
+    BYTE *write_start = output;             // Data up to this point was already writen to outsream
+    BYTE *write_end   = output + mymin (bufsize-dictsize, HUGE_BUFFER_SIZE); // Flush buffer when output pointer reaches this point
     if (compress_all_at_once)  write_end = outbuf + bufsize + 1;    // All data should be written after decompression finished
     uint64 offset = 0;                    // Current outfile position corresponding to beginning of outbuf
     int offset_overflow = 0;              // Flags that offset was overflowed so we can't use it for match checking
@@ -429,11 +1098,10 @@ int tor_decompress0 (CALLBACK_FUNC *callback, void *auxdata, int _bufsize, int m
             UINT dist = decoder.getdist();
             print_match (output-outbuf+offset, len, dist);
 
-            // Check for simple match (i.e. match not requiring any special handling, >99% of matches fail to this category)
+            // Check for simple match (i.e. match not requiring any special handling, >99% of matches fail to this category).
+            // Bytes written after the match end by copy_match() fall either into outbuf or PAD_FOR_TABLES area after it
             if (output-outbuf>=dist && write_end-output>len) {
-                BYTE *p = output-dist;
-                do   *output++ = *p++;
-                while (--len);
+                output = copy_match (output, dist, len);
 
             // Check that it's a proper match
             } else if (len<IMPOSSIBLE_LEN) {
@@ -467,7 +1135,8 @@ int tor_decompress0 (CALLBACK_FUNC *callback, void *auxdata, int _bufsize, int m
         }
     }
 finished:
-    BigFree(outbuf-PAD_FOR_TABLES);
+    if (dict)  tor_return_outbuf (dict, cached);
+    else       BigFree(outbuf-PAD_FOR_TABLES);
     // Return decoder error code, errcode or FREEARC_OK
     return decoder.error() < 0 ?  decoder.error() :
            errcode         < 0 ?  errcode
@@ -475,7 +1144,137 @@ finished:
 }
 
 
-int tor_decompress (CALLBACK_FUNC *callback, void *auxdata)
+// Read frames index following the end-of-stream marker and check that it matches the stream:
+// index[] holds compressed and original offsets of all frames decompressed and of the stream end
+int tor_check_frames_index (CALLBACK_FUNC *callback, void *auxdata, uint frames, uint64 *index)
+{
+    int errcode = FREEARC_OK;
+    BYTE entry[FRAMES_INDEX_ENTRY];
+    for (uint i=0; i<=frames; i++) {
+        READ (entry, FRAMES_INDEX_ENTRY);
+        if (value64(entry) != index[2*i]  ||  value64(entry+8) != index[2*i+1])  {errcode=FREEARC_ERRCODE_BAD_COMPRESSED_DATA; goto finished;}
+    }
+    READ (entry, FRAMES_INDEX_FOOTER);
+    if (value32(entry) != frames  ||  value32(entry+4) != FRAMES_INDEX_SIGNATURE)  {errcode=FREEARC_ERRCODE_BAD_COMPRESSED_DATA; goto finished;}
+finished:
+    return errcode<0? errcode : FREEARC_OK;
+}
+
+
+// Multithreaded decompression of framed stream ****************************************************
+
+struct TornadoMTDecompressor;
+
+// Single Tornado decompression thread: decompresses one frame into memory block
+struct TornadoDecompressionThread : WorkerThread
+{
+    TornadoMTDecompressor* decompressor;
+    uint origsize;    // Original size of the frame being decompressed
+    int init();
+    int process();
+    int done();
+};
+
+// Multi-threaded decompressor of framed stream. Frames are read and decompressed in parallel,
+// while the Writer thread outputs decompressed blocks in the stream order
+struct TornadoMTDecompressor : MTCompressor<TornadoDecompressionThread>
+{
+    uint blocksize;   // Maximum original size of frame
+    int  flags;       // Framed stream flags
+    uint64 *index;    // Compressed and original offset of each frame read so far (used to check the frames index)
+    uint    frames;   // Number of frames read
+
+    TornadoMTDecompressor (CALLBACK_FUNC *callback, void *auxdata, uint _blocksize, int _flags)
+    {
+        this->callback = callback;
+        this->auxdata  = auxdata;
+        blocksize = _blocksize,  flags = _flags;
+        index = NULL;  frames = 0;
+    }
+    ~TornadoMTDecompressor()  {free(index);}
+
+    // Remember offsets of the next frame start (or the stream end) as it should be recorded in the frames index
+    int add_frame (uint64 comppos, uint64 origpos)
+    {
+        if (frames%1024 == 0) {
+            uint64 *p = (uint64*) realloc (index, (frames+1024) * 2*sizeof(uint64));
+            if (!p)  return FREEARC_ERRCODE_NOT_ENOUGH_MEMORY;
+            index = p;
+        }
+        index[2*frames] = comppos,  index[2*frames+1] = origpos;
+        return FREEARC_OK;
+    }
+
+    int main_cycle()
+    {
+        int errcode = FREEARC_OK;
+        uint64 comppos = FRAMED_STREAM_HEADER_SIZE,  origpos = 0;
+        for(;;)
+        {
+            if (flags & FRAMES_INDEX)  {errcode = add_frame (comppos, origpos);  if (errcode<0)  return errcode;}
+            // Read frame header: compressed and original sizes
+            uint compsize;  READ4 (compsize);
+            if (compsize==0)  return flags & FRAMES_INDEX?  tor_check_frames_index (callback, auxdata, frames, index)  :  FREEARC_OK;
+            uint origsize;  READ4 (origsize);
+            if (compsize > tornado_frame_bound(blocksize)  ||  origsize > blocksize)  return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+            comppos += FRAME_HEADER_SIZE+compsize,  origpos += origsize,  frames++;
+
+            TornadoDecompressionThread *job = FreeJobs.Get();   // Acquire next decompression job
+            if (this->errcode < 0)  return 0;                    // Error in other thread
+            READ (job->InBuf, compsize);
+            // Frames are ordinary Tornado streams, but nested framed streams aren't allowed
+            if (BYTE(job->InBuf[0]) == FRAMED_STREAM)  return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+            job->InSize   = compsize;
+            job->origsize = origsize;
+            WriterJobs.Put(job);
+            job->StartOperation.Signal();
+        }
+finished:
+        return errcode;
+    }
+};
+
+int TornadoDecompressionThread::init()      // Alloc resources
+{
+    decompressor = (TornadoMTDecompressor*) task;
+    InBuf  = (char*) BigAlloc (tornado_frame_bound (decompressor->blocksize));
+    OutBuf = (char*) BigAlloc (decompressor->blocksize);
+    return (InBuf && OutBuf? 0 : FREEARC_ERRCODE_NOT_ENOUGH_MEMORY);
+}
+
+int TornadoDecompressionThread::process()   // Decompress one frame
+{
+    TornadoFrame out;
+    out.buf  = (BYTE*) OutBuf;
+    out.size = decompressor->blocksize;
+    out.pos  = 0;
+    TornadoFrame frame;
+    frame.callback = tor_frame_writer;  frame.auxdata = &out;
+    frame.buf = (BYTE*) InBuf;  frame.size = InSize;  frame.pos = 0;  frame.written = 0;
+    int errcode = tor_decompress (tor_frame_reader, &frame);
+    if (errcode < 0)  return errcode==FREEARC_ERRCODE_OUTBLOCK_TOO_SMALL? FREEARC_ERRCODE_BAD_COMPRESSED_DATA : errcode;
+    if (out.pos != origsize)  return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+    return out.pos;
+}
+
+int TornadoDecompressionThread::done()      // Free resources
+{
+    BigFree(OutBuf);  OutBuf = NULL;
+    BigFree(InBuf);   InBuf  = NULL;
+    return 0;
+}
+
+// Memory used by multithreaded decompression: every decompression thread has its own decoder window,
+// and every job (including extra ones used for I/O buffering) holds compressed frame and decompressed block
+MemSize tornado_mt_decompression_mem (PackMethod m)
+{
+    uint block = mymin (m.buffer, m.block_size);
+    int  threads = GetCompressionThreads(),  jobs = threads + threads/2 + 1;
+    return threads * (block + PAD_FOR_TABLES*2)
+         + jobs    * (block + tornado_frame_bound(block));
+}
+
+int tor_decompress (CALLBACK_FUNC *callback, void *auxdata, TornadoDictionary *dict)
 {
     int errcode;
     // First 6 bytes of compressed data are encoding method, minimum match length and buffer size
@@ -486,16 +1285,23 @@ int tor_decompress (CALLBACK_FUNC *callback, void *auxdata)
 
     switch (encoding_method) {
     case BYTECODER:
-            return tor_decompress0 <LZ77_ByteDecoder> (callback, auxdata, bufsize, minlen);
+            return tor_decompress0 <LZ77_ByteDecoder> (callback, auxdata, bufsize, minlen, dict);
 
     case BITCODER:
-            return tor_decompress0 <LZ77_BitDecoder>  (callback, auxdata, bufsize, minlen);
+            return tor_decompress0 <LZ77_BitDecoder>  (callback, auxdata, bufsize, minlen, dict);
 
     case HUFCODER:
-            return tor_decompress0 <LZ77_Decoder <HuffmanDecoder<EOB_CODE> > > (callback, auxdata, bufsize, minlen);
+            return tor_decompress0 <LZ77_Decoder <HuffmanDecoder<EOB_CODE> > > (callback, auxdata, bufsize, minlen, dict);
 
     case ARICODER:
-            return tor_decompress0 <LZ77_Decoder <ArithDecoder<EOB_CODE> >   > (callback, auxdata, bufsize, minlen);
+            return tor_decompress0 <LZ77_Decoder <ArithDecoder<EOB_CODE> >   > (callback, auxdata, bufsize, minlen, dict);
+
+    case FRAMED_STREAM:   // Framed streams are never compressed with preset dictionary
+            if (dict || (minlen & ~FRAMES_INDEX))  return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+            {
+                TornadoMTDecompressor d (callback, auxdata, bufsize, minlen);
+                return d.run();
+            }
     default:
             errcode = FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
     }
@@ -503,6 +1309,88 @@ finished: return errcode;
 }
 
 
+// Random access to framed stream ******************************************************************
+
+// Destination of tor_decompress_at(): skips decompressed data until requested offset,
+// then fills the output buffer and stops decompression
+struct TornadoRangeWriter
+{
+    BYTE   *out;      // Output buffer
+    int     outsize;  // ..its size
+    int     outpos;   // ..and amount of data already placed here
+    uint64  skip;     // Bytes to skip before output starts
+};
+
+int tor_range_writer (const char *what, void *data, int size, void *auxdata)
+{
+    TornadoRangeWriter &w = *(TornadoRangeWriter*)auxdata;
+    if (strequ(what,"write")) {
+        BYTE *p = (BYTE*)data;  int n = size;
+        int skipped = mymin (w.skip, uint64(n));
+        p += skipped,  n -= skipped,  w.skip -= skipped;
+        n = mymin (n, w.outsize-w.outpos);
+        memcpy (w.out+w.outpos, p, n);
+        w.outpos += n;
+        return w.outpos==w.outsize? FREEARC_ERRCODE_NO_MORE_DATA_REQUIRED : size;
+    }
+    return FREEARC_ERRCODE_NOT_IMPLEMENTED;
+}
+
+// Decompress outsize bytes starting at the given offset of original data from the framed stream with index,
+// entirely held in memory (f.e. mapped file). Only frames containing requested data are decompressed.
+// Returns amount of data placed to out[] (less than outsize only at the end of data) or error code
+int tor_decompress_at (void *data, uint64 datasize, uint64 offset, void *out, int outsize)
+{
+    BYTE *stream = (BYTE*)data;
+    if (datasize < FRAMED_STREAM_HEADER_SIZE + FRAMES_INDEX_FOOTER)     return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+    if (stream[0] != FRAMED_STREAM  ||  !(stream[1] & FRAMES_INDEX))   return FREEARC_ERRCODE_NOT_IMPLEMENTED;   // Stream without index
+    uint blocksize = value32 (stream+2);
+
+    // Locate index at the stream end
+    BYTE *footer = stream + datasize - FRAMES_INDEX_FOOTER;
+    uint frames  = value32 (footer);
+    if (value32(footer+4) != FRAMES_INDEX_SIGNATURE
+    ||  (datasize - FRAMED_STREAM_HEADER_SIZE - FRAMES_INDEX_FOOTER) / FRAMES_INDEX_ENTRY <= frames)   return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+    BYTE *index = footer - uint64(frames+1)*FRAMES_INDEX_ENTRY;
+#define COMPPOS(i)  value64 (index + uint64(i)*FRAMES_INDEX_ENTRY)
+#define ORIGPOS(i)  value64 (index + uint64(i)*FRAMES_INDEX_ENTRY + 8)
+    // Frames should fill the stream from its header up to the end-of-stream marker (4 zero bytes) preceding the index
+    uint64 limit = uint64(index-stream) - 4;
+    if (COMPPOS(0) != FRAMED_STREAM_HEADER_SIZE  ||  ORIGPOS(0) != 0
+    ||  COMPPOS(frames) != limit  ||  value32(stream+limit) != 0)   return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+    if (offset >= ORIGPOS(frames)  ||  outsize <= 0)  return 0;
+
+    // Binary search for the last frame starting at or before offset
+    uint lo = 0, hi = frames-1;
+    while (lo < hi) {
+        uint mid = (lo+hi+1)/2;
+        if (ORIGPOS(mid) <= offset)  lo = mid;  else  hi = mid-1;
+    }
+
+    TornadoRangeWriter w;
+    w.out = (BYTE*)out,  w.outsize = outsize,  w.outpos = 0,  w.skip = offset - ORIGPOS(lo);
+    for (uint i=lo; i<frames && w.outpos<outsize; i++) {
+        uint64 pos = COMPPOS(i);
+        if (pos > limit  ||  limit-pos < FRAME_HEADER_SIZE  ||  COMPPOS(i+1) > limit)  return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+        uint compsize = value32 (stream+pos),  origsize = value32 (stream+pos+4);
+        if (compsize > tornado_frame_bound(blocksize)  ||  origsize > blocksize
+        ||  COMPPOS(i+1) - pos - FRAME_HEADER_SIZE != compsize  ||  ORIGPOS(i) + origsize != ORIGPOS(i+1))   return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+        // Frames are ordinary Tornado streams, but nested framed streams aren't allowed
+        if (stream[pos+FRAME_HEADER_SIZE] == FRAMED_STREAM)  return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+        TornadoFrame frame;
+        frame.callback = tor_range_writer;  frame.auxdata = &w;
+        frame.buf = stream + pos + FRAME_HEADER_SIZE;  frame.size = compsize;  frame.pos = 0;  frame.written = 0;
+        int errcode = tor_decompress (tor_frame_reader, &frame);
+        if (errcode == FREEARC_ERRCODE_NO_MORE_DATA_REQUIRED)  break;
+        if (errcode < 0)  return errcode;
+        if (frame.written != origsize)  return FREEARC_ERRCODE_BAD_COMPRESSED_DATA;
+    }
+#undef COMPPOS
+#undef ORIGPOS
+    return w.outpos;
+}
+
+
 /*
 LZ77 model:
     -no lz if len small and dist large: don't have much sense with our MINLEN=4
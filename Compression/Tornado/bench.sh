@@ -0,0 +1,46 @@
+#!/bin/sh
+
+# Tornado benchmark for Unix: prints decompression speed (mb/sec of unpacked data, raw CPU time)
+# of every preset for one or more tor binaries, f.e. builds before and after a change.
+# With -c, compression is benchmarked instead and cycles per byte of input data are printed
+# (f.e. compare builds made with and without -DPREFETCH_DISTANCE=0)
+# usage: bench.sh [-c] FILE [TOR_BINARY...]   (default binary is ./tor, presets are -1..-${MAX_METHOD:-9})
+
+export LC_ALL='C'
+COMPRESS=''
+[ "$1" = "-c" ] && { COMPRESS=1; shift; }
+[ -f "$1" ] || { echo "usage: $0 [-c] FILE [TOR_BINARY...]"; exit 1; }
+FILE="$1"; shift
+[ $# -gt 0 ] || set -- ./tor
+TEMP="${TMPDIR:-/tmp}/tor-bench.$$"
+trap 'rm -f "$TEMP".tor "$TEMP".out' 0
+
+printf '%-8s' 'preset'
+for TOR; do printf '%16s' "$(basename "$TOR")"; done
+echo
+M=1
+while [ $M -le ${MAX_METHOD:-9} ]; do
+	printf '%-8s' "-$M"
+	for TOR; do
+		"$TOR" -$M -q <"$FILE" >"$TEMP".tor || exit 1
+		BEST=''
+		# best of 3 runs; speed is taken from the last line of tor statistics
+		for RUN in 1 2 3; do
+			if [ -n "$COMPRESS" ]; then
+				CYCLES=$("$TOR" -$M -qthp "$FILE" -o"$TEMP".tor 2>&1 | sed -n 's/.* \([0-9.]*\) cycles\/byte.*/\1/p' | tail -n 1)
+				BEST=$(echo "$BEST $CYCLES" | awk '{print (NF<2 || $1<$2? $1 : $2)}')
+				continue
+			fi
+			SPEED=$("$TOR" -d -cpu -qthp "$TEMP".tor -o"$TEMP".out 2>&1 | sed -n 's/.*speed \([0-9.]*\) mb\/sec.*/\1/p' | tail -n 1)
+			cmp -s "$FILE" "$TEMP".out || { echo " decompression failed: $TOR -$M"; exit 1; }
+			BEST=$(echo "$BEST $SPEED" | awk '{print ($1>$2? $1 : $2)}')
+		done
+		if [ -n "$COMPRESS" ]; then
+			printf '%11s c/b ' "$BEST"
+		else
+			printf '%11s mb/s' "$BEST"
+		fi
+	done
+	echo
+	M=$(($M + 1))
+done
@@ -35,9 +35,11 @@ PARM_STATS=''
 if [ "$MSYSTEM" = 'MINGW32' ]; then
 	PARM_SYSTEM='-DFREEARC_WIN'
 	PARM_TIME=''
+	PARM_THREADS=''
 else
 	PARM_SYSTEM='-DFREEARC_UNIX'
 	PARM_TIME='-lrt'
+	PARM_THREADS='-lpthread'
 fi
 
 for P; do
@@ -94,7 +96,7 @@ for P; do
 		esac
 	fi
 done
-CFLAGS="$CFLAGS$PARM_FULL$PARM_STATS$PARM_ADDR $PARM_ENDIANNES $PARM_SYSTEM $PARM_TIME -D_FILE_OFFSET_BITS=64 -o tor main.cpp"
+CFLAGS="$CFLAGS$PARM_FULL$PARM_STATS$PARM_ADDR $PARM_ENDIANNES $PARM_SYSTEM $PARM_TIME $PARM_THREADS -D_FILE_OFFSET_BITS=64 -o tor main.cpp"
 
 if [ "$PARM_PROF" = "$PROF_USE" ]; then
 	echo 'compiling binary for profiling...'
@@ -5,6 +5,11 @@
 #define FREEARC_STANDALONE_TORNADO
 #include "Tornado.cpp"
 #include "../Common.cpp"
+#include "../LZMA/Windows/Synchronization.cpp"
+
+// Number of threads used for multithreaded compression
+static int CompressionThreads = 1;
+int __cdecl GetCompressionThreads (void)  {return CompressionThreads;}
 
 static const char *PROGRAM_NAME = "Tornado";
 
@@ -19,7 +24,7 @@ static const char *parser_name[] = {"", "greedy", "lazy", "flexible", "optimal"}
 static char *name (PackMethod method)
 {
     static char namebuf[200], h[100], b[100], auxhash_size[100], u[100], ah[100];
-    const char*hashname[] = {"hash4", "chash4", "cchash4", "", "", "cchash5", "cchash6", "cchash7"};
+    const char*hashname[] = {"hash4", "chash4", "cchash4", "", "", "cchash5", "cchash6", "cchash7", "bt4"};
     int c  = method.encoding_method;
     int l  = method.hash_row_width;
     showMem (method.hashsize,     h);
@@ -29,7 +34,7 @@ static char *name (PackMethod method)
     int p  = method.match_parser;
     int h3 = method.hash3;
     sprintf (u, x<2 && method.update_step<999? "/u%d":"", method.update_step);
-    sprintf (ah, x>4? " + %s:%d %s":"", auxhash_size, method.auxhash_row_width, x>5? "cchash4" : "exhash4");
+    sprintf (ah, x>4 && x<8? " + %s:%d %s":"", auxhash_size, method.auxhash_row_width, x>5? "cchash4" : "exhash4");
     sprintf (namebuf, c==STORING? codec_name[c] : "%s parser, %s:%d%s %s%s%s, buffer %s, %s%s",
              parser_name[p], h, l, u, hashname[x], ah, h3==2?" + 256kb hash3 + 16kb hash2":h3?" + 16kb hash3 + 4kb hash2":"", b, codec_name[c], method.find_tables? "" : " w/o tables");
     return namebuf;
@@ -49,9 +54,11 @@ struct Results {
   FILESIZE insize, outsize;    // How many bytes was already read/written
   FILESIZE qoutsize;           // Size of compressed output (including data not yet written to disk)
   double start_time;           // When (de)compression was started
+  uint64 start_cycles;         // CPU timestamp counter at this moment
   double lasttime, lasttime2;  // Last time when we've updated progress indicator/console title
   bool   use_cpu_time;         // Compute pure CPU time used (instead of wall-clock time)
   bool   show_exact_percent;   // Show xx.x% progress indicator instead of xx%
+  uint64 start_pages[PAGE_TYPES];  // Memory allocated by BigAlloc() before (de)compression started, per page type
   bool   quiet_title, quiet_header, quiet_progress, quiet_result;
                                // Don't show window title/compression header/progress/results
 };
@@ -63,6 +70,18 @@ struct Results {
 #define GetSomeTime() (r.use_cpu_time? GetThreadCPUTime() : GetGlobalTime())
 #endif
 
+// Return CPU timestamp counter, used to report cycles per byte. Return 0 if it isn't available
+#if defined(FREEARC_NO_TIMING) || !(defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64))
+#define GetCycles() 0
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define GetCycles() __rdtsc()
+#endif
+
 // Callback function called by compression routine to read/write data.
 // Also it's called by the driver to init/shutdown its processing
 int ReadWriteCallback (const char *what, void *buf, int size, void *r_)
@@ -73,6 +92,8 @@ int ReadWriteCallback (const char *what, void *buf, int size, void *r_)
     r.insize = r.outsize = r.qoutsize = 0;
     r.show_exact_percent = FALSE;
     r.start_time = r.lasttime = r.lasttime2 = GetSomeTime();
+    r.start_cycles = GetCycles();
+    size_t pagesize[PAGE_TYPES];  GetBigAllocStats (r.start_pages, pagesize);
 #ifdef FREEARC_WIN
     if (strequ (r.filename, "-"))   // On windows, get_flen cannot return real filesize in situations like "type file|tor"
         r.filesize = -1;
@@ -158,8 +179,26 @@ int ReadWriteCallback (const char *what, void *buf, int size, void *r_)
 #ifndef FREEARC_NO_TIMING
       double speed = (r.mode==COMPRESS? insizeMB : outsizeMB) / mymax(time,0.001);
       if (time>0.001)  fprintf (stderr, ", time %.3lf secs, speed %.3lf mb/sec", time, speed);
+      // Cycles per byte of uncompressed data (timestamp counter runs at nominal frequency and includes I/O time)
+      uint64 cycles = GetCycles() - r.start_cycles;
+      if (cycles)  fprintf (stderr, ", %.1lf cycles/byte", double(cycles) / (r.mode==COMPRESS? r.insize : r.outsize));
 #endif
       fprintf (stderr, "\n");
+      // Page sizes used for hash tables and buffers when large pages were requested
+      if (r.method.large_pages != LARGE_PAGES_DEFAULT)
+      {
+        const char *page_type[] = {"", "transparent ", "huge "};
+        uint64 bytes[PAGE_TYPES];  size_t pagesize[PAGE_TYPES];  char page[100];
+        GetBigAllocStats (bytes, pagesize);
+        fprintf (stderr, "Memory:");
+        for (int i=0, first=1; i<PAGE_TYPES; i++)
+          if (bytes[i] -= r.start_pages[i]) {
+            showMem (pagesize[i], page);
+            fprintf (stderr, "%s %.1lf mb in %s%s pages", first? "":",", double(bytes[i])/mb, page_type[i], page);
+            first = 0;
+          }
+        fprintf (stderr, "\n");
+      }
     }
 #ifndef FREEARC_NO_TIMING
     if (!r.quiet_title && r.filesize)
@@ -194,6 +233,9 @@ int main (int argc, char **argv)
     // Output path/filename
     const char *output_filename = NULL;
 
+    // Preset dictionary filename
+    const char *dictionary_filename = NULL;
+
     // Process options until "--"
     // 1. First, process -0..-12 option if any
     for (char **argv_ptr = argv; *++argv_ptr!=NULL; ) {
@@ -234,6 +276,9 @@ int main (int argc, char **argv)
             else if (strcasecmp(param,"ss")==0)     r.method.hash3 = 2;
             else if (strcasecmp(param,"s+")==0)     r.method.hash3 = 1;
             else if (strcasecmp(param,"s-")==0)     r.method.hash3 = 0;
+            else if (strncasecmp(param,"mt",2)==0)  CompressionThreads = parseInt (param+2, &error);
+            else if (strncasecmp(param,"lp",2)==0) {r.method.large_pages = parseInt (param+2, &error);  if (r.method.large_pages >= LARGE_PAGES_MODES)  error=1;}
+            else if (strncasecmp(param,"dict=",5)==0)  dictionary_filename = param+5;
             else if (isdigit(*param))            ; // -0..-12 option is already processed :)
             else switch( tolower(*param++) ) {
                 case 'c': r.method.encoding_method = parseInt (param, &error); break;
@@ -245,6 +290,7 @@ int main (int argc, char **argv)
                 case 'o': output_filename          = param;                    break;
                 case 'h': r.method.hashsize        = parseMem (param, &error); break;
                 case 'u': r.method.update_step     = parseInt (param, &error); break;
+                case 'm': r.method.block_size      = parseMem (param, &error); break;
                 case 'q':
 #ifndef FREEARC_NO_TIMING
                           r.quiet_title            = strchr (param, 't');
@@ -309,10 +355,14 @@ check_for_errors:
         printf( "   -al#    -- auxiliary hash row length (1..65536), default %d\n", r.method.auxhash_row_width);
         printf( "   -u#     -- update step (1..999), default %d\n", r.method.update_step);
         printf( "   -c#     -- coder (1-bytes,2-bits,3-huf,4-arith), default %d\n", r.method.encoding_method);
-        printf( "   -p#     -- parser (1-greedy,2-lazy), default %d\n", r.method.match_parser);
-        printf( "   -x#     -- caching match finder (0-disabled,1-shifting,2-cycled,5-ht5,6-ht6,7-ht7), default %d\n", r.method.caching_finder);
+        printf( "   -p#     -- parser (1-greedy,2-lazy,4-optimal), default %d\n", r.method.match_parser);
+        printf( "   -x#     -- caching match finder (0-disabled,1-shifting,2-cycled,5-ht5,6-ht6,7-ht7,8-binary tree), default %d\n", r.method.caching_finder);
         printf( "   -s#     -- 2/3-byte hash (0-disabled,1-fast,2-max), default %d\n", r.method.hash3);
         printf( "   -t#     -- table diffing (0-disabled,1-enabled), default %d\n", r.method.find_tables);
+        printf( "   -m#     -- compress in independent blocks of given size, indexed for random access (0-disabled), default %d\n", r.method.block_size);
+        printf( "   -mt#    -- number of compression threads, default %d\n", CompressionThreads);
+        printf( "   -lp#    -- large pages for hash and buffers (0-system default,1-disabled,2-transparent,3-huge), default %d\n", r.method.large_pages);
+        printf( "   -dict=FILE -- preset dictionary, improves compression of small files (also required for decompression)\n");
         printf( "\n"
                 " Predefined methods:\n");
         for (int i=1; i<elements(std_Tornado_method); i++)
@@ -324,6 +374,24 @@ check_for_errors:
 
 
 
+    // Load preset dictionary
+    if (dictionary_filename) {
+        FILE *f = fopen (dictionary_filename, "rb");
+        if (f == NULL) {
+            fprintf (stderr, "\n Can't open %s for read\n", dictionary_filename);
+            exit(2);
+        }
+        uint size = get_flen(f);
+        BYTE *data = (BYTE*) malloc (mymax(size,1));
+        if (data == NULL  ||  file_read (f, data, size) != size  ||  (r.method.dictionary = tor_load_dictionary (data, size)) == NULL) {
+            fprintf (stderr, "\n Can't load dictionary %s\n", dictionary_filename);
+            exit(2);
+        }
+        fclose (f);
+        free (data);
+    }
+
+
     // (De)compress all files given on cmdline
     bool parse_options=TRUE;  // options will be parsed until "--"
     for (char **parameters = argv; *++parameters!=NULL; )
@@ -403,14 +471,17 @@ add_remove_ext: // Remove COMPRESS_EXT on the end of name or add DECOMPRESS_EXT
             if (!r.quiet_header && r.filesize >= 0)
                 fprintf (stderr, "Compressing %.3lf mb with %s\n", double(r.filesize)/1000/1000, name(r.method));
             PackMethod m = r.method;
+            // With preset dictionary, buffer should hold it plus at least the same amount of data (see tor_dictionary_size)
+            uint dictsize = m.dictionary? m.dictionary->size : 0;
             if (r.filesize >= 0)
-                m.buffer = mymin (m.buffer, r.filesize+LOOKAHEAD*2);
+                m.buffer = mymin (m.buffer, mymax(r.filesize,dictsize)+dictsize+LOOKAHEAD*2);
             result = tor_compress (m, ReadWriteCallback, &r);
             break; }
 
         case DECOMPRESS: {
             //if (!r.quiet_header && !strequ (r.outname, "-"))   fprintf (stderr, "Unpacking %.3lf mb\n", double(r.filesize)/1000/1000);
-            result = tor_decompress (ReadWriteCallback, &r);
+            LargePagesScope large_pages (r.method.large_pages);
+            result = tor_decompress (ReadWriteCallback, &r, r.method.dictionary);
             break; }
         }
 
@@ -248,7 +248,7 @@ int ENCRYPTION_METHOD::compress (CALLBACK_FUNC *callback, void *auxdata)
 }
 
 //   buf[MAX_METHOD_STRLEN] ,       (,   parse_ENCRYPTION)
-void ENCRYPTION_METHOD::ShowCompressionMethod (char *buf)
+void ENCRYPTION_METHOD::ShowCompressionMethod (char *buf, bool purify)
 {
     sprintf (buf, "%s-%d/%s:n%d:r%d%s%s%s%s%s%s%s%s"
                                         , cipher_descriptor[cipher].name, keySize*8
@@ -0,0 +1,97 @@
+// Partial extraction test: when the writer stops accepting data (as arc does after extracting
+// the last needed file of a solid block), decompressor must return FREEARC_ERRCODE_NO_MORE_DATA_REQUIRED
+// instead of hanging, for any number of threads and any stop point.
+// Compile with compile-partial-extraction, run without parameters; exit code 0 means success.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../Compression/Compression.h"
+
+// Memory buffer used as input or output stream
+struct Stream
+{
+  char *buf;
+  int   size, pos;
+  int   writes, stop;   // Writes made so far and number of writes after which the writer refuses data (-1: never)
+};
+
+struct Streams {Stream *in, *out;};
+
+int mem_callback (const char *what, void *buf, int size, void *auxdata)
+{
+  Stream *in = ((Streams*)auxdata)->in,  *out = ((Streams*)auxdata)->out;
+  if (strequ (what, "read")) {
+    int n = mymin (size, in->size - in->pos);
+    memcpy (buf, in->buf + in->pos, n);
+    in->pos += n;
+    return n;
+  } else if (strequ (what, "write")) {
+    if (out->stop >= 0  &&  out->writes++ >= out->stop)   return FREEARC_ERRCODE_NO_MORE_DATA_REQUIRED;
+    if (size > out->size - out->pos)                      return FREEARC_ERRCODE_OUTBLOCK_TOO_SMALL;
+    memcpy (out->buf + out->pos, buf, size);
+    out->pos += size;
+    return size;
+  } else {
+    return FREEARC_ERRCODE_NOT_IMPLEMENTED;
+  }
+}
+
+// (De)compress whole input buffer into output one, returning errcode
+int process (bool decompress, char *method, Stream *in, Stream *out)
+{
+  Streams s = {in, out};
+  in->pos = 0,  out->pos = 0,  out->writes = 0;
+  return decompress?  Decompress (method, mem_callback, &s)  :  Compress (method, mem_callback, &s);
+}
+
+int main (void)
+{
+  // Compressible data: random words from small vocabulary
+  const int size = 4*mb;
+  Stream orig = {(char*) malloc(size), size, 0, 0, -1};
+  srand (1);
+  for (int i=0; i<size; i++)
+    orig.buf[i] = (i%8==7? ' ' : 'a' + (rand()>>4)%4 + (i/8)%3);
+  Stream packed   = {(char*) malloc(size*2), size*2, 0, 0, -1};
+  Stream unpacked = {(char*) malloc(size),   size,   0, 0, -1};
+
+  // Methods split data into many independent blocks, processed by multithreaded decompressors
+  static char *methods[] = {"lzp:64k:h18", "grzip:128k:m4", "tor:3:m64k"};
+  static int threads[]   = {1, 2, 4, 8};
+  static int stops[]     = {0, 2, 5, 10, 20};
+  int failures = 0;
+
+  // Every case either finishes quickly or hangs, so the whole test is limited by alarm
+  alarm (600);
+  for (int m=0; m < sizeof(methods)/sizeof(*methods); m++)
+  {
+    SetCompressionThreads (1);
+    int errcode = process (false, methods[m], &orig, &packed);
+    if (errcode < 0)  {printf ("%s: compression error %d\n", methods[m], errcode);  failures++;  continue;}
+    packed.size = packed.pos;
+
+    for (int t=0; t < sizeof(threads)/sizeof(*threads); t++)
+    {
+      SetCompressionThreads (threads[t]);
+      unpacked.stop = -1;
+      errcode = process (true, methods[m], &packed, &unpacked);
+      if (errcode < 0  ||  unpacked.pos != size  ||  memcmp (orig.buf, unpacked.buf, size))
+        {printf ("%s, %d threads: full decompression failed, errcode %d\n", methods[m], threads[t], errcode);  failures++;}
+
+      for (int s=0; s < sizeof(stops)/sizeof(*stops); s++)
+      {
+        unpacked.stop = stops[s];
+        errcode = process (true, methods[m], &packed, &unpacked);
+        if (errcode != FREEARC_ERRCODE_NO_MORE_DATA_REQUIRED  ||  memcmp (orig.buf, unpacked.buf, unpacked.pos))
+          {printf ("%s, %d threads, stop after %d writes: errcode %d\n", methods[m], threads[t], stops[s], errcode);  failures++;}
+      }
+    }
+    packed.size = size*2;
+  }
+
+  printf (failures? "%d tests FAILED\n" : "All tests passed\n", failures);
+  return failures? EXIT_FAILURE : EXIT_SUCCESS;
+}
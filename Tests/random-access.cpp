@@ -0,0 +1,115 @@
+// Random access test of framed Tornado streams: tor_decompress_at() should return exactly
+// the requested range of original data, and reject streams with corrupted frames index.
+// Compile with compile-random-access, run without parameters; exit code 0 means success.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Compression/Compression.h"
+
+// Declared in Tornado/C_Tornado.h, that can't be included without Tornado sources
+extern "C" int tor_decompress_at (void *data, uint64 datasize, uint64 offset, void *out, int outsize);
+
+// Memory buffer used as input or output stream
+struct Stream
+{
+  char *buf;
+  int   size, pos;
+};
+
+struct Streams {Stream *in, *out;};
+
+int mem_callback (const char *what, void *buf, int size, void *auxdata)
+{
+  Stream *in = ((Streams*)auxdata)->in,  *out = ((Streams*)auxdata)->out;
+  if (strequ (what, "read")) {
+    int n = mymin (size, in->size - in->pos);
+    memcpy (buf, in->buf + in->pos, n);
+    in->pos += n;
+    return n;
+  } else if (strequ (what, "write")) {
+    if (size > out->size - out->pos)   return FREEARC_ERRCODE_OUTBLOCK_TOO_SMALL;
+    memcpy (out->buf + out->pos, buf, size);
+    out->pos += size;
+    return size;
+  } else {
+    return FREEARC_ERRCODE_NOT_IMPLEMENTED;
+  }
+}
+
+// Decompress the range of original data and compare it with the original; return number of failures
+int check_range (Stream *packed, Stream *orig, char *out, uint64 offset, int size)
+{
+  int expected = offset >= orig->size? 0 : mymin (uint64(size), orig->size - offset);
+  int result   = tor_decompress_at (packed->buf, packed->size, offset, out, size);
+  if (result == expected  &&  memcmp (out, orig->buf + offset, expected) == 0)  return 0;
+  printf ("offset %llu, size %d: got %d, expected %d\n", (unsigned long long)offset, size, result, expected);
+  return 1;
+}
+
+int main (void)
+{
+  // Compressible data: random words from small vocabulary
+  const int size = 4*mb;
+  Stream orig = {(char*) malloc(size), size, 0};
+  srand (1);
+  for (int i=0; i<size; i++)
+    orig.buf[i] = (i%8==7? ' ' : 'a' + (rand()>>4)%4 + (i/8)%3);
+  Stream packed = {(char*) malloc(size*2), size*2, 0};
+  char *out     = (char*) malloc(size+1);
+  int failures = 0;
+
+  // Small blocks make framed stream with many frames
+  Streams s = {&orig, &packed};
+  SetCompressionThreads (2);
+  int errcode = Compress ("tor:3:m64k", mem_callback, &s);
+  if (errcode < 0)  {printf ("compression error %d\n", errcode);  return EXIT_FAILURE;}
+  packed.size = packed.pos;
+
+  // Whole data, frame boundaries, ranges crossing the end of data and random ranges
+  failures += check_range (&packed, &orig, out, 0, size+1);
+  failures += check_range (&packed, &orig, out, 64*kb-1, 2);
+  failures += check_range (&packed, &orig, out, size-10, 100);
+  failures += check_range (&packed, &orig, out, size, 100);
+  for (int i=0; i<300; i++) {
+    uint64 offset = (uint64(rand())*RAND_MAX + rand()) % (size+100);
+    failures += check_range (&packed, &orig, out, offset, 1 + (uint64(rand())*RAND_MAX + rand()) % (size/2));
+  }
+
+  // Index entries pointing outside of the stream or inconsistent with frame headers should be rejected
+  uint frames = *(uint32*)(packed.buf + packed.size - 8);
+  char *index = packed.buf + packed.size - 8 - (frames+1)*16;
+  const int entries[] = {0, 1, int(frames/2), int(frames-1), int(frames)};
+  static const uint64 values[] = {0, 3, uint64(-1), uint64(-8), 200000};
+  for (int e=0; e < sizeof(entries)/sizeof(*entries); e++)
+    for (int v=0; v < sizeof(values)/sizeof(*values); v++)
+      for (int field=0; field<16; field+=8)
+      {
+        uint64 saved;  memcpy (&saved, index + entries[e]*16 + field, 8);
+        uint64 value = saved + values[v];
+        memcpy (index + entries[e]*16 + field, &value, 8);
+        if (values[v] != 0) {
+          int result = tor_decompress_at (packed.buf, packed.size, 0, out, size);
+          if (result >= 0)
+            {printf ("index entry %d field %d changed by %lld: got %d instead of error\n", entries[e], field, (long long)values[v], result);  failures++;}
+        }
+        memcpy (index + entries[e]*16 + field, &saved, 8);
+      }
+  // Frame size that doesn't match the index
+  char *frame = packed.buf + *(uint64*)(index + (frames-1)*16);
+  *(uint32*)frame += 100;
+  if (tor_decompress_at (packed.buf, packed.size, 0, out, size) >= 0)
+    {printf ("corrupted frame header accepted\n");  failures++;}
+  *(uint32*)frame -= 100;
+  // Last frame extending past the stream end, with index entries consistent with its header
+  uint64 saved_end = *(uint64*)(index + frames*16);
+  *(uint32*)frame += 200000,  *(uint64*)(index + frames*16) += 200000;
+  if (tor_decompress_at (packed.buf, packed.size, 0, out, size) >= 0)
+    {printf ("frame extending past the stream end accepted\n");  failures++;}
+  *(uint32*)frame -= 200000,  *(uint64*)(index + frames*16) = saved_end;
+  failures += check_range (&packed, &orig, out, 0, size);
+
+  printf (failures? "%d tests FAILED\n" : "All tests passed\n", failures);
+  return failures? EXIT_FAILURE : EXIT_SUCCESS;
+}
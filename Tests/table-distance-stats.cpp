@@ -0,0 +1,74 @@
+// Checks all versions of table_distance_stats() against the original Delta scanning loop,
+// which remembered position of the last byte with each value of 4 higher bits over all lines scanned.
+// Compile with compile-table-distance-stats, run without parameters; exit code 0 means success.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Compression/SIMD.h"
+
+const int LINE = 32;
+
+// Data where Delta looks for tables: random bytes, zeroes and tables with rows of 1..TABLE_MAX_DIST+2 bytes
+void fill (BYTE *buf, int size)
+{
+  for (BYTE *p = buf, *end = buf+size;  p < end; )
+  {
+    int len = mymin (1 + rand()%3000,  end-p);
+    switch (rand()%3)
+    {
+      case 0:  for (int i=0; i<len; i++)  p[i] = rand();  break;
+      case 1:  memset (p, 0, len);  break;
+      case 2:  int N = 1 + rand()%(TABLE_MAX_DIST+2);
+               for (int i=0; i<len; i++)  p[i] = i<N? rand() : p[i-N] + rand()%8 - 4;
+               break;
+    }
+    p += len;
+  }
+}
+
+int main (void)
+{
+  const int size = 4 << 20;
+  BYTE *buf = (BYTE*) malloc (size);
+  int failures = 0,  lines = 0;
+  srand (1);
+  fill (buf, size);
+
+  BYTE *hash[16];  iterate_var(i,16)  hash[i] = buf-1;   // original loop state
+  BYTE  prev_line[LINE],  *prev_ptr = NULL;
+  for (BYTE *ptr = buf+LINE;  ptr+LINE*3 < buf+size;  lines++)
+  {
+    // Original loop: distance to the last byte with the same 4 higher bits
+    BYTE ref[TABLE_MAX_DIST];  zeroArray(ref);
+    for (BYTE *p = ptr;  p < ptr+LINE;  p++)
+    {
+      int n = p - hash[*p/16];
+      hash[*p/16] = p;
+      if (n<=TABLE_MAX_DIST)  ref[n-1]++;
+    }
+
+    BYTE *prev = prev_ptr? prev_line : NULL;
+    int   gap  = prev_ptr? ptr-(prev_ptr+LINE) : 0;
+    BYTE  count[3][TABLE_MAX_DIST];  char *name[3] = {"scalar", "sse2", "avx2"};  int versions = 1;
+    table_distance_stats_scalar (ptr, prev, gap, count[0]);
+#ifdef FREEARC_SIMD
+    if (simd_level() >= SIMD_SSE2)  table_distance_stats_sse2 (ptr, prev, gap, count[1]),  versions = 2;
+    if (simd_level() >= SIMD_AVX2)  table_distance_stats_avx2 (ptr, prev, gap, count[2]),  versions = 3;
+#endif
+    for (int v=0; v<versions; v++)
+      if (memcmp (ref, count[v], TABLE_MAX_DIST))
+        {if (failures++ < 10)  printf ("%s: wrong stats at offset %d, gap %d\n", name[v], int(ptr-buf), gap);}
+
+    // Delta diffs tables in place after they were scanned, and skips lines, f.e. inside found tables
+    memcpy (prev_line, ptr, LINE),  prev_ptr = ptr;
+    if (rand()%4 == 0)  iterate_var(i,LINE)  ptr[i] -= ptr[i-1];
+    ptr += LINE;
+    if (rand()%3 == 0)  ptr += rand() % (rand()%8==0? 200 : 40);
+  }
+
+  if (failures)  printf ("%d of %d lines FAILED\n", failures, lines);
+  else           printf ("All %d lines passed\n", lines);
+  return failures? EXIT_FAILURE : EXIT_SUCCESS;
+}
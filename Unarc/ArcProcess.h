@@ -146,6 +146,9 @@ int PROCESS::DecompressCallback (const char *what, void *buf, int size)
     }
     return origsize;     //       
 
+  } else if (strequ (what, "testing")) {
+    return cmd->cmd=='t';  //    -      
+
   } else return FREEARC_ERRCODE_NOT_IMPLEMENTED;
 }
 